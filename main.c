@@ -53,6 +53,9 @@
 #include <xscugic.h>
 #include "platform.h"
 #include "smmu_driver.h"
+#include "smmu_snapshot.h"
+#include "smmu_ptgen.h"
+#include "smmu_dma.h"
 #include "xzdma.h"
 #include "xaxicdma.h"
 
@@ -68,6 +71,8 @@
 #define HPC0_TBU 0x0
 #define DAP_APB_control_TBU 0x2
 
+#define DMA_TIMEOUT_US 1000
+
 /* https://support.xilinx.com/s/question/0D52E00006hpmCxSAI/smmu-on-zcu102?language=en_US */
 /* https://docs.xilinx.com/r/en-US/ug1085-zynq-ultrascale-trm/Master-IDs-List */
 /* https://docs.xilinx.com/r/en-US/ug1087-zynq-ultrascale-registers */
@@ -109,6 +114,12 @@ u64 cb1_tt_l1_base_64[4] __attribute__((aligned(GRANULE)));
 u16 output_address_0 = 0x0; // flat [39:30] = 0b00000000
 u16 output_address_1 = 0x1; // not flat [39:30] = 0b00000001
 
+// SMMU configuration saved for the warm boot, it is kept in the OCM across resets (NOLOAD section)
+// #define SMMU_WARM_BOOT 1
+#ifdef SMMU_WARM_BOOT
+u8 smmu_snapshot_ocm[SMMU_SNAPSHOT_OCM_SIZE] SMMU_SNAPSHOT_SECTION;
+#endif
+
 /* -- NOTES -- */
 
 /*
@@ -253,6 +264,25 @@ int main()
 
 	// set the HP0 as a secure port
 
+#ifdef SMMU_WARM_BOOT
+	// warm boot: replay the saved configuration instead of recomputing it
+	if (smmu_snapshot_restore(smmu_snapshot_ocm) == XST_SUCCESS){
+		xil_printf("# APU0: SMMU configuration restored from the OCM snapshot\n\r");
+		goto smmu_configured;
+	}
+#endif
+
+// #define SMMU_PTGEN_IMAGE 1
+#ifdef SMMU_PTGEN_IMAGE
+	// tables and registers precomputed by tools/smmu_ptgen from tools/layout_main.txt
+	if (smmu_ptgen_verify(&smmu_ptgen_image_data) == XST_SUCCESS){
+		set_SMMU_sCR0(0x1, 0x1, 0x1, 0x1, 0x1);
+		smmu_ptgen_apply(&smmu_ptgen_image_data);
+		set_SMMU_sCR0(0x0, 0x1, 0x1, 0x1, 0x1);
+		goto smmu_configured;
+	}
+#endif
+
 #ifndef VA_64_Config
 
 /* -------------- 32 bit lpae config -------------- */
@@ -786,6 +816,14 @@ int main()
 /* -------------- 64 bit config -------------- */
 #endif
 
+#ifdef SMMU_WARM_BOOT
+	// cold boot: save the configuration for the next warm boot
+	xil_printf("# APU0: SMMU snapshot of %d bytes saved\n\r", smmu_snapshot_capture(smmu_snapshot_ocm, sizeof(smmu_snapshot_ocm)));
+#endif
+
+#if defined(SMMU_WARM_BOOT) || defined(SMMU_PTGEN_IMAGE)
+smmu_configured:
+#endif
 	xil_printf("# APU0: All is set \n\r");
 
 	/* Note: the SrcAddr (SrcBuf) and the DstAddr (DstBuf) are both written in the CDMA register, for this
@@ -841,15 +879,12 @@ int main()
 
 	// CDMA1 transfer
 	XAxiCdma_SimpleTransfer(&FpdCDma1, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
-	while (XAxiCdma_IsBusy(&FpdCDma1));
-
-	// wait for 5 seconds for the transfer
-	/*sleep(5);
-	if(XAxiCdma_IsBusy(&FpdCDma1)){
-		printCBnErrors(1);
-		printSMMUGlobalErr();
-	}*/
-	//while (XAxiCdma_IsBusy(&FpdCDma1));
+
+	// bounded wait: a faulting transfer is reported with its cause and the CDMA reset, instead of hanging here
+	smmu_dma_result result;
+	if (smmu_dma_wait_cdma(&FpdCDma1, (HPC0_TBU << 10) | CDMA1_MID, DMA_TIMEOUT_US, &result) != XST_SUCCESS){
+		smmu_dma_print(&result);
+	}
 
 	// print
 	xil_printf("# APU0: Completed\n\r");
@@ -53,6 +53,20 @@
  #include <xscugic.h>
  #include "platform.h"
  #include "smmu_driver.h"
+ #include "smmu_pgtable.h"
+ #include "smmu_fault.h"
+ #include "smmu_lazy.h"
+ #include "smmu_asid.h"
+ #include "smmu_domain.h"
+ #include "smmu_smr.h"
+ #include "smmu_gdma.h"
+ #include "smmu_iova.h"
+ #include "smmu_finject.h"
+ #include "smmu_irq.h"
+ #include "smmu_dma.h"
+ #include "smmu_dmaq.h"
+ #include "smmu_dmapool.h"
+ #include "smmu_zcopy.h"
  #include "xzdma.h"
  #include "xaxicdma.h"
  #include "xtime_l.h"
@@ -60,6 +74,135 @@
  // EXPERIMENTS PARAMS
  #define N_TRANSFERS 10000
  #define N_CDMA 2
+ #define DMA_TIMEOUT_US 1000 // bounded wait of a transfer: past it the CDMA is reset and the cause reported
+ // #define REMAP_TEST 1 // migrate the CB1 block to DDR low under live translation before the benchmark
+ // #define IOVA_LOOKUP_BENCH 1 // compare software walk, translation cache and ATS1PR lookups on CB2
+ #define N_LOOKUPS 10000
+ #define IOVA_BENCH_SIZE 0x200000 // 2MB of 4KB pages: more pages than translation cache entries
+ #define IOVA_BENCH_HOT_SIZE 0x40000 // working set that fits in the translation cache
+ // #define STALL_FAULT_BENCH 1 // CDMA1 transfers on unmapped pages, mapped by the stall fault handler
+ #define N_FAULT_TRANSFERS 1000
+ // #define LAZY_MAP_BENCH 1 // sparse CDMA1 transfers in a lazily mapped window, against an eager mapping of it
+ #define LAZY_WINDOW_VA 0x10000000
+ #define LAZY_WINDOW_PA 0x34000000 // DDR low: reachable with the 32-bit PASize of the bank
+ #define LAZY_WINDOW_SIZE 0x4000000 // 64MB
+ #define LAZY_STRIDE 0x100000 // one transfer per 1MB of the window
+ #define LAZY_PREFETCH 1
+ // #define ASID_SWITCH_BENCH 1 // CB1 switched between two tenants by TTBR0/ASID swap and by TLBIALL
+ #define N_SWITCHES 1000
+ #define TENANT_B_OFFSET 0x840000000 // tenant B sees DstBuf in DDR high, as the CB1 block mapping
+ // #define DOMAIN_BENCH 1 // SMMU_MAX_DOMAINS domains over CB2-CB15, CDMA1 in domain 0
+ #define DOMAIN_CB_MASK 0xFFFC
+ #define DOMAIN_FIRST_SMR 3
+ #define N_ACTIVATIONS 1000
+ #define DOMAIN_RETRIES 2 // transfers of CDMA1 in the evicted domain 0: the first one binds it
+ #define UNUSED_TBU 0x1F // stream ids of the domains without a master
+ // #define OVERHEAD_BENCH 1 // CDMA1 transfer sweep under bypass, stage 1 (1GB/2MB/4KB) and nested translation
+ #define N_OVERHEAD_TRANSFERS 100
+ #define OVERHEAD_SRC 0x20000000 // DDR low, flat in every configuration
+ #define OVERHEAD_DST 0x20200000
+ #define OVERHEAD_WINDOW 0x400000 // source and destination 2MB blocks
+ #define OVERHEAD_S2_CB 3 // stage 2 context bank of the nested configuration
+ #define OVERHEAD_S2_BLOCK SMMU_PT_BLOCK_2MB
+ // #define TLB_STRIDE_BENCH 1 // CDMA1 writes over a 4KB page window with growing working sets, for each stride
+ #define STRIDE_WINDOW_VA 0x40000000
+ #define STRIDE_WINDOW_PA 0x38000000 // DDR low, after the lazy window
+ #define STRIDE_WINDOW_SIZE 0x4000000 // 64MB: 16384 pages, 32 level 3 tables
+ #define N_STRIDE_TRANSFERS 4096
+ #define STRIDE_KNEE_PERCENT 10 // latency step between two working sets reported as a capacity limit
+ // #define CONTENTION_BENCH 1 // concurrent CDMAs and GDMA channels: same/separate CBs, same/different TBUs, shared/disjoint pages
+ #define N_CONTENTION_TRANSFERS 1000
+ #define N_GDMA_MASTERS 2 // FPD DMA channels among the masters
+ #define CONTENTION_SIZE 4096 // bytes per transfer
+ #define CONTENTION_WINDOW 0x20000000 // DDR low, flat: one working set per master
+ #define CONTENTION_WS_SIZE 0x40000 // 64 pages per master
+ #define CONTENTION_FIRST_SMR 3
+ #define CONTENTION_FIRST_CB 4
+ // #define GDMA_BENCH 1 // GDMA channels in parallel, simple and linked list mode, bypass and translated
+ #define N_GDMA_TRANSFERS 256 // per channel
+ #define GDMA_SIZE 0x4000 // bytes per transfer
+ #define GDMA_LIST_LEN 8 // transfers per linked list
+ #define GDMA_SRC 0x30000000 // DDR low, one window per channel, flat
+ #define GDMA_DST 0x31000000
+ #define GDMA_CH_WINDOW 0x100000
+ #define GDMA_FIRST_SMR 3
+ #define GDMA_FIRST_CB 8 // channel n on CB 8 + n
+ // #define IOVA_WINDOW_BENCH 1 // CDMA1 into DDR high: bounce buffer in DDR low + CPU copy, against direct DMA through an IOVA window
+ #define N_WINDOW_TRANSFERS 100
+ #define WINDOW_SIZE 0x10000 // bytes per transfer
+ #define WINDOW_SRC 0x22000000 // DDR low, flat
+ #define WINDOW_BOUNCE 0x22200000 // DDR low, flat
+ #define WINDOW_HIGH_DST 0x870000000 // DDR high, beyond the 32-bit address bus of the CDMA
+ #define WINDOW_IOVA 0x50000000 // IOVA window of CB1
+ #define WINDOW_IOVA_SIZE 0x1000000
+ // #define MEMTYPE_BENCH 1 // CDMA1 copies within buffers of each memory type of the MAIR table
+ #define N_MEMTYPE_TRANSFERS 1000
+ #define MEMTYPE_SIZE 0x1000 // bytes per transfer
+ #define MEMTYPE_VA 0x60000000
+ #define MEMTYPE_PA 0x24000000 // DDR low, a 2MB block per memory type: source in the first half, destination in the second
+ // #define WALK_PLACEMENT_BENCH 1 // cold-TLB CDMA1 latency with the CB1 tables in DDR low, the OCM and DDR high
+ #define N_WALK_TRANSFERS 1000
+ #define WALK_WINDOW_VA 0x70000000
+ #define WALK_WINDOW_PA 0x26000000 // DDR low, 4KB pages: every miss walks the three levels
+ #define WALK_WINDOW_SIZE 0x200000
+ // #define FAULT_INJECT_BENCH 1 // CDMA1 translation, permission and unidentified stream faults: fault-to-handler latency
+ #define N_INJECTIONS 256 // per kind of fault
+ #define INJECT_VA 0x78000000 // CB1: a read-only page, the next page unmapped
+ #define INJECT_PA 0x28000000
+ #define INJECT_SMR 1 // SMR1 of CDMA1, invalid during the unidentified stream faults
+ #define INJECT_TIMEOUT_US 1000
+ // #define SMMU_IRQ_DISPATCH 1 // SMMU line dispatched to the handlers of the banks (smmu_irq.c) instead of SMMU_InterruptHandler
+ #define SMMU_IRQ_CPU 0 // housekeeping core taking the SMMU faults, it must run a GIC CPU interface
+ #define SMMU_IRQ_PRIORITY 0xA0 // below the data-plane interrupts
+ // #define FAULT_STORM_BENCH 1 // CDMA1 fault storm on CB1: the bank goes from interrupt to polled mode and back
+ #define N_STORM_FAULTS 10000
+ #define STORM_VA 0x7C000000 // unmapped in CB1
+ #define STORM_TIMEOUT_US 10 // wait for the abort of a transfer
+ #define STORM_QUIET_MS 100 // polling after the storm
+ // #define DMA_HANG_BENCH 1 // CDMA1 writes to an unmapped page of CB1, aborted then stalled: detection and recovery of the transfer
+ #define N_HANG_TRANSFERS 100 // per fault mode
+ #define HANG_VA 0x7E000000 // unmapped in CB1
+ #define HANG_TIMEOUT_US 100
+ // #define DMAQ_BENCH 1 // CDMA1 copy jobs: map, transfer and unmap in sequence against the asynchronous pipeline (smmu_dmaq.c)
+ #define N_DMAQ_JOBS 1000
+ #define DMAQ_SIZE 0x4000 // bytes per job
+ #define DMAQ_BUFFERS 32 // the jobs cycle over DMAQ_BUFFERS source and destination buffers
+ #define DMAQ_SRC 0x2A000000 // DDR low
+ #define DMAQ_DST 0x2A200000
+ #define DMAQ_IOVA 0x58000000 // IOVA window of CB1
+ #define DMAQ_IOVA_SIZE 0x1000000
+ // #define DMAPOOL_BENCH 1 // CDMA1 control transfers of 64B to 4KB: buffers mapped for each transfer against the pre-mapped pool
+ #define N_DMAPOOL_TRANSFERS 1000 // per size
+ #define DMAPOOL_BASE 0x2C000000 // DDR low, 2MB aligned
+ #define DMAPOOL_IOVA 0x5C000000 // CB1
+ #define DMAPOOL_MAP_IOVA 0x5A000000 // IOVA window of CB1 for the mappings of each transfer
+ #define DMAPOOL_MAP_IOVA_SIZE 0x1000000
+ // #define ZCOPY_BENCH 1 // CDMA1 between two application buffers: copies through fixed DMA buffers against zero-copy mappings
+ #define N_ZCOPY_TRANSFERS 20 // per size
+ #define ZCOPY_MAX_SIZE 0x100000
+ #define ZCOPY_APP_SRC 0x2E000040 // DDR low, application buffers: not page aligned
+ #define ZCOPY_APP_DST 0x2E200080
+ #define ZCOPY_DMA_SRC 0x2E400000 // fixed DMA buffers, flat in CB1
+ #define ZCOPY_DMA_DST 0x2E600000
+ #define ZCOPY_IOVA 0x68000000 // IOVA window of CB1
+ #define ZCOPY_IOVA_SIZE 0x1000000
+ // #define PT_SHARE_BENCH 1 // a region mapped in several trees: private tables against tables shared with CB1, then copy-on-write in CB1
+ #define PT_SHARE_DOMAINS 4 // trees mapping the region, CB1 is the first one: 5 table pages each when private
+ #define PT_SHARE_BASE 0x2F000000 // DDR low, shared region mapped with 4KB pages
+ #define PT_SHARE_SIZE 0x800000
+ #define PT_SHARE_ALT 0x2F800000 // page remapped by CB1 alone
+ #define PT_SHARE_VA 0x6C000000 // 2MB aligned
+ #if defined(STALL_FAULT_BENCH) || defined(LAZY_MAP_BENCH) || defined(TLB_STRIDE_BENCH) || defined(IOVA_WINDOW_BENCH) || \
+     defined(MEMTYPE_BENCH) || defined(FAULT_INJECT_BENCH) || defined(FAULT_STORM_BENCH) || defined(DMA_HANG_BENCH) || \
+     defined(DMAQ_BENCH) || defined(DMAPOOL_BENCH) || defined(ZCOPY_BENCH) || defined(PT_SHARE_BENCH)
+ #define CB1_POOL_TREE 1 // the benchmark runs CB1 on a tree of the table pool (with_cb1_pool_tree)
+ #endif
+ #if defined(FAULT_STORM_BENCH) && !defined(SMMU_IRQ_DISPATCH)
+ #define SMMU_IRQ_DISPATCH 1 // the throttling is done by the dispatch
+ #endif
+ #if defined(FAULT_INJECT_BENCH) && defined(SMMU_IRQ_DISPATCH)
+ #error "FAULT_INJECT_BENCH times SMMU_InterruptHandler, which SMMU_IRQ_DISPATCH replaces: define only one of them"
+ #endif
  
  // NOTE: the pool_size has been set to 6
  
@@ -73,6 +216,9 @@
  #define HPC0_TBU 0x0
  #define DAP_APB_control_TBU 0x2
  
+ #define CDMA0_STREAM_ID ((HPC0_TBU << 10) | CDMA0_MID)
+ #define CDMA1_STREAM_ID ((HPC0_TBU << 10) | CDMA1_MID)
+ 
  /* https://support.xilinx.com/s/question/0D52E00006hpmCxSAI/smmu-on-zcu102?language=en_US */
  /* https://docs.xilinx.com/r/en-US/ug1085-zynq-ultrascale-trm/Master-IDs-List */
  /* https://docs.xilinx.com/r/en-US/ug1087-zynq-ultrascale-registers */
@@ -94,136 +240,1929 @@
  // CDMA config instance
  XAxiCdma_Config *CDmaConfig;
  
- /* -- GDMA Buffers -- */
+ /* -- GDMA Buffers -- */
+ 
+ // I have put the translation tables here because in the main function setting it to 0 was blocking the program
+ // Maybe it goes over the stack size limitation
+ 
+ // translation table locations
+ // TTBR addresses must be aligned with the granule (4KB in aarch32 lpae)
+ #define GRANULE 4096
+ /* u64 cb0_tt_l1_base_64[4] __attribute__((aligned(GRANULE)));*/
+ 
+ // output addresses for the translation of 1GB
+ // Note: those are the 10 bits [39:30] for the output address
+ // DDR_LOW is DDR Low is 2 GB 0x0000_0000-0x7FFF_FFFF
+ # define VIRT_BASE_ADDR 0x840000000
+ u16 output_address_0 = 0x0; // flat [39:30]
+ u16 output_address_1 = 0b0000100001; // not flat [39:30] --> 0x8_4000_0000
+ 
+ /* -- NOTES -- */
+ 
+ /*
+  * Aarch32 LPAE:
+  * -Uses 64-bit descriptors in its translation tables
+  * -Is added to the ARMv7 architecture by the Large Physical Address Extension (LPAE)
+  * -Supports the translation of VAs of up to 32 bits
+  * -Supports output addresses of up to 40 bits, that can be IPAs or VAs.
+  */
+ 
+ /* The configuration is a an entry block for the first stage of translation:
+  * The bits [32:30] are used to select one of the 4 entries of the translation table. Then, the entry will contain
+  * an output address of 39:30 set that will be attached to the remaining bits.
+  * In a flat configuration, those bits are set to 0x0.
+  * Supposing to have the output bits set to 0x400 (0b10000000000), the output will be that bits concatenated to the
+  * remaining ones [29:0].
+  */
+ 
+ /* -- NOTES -- */
+ 
+ // configure CDMA1-0 (PL)
+ #define HPC_CHANNEL	1
+ #define AXI_ATTR(prot, cache)	((prot << 4) | cache)
+ #define NORM_WB_OUT_CACHE	0x605UL
+ #define PROT_UP_S_D	0x0	/* Unprivileged, Secure, Data */
+ #define AXI_PROT	PROT_UP_S_D
+ #define	CACHE_OA_M	0xB /* Write-through No-allocate */
+ 
+ XAxiCdma FpdCDma0;
+ XAxiCdma FpdCDma1;
+ XAxiCdma_Config *CDmaConfig0;
+ XAxiCdma_Config *CDmaConfig1;
+ static void FpdCdmaConfiguration(void)
+ {
+     CDmaConfig0 = XAxiCdma_LookupConfig(XPAR_AXICDMA_0_DEVICE_ID);
+     if (!CDmaConfig0) {
+         xil_printf("Cannot find config structure \r\n");
+         return XST_FAILURE;
+     }
+     CDmaConfig1 = XAxiCdma_LookupConfig(XPAR_AXICDMA_1_DEVICE_ID);
+     if (!CDmaConfig1) {
+         xil_printf("Cannot find config structure \r\n");
+         return XST_FAILURE;
+     }
+     XAxiCdma_CfgInitialize(&FpdCDma0, CDmaConfig0, CDmaConfig0->BaseAddress);
+     XAxiCdma_CfgInitialize(&FpdCDma1, CDmaConfig1, CDmaConfig1->BaseAddress);
+ }
+ 
+ // Bounded wait of a transfer: a failed one is reported with its cause, the CDMA is reset
+ static int wait_transfer(XAxiCdma* cdma, u16 stream_id){
+     smmu_dma_result result;
+ 
+     if (smmu_dma_wait_cdma(cdma, stream_id, DMA_TIMEOUT_US, &result) != XST_SUCCESS){
+         xil_printf("# APU0: ");
+         smmu_dma_print(&result);
+         return XST_FAILURE;
+     }
+     return XST_SUCCESS;
+ }
+ 
+ #ifdef CB1_POOL_TREE
+ typedef void (*cb1_bench)(XAxiCdma* cdma, u8 cb);
+ 
+ /* Runs bench with the bank cb on an empty tree of the table pool, then puts the bank back on the block mapping
+  * block_l1 and frees the tree with the tables the bench left in it.
+  */
+ static void with_cb1_pool_tree(cb1_bench bench, XAxiCdma* cdma, u8 cb, u64* block_l1, u8 t0sz){
+     u64* l1_table = smmu_pt_alloc_table();
+ 
+     smmu_pt_attach(cb, l1_table);
+     set_CBnTTBR0_32_lpae_stage1(cb, 0x0, (UINTPTR)l1_table, t0sz);
+     invalidate_CBn_by_TLBIALL(cb);
+     sync_CBn_TLB(cb);
+ 
+     bench(cdma, cb);
+ 
+     set_CBnTTBR0_32_lpae_stage1(cb, 0x0, (UINTPTR)block_l1, t0sz);
+     invalidate_CBn_by_TLBIALL(cb);
+     sync_CBn_TLB(cb);
+     smmu_pt_attach(cb, NULL);
+     smmu_pt_free_tree(l1_table);
+ }
+ #endif
+ 
+ static void do_transfers(XAxiCdma** cdma_vector, u16* stream_vector, u32 cdma_vector_len, u32 n_transfers){
+     u64 elapsed_counts;
+     int ret;
+     float time_elapsed;
+     float average_time = 0;
+     XTime startTime, endTime;
+ 
+     // note: the GetTime functions read the number of clock cycles of the processor
+     // The difference of counts divided by the counts per seconds gives me the elapsed time in seconds
+     for (int i=0; i<n_transfers; i++){
+ 
+         // NOTE: IL PROBLEMA E' CHE DOPO CHE CDMA1 FA UNA TRANSAZIONE, CDMA 0 NON PUO' PIU'
+ 
+         /* try to comment this */
+         Xil_Out32(0xFD810618, 0xFFFFFFFF); //invalidate all
+         Xil_Out32(0xFD810600, 0x0); // invalidate by VA
+         Xil_Out32(0xFD800064, 0x0); // invalidate by VMID 0x0 (CBAR)
+         Xil_Out32(0xFD800060, 0x0); // invalidate STLBIALL
+         Xil_Out32(0xFD800068, 0x0); // SMMU_TLBIALLNSNH
+         /*memset(cb0_tt_l1_base_64, 0x0, sizeof(u64)*4);
+         set_Table_Entry_32_lpae(cb0_tt_l1_base_64, entry_index, entry_value_0);*/
+         //XAxiCdma_CfgInitialize(&FpdCDma0, CDmaConfig0, CDmaConfig0->BaseAddress);
+         /* try to comment this */
+ 
+         /* try to comment this */
+         /*Xil_DCacheInvalidate();
+         Xil_ICacheInvalidate();*/
+         /* try to comment this */
+         XTime_GetTime(&startTime);
+ 
+         // CDMAs transfers
+         for (int i=0; i<cdma_vector_len; i++){
+             ret = XAxiCdma_SimpleTransfer(cdma_vector[i], (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
+ 
+             // ret != XST_SUCCESS
+             if (ret != 0){
+                 xil_printf("# APU0: the transfer went wrong, loop breaks\r\n");
+                 break;
+             }
+         }
+ 
+         // wait for all the cdmas to end
+         for (int i=0; i<cdma_vector_len; i++){
+             if (wait_transfer(cdma_vector[i], stream_vector[i]) != XST_SUCCESS){
+                 ret = XST_FAILURE;
+             }
+         }
+         if (ret != 0){
+             xil_printf("# APU0: transfer %d failed, loop breaks\r\n", i);
+             n_transfers = i;
+             break;
+         }
+ 
+         // measure endTime
+         XTime_GetTime(&endTime);
+ 
+         // printing the elapsed time in milliseconds
+         elapsed_counts = endTime - startTime;
+         time_elapsed = (float)elapsed_counts/(float)COUNTS_PER_SECOND;
+         average_time += time_elapsed;
+     }
+ 
+     if (n_transfers == 0){
+         return;
+     }
+ 
+     // print the average time in milliseconds
+     average_time = average_time / n_transfers;
+     printf("# APU0: transfer completed in %fms on average\n\r", average_time*1000); // xil_printf does not support floating point
+ }
+ 
+ #ifdef IOVA_LOOKUP_BENCH
+ static void print_lookup_time(const char* name, XTime startTime, XTime endTime){
+     printf("# APU0: %s lookup in %fns on average\n\r", name, (float)(endTime - startTime)*1000000000/(float)COUNTS_PER_SECOND/N_LOOKUPS);
+ }
+ 
+ // average time of a CPU-side translation of the pages mapped on the context bank
+ static void iova_lookup_bench(u8 cb){
+     XTime startTime, endTime;
+     u64 pa, pa_hw;
+     u32 mismatches = 0;
+     u64* root = smmu_pt_root(cb);
+     smmu_tcache_stats stats;
+ 
+     // software walk of the tables
+     XTime_GetTime(&startTime);
+     for (int i=0; i<N_LOOKUPS; i++){
+         walk_Table_32_lpae(root, (i*GRANULE) % IOVA_BENCH_SIZE, &pa);
+     }
+     XTime_GetTime(&endTime);
+     print_lookup_time("software walk", startTime, endTime);
+ 
+     // translation cache, working set larger than the cache (direct-mapped: every lookup misses)
+     XTime_GetTime(&startTime);
+     for (int i=0; i<N_LOOKUPS; i++){
+         smmu_iova_to_phys(cb, (i*GRANULE) % IOVA_BENCH_SIZE, &pa);
+     }
+     XTime_GetTime(&endTime);
+     print_lookup_time("translation cache (cold)", startTime, endTime);
+ 
+     // translation cache, working set that fits in the cache
+     XTime_GetTime(&startTime);
+     for (int i=0; i<N_LOOKUPS; i++){
+         smmu_iova_to_phys(cb, (i*GRANULE) % IOVA_BENCH_HOT_SIZE, &pa);
+     }
+     XTime_GetTime(&endTime);
+     print_lookup_time("translation cache (hot)", startTime, endTime);
+ 
+     smmu_tcache_get_stats(&stats);
+     xil_printf("# APU0: translation cache %u hits, %u misses\r\n", stats.hits, stats.misses);
+ 
+     // hardware translation operation
+     XTime_GetTime(&startTime);
+     for (int i=0; i<N_LOOKUPS; i++){
+         translate_CBn_by_ATS1PR(cb, (i*GRANULE) % IOVA_BENCH_SIZE, &pa);
+     }
+     XTime_GetTime(&endTime);
+     print_lookup_time("ATS1PR", startTime, endTime);
+ 
+     // both paths must agree
+     for (u32 va=0; va<IOVA_BENCH_SIZE; va+=GRANULE){
+         if (smmu_iova_to_phys(cb, va, &pa) != XST_SUCCESS || translate_CBn_by_ATS1PR(cb, va, &pa_hw) != XST_SUCCESS || pa != pa_hw){
+             mismatches++;
+         }
+     }
+     xil_printf("# APU0: %u mismatches between software and ATS1PR translations\r\n", mismatches);
+ }
+ #endif
+ 
+ #ifdef STALL_FAULT_BENCH
+ // maps the faulting page flat and retries the transaction
+ static smmu_fault_action map_on_fault(const smmu_fault* fault, void* arg){
+     u32 page = (u32)fault->far & ~(GRANULE - 1);
+     u64 pa;
+ 
+     // another stalled transaction of the same burst can have mapped the page already
+     if (smmu_iova_to_phys(fault->cb, page, &pa) == XST_SUCCESS){
+         return SMMU_FAULT_RETRY;
+     }
+     if (smmu_map(fault->cb, page, page, GRANULE, SMMU_PT_ATTR_RW) != XST_SUCCESS){
+         return SMMU_FAULT_TERMINATE;
+     }
+     return SMMU_FAULT_RETRY;
+ }
+ 
+ static u64 timed_transfer(XAxiCdma* cdma){
+     XTime startTime, endTime;
+ 
+     XTime_GetTime(&startTime);
+     if (XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL) != 0){
+         xil_printf("# APU0: the transfer went wrong\r\n");
+     }
+     wait_transfer(cdma, CDMA1_STREAM_ID);
+     XTime_GetTime(&endTime);
+ 
+     return endTime - startTime;
+ }
+ 
+ // transfers of cdma (through the context bank cb) with the buffer pages mapped and with the buffer pages unmapped
+ static void stall_fault_bench(XAxiCdma* cdma, u8 cb){
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     u32 dst_page = (UINTPTR)DstBuf & ~(GRANULE - 1);
+     u64 mapped_counts = 0;
+     u64 fault_counts = 0;
+     smmu_fault_stats stats;
+     smmu_fault fault;
+ 
+     // the first transfer maps the pages
+     timed_transfer(cdma);
+     for (int i=0; i<N_FAULT_TRANSFERS; i++){
+         mapped_counts += timed_transfer(cdma);
+     }
+ 
+     for (int i=0; i<N_FAULT_TRANSFERS; i++){
+         smmu_unmap(cb, src_page, GRANULE);
+         if (dst_page != src_page){
+             smmu_unmap(cb, dst_page, GRANULE);
+         }
+         fault_counts += timed_transfer(cdma);
+     }
+ 
+     smmu_fault_get_stats(&stats);
+     xil_printf("# APU0: %u faults, %u retried, %u terminated, %u not queued\r\n", stats.faults, stats.retried, stats.terminated, stats.dropped);
+     printf("# APU0: transfer on mapped pages in %fus on average\n\r", (float)mapped_counts*1000000/(float)COUNTS_PER_SECOND/N_FAULT_TRANSFERS);
+     printf("# APU0: transfer on unmapped pages in %fus on average\n\r", (float)fault_counts*1000000/(float)COUNTS_PER_SECOND/N_FAULT_TRANSFERS);
+     if (stats.faults > 0){
+         printf("# APU0: fault capture to resume in %fus on average, %fus max\n\r",
+                 (float)stats.total_resume_counts*1000000/(float)COUNTS_PER_SECOND/stats.faults,
+                 (float)stats.max_resume_counts*1000000/(float)COUNTS_PER_SECOND);
+     }
+ 
+     // drain the queue
+     while (smmu_fault_pop(&fault) == XST_SUCCESS);
+ }
+ #endif
+ 
+ #ifdef LAZY_MAP_BENCH
+ // eager and lazy mapping of a sparse window on the context bank, the lazy one populated by the transfers of cdma
+ static void lazy_map_bench(XAxiCdma* cdma, u8 cb){
+     XTime startTime, endTime;
+     u32 free_pages = smmu_pt_free_pages();
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     u64 transfer_counts = 0;
+     u32 n_transfers = 0;
+     smmu_lazy_stats stats;
+     smmu_fault fault;
+ 
+     // eager: the whole window with 4KB pages
+     XTime_GetTime(&startTime);
+     smmu_pt_map_max_block(smmu_pt_root(cb), LAZY_WINDOW_VA, LAZY_WINDOW_PA, LAZY_WINDOW_SIZE, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+     XTime_GetTime(&endTime);
+     printf("# APU0: eager map in %fus, %u table pages\n\r", (float)(endTime - startTime)*1000000/(float)COUNTS_PER_SECOND, free_pages - smmu_pt_free_pages());
+     smmu_unmap(cb, LAZY_WINDOW_VA, LAZY_WINDOW_SIZE);
+ 
+     // lazy: only the reservation
+     XTime_GetTime(&startTime);
+     smmu_lazy_map(cb, LAZY_WINDOW_VA, LAZY_WINDOW_PA, LAZY_WINDOW_SIZE, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB, LAZY_PREFETCH);
+     XTime_GetTime(&endTime);
+     printf("# APU0: lazy map in %fus\n\r", (float)(endTime - startTime)*1000000/(float)COUNTS_PER_SECOND);
+ 
+     // the source buffer is mapped eagerly, the destinations are spread over the window
+     smmu_map(cb, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW);
+     for (u32 offset=0; offset<LAZY_WINDOW_SIZE; offset+=LAZY_STRIDE){
+         XTime_GetTime(&startTime);
+         if (XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, LAZY_WINDOW_VA + offset, DMA_BUF_SIZE, NULL, NULL) != 0){
+             xil_printf("# APU0: the transfer went wrong\r\n");
+         }
+         wait_transfer(cdma, CDMA1_STREAM_ID);
+         XTime_GetTime(&endTime);
+         transfer_counts += endTime - startTime;
+         n_transfers++;
+     }
+ 
+     smmu_lazy_get_stats(&stats);
+     xil_printf("# APU0: %u lazy faults, %u granules mapped, %u prefetched, %u unresolved\r\n", stats.faults, stats.granules, stats.prefetched, stats.unresolved);
+     printf("# APU0: sparse transfer in %fus on average, %u table pages\n\r", (float)transfer_counts*1000000/(float)COUNTS_PER_SECOND/n_transfers, free_pages - smmu_pt_free_pages());
+ 
+     smmu_lazy_unmap(cb, LAZY_WINDOW_VA);
+     smmu_unmap(cb, src_page, GRANULE);
+     while (smmu_fault_pop(&fault) == XST_SUCCESS);
+ }
+ #endif
+ 
+ #ifdef ASID_SWITCH_BENCH
+ // transfer of cdma, the data must land at dst (CPU address of DstBuf for the current tenant)
+ static int checked_transfer(XAxiCdma* cdma, volatile u8* dst, u8 pattern){
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         SrcBuf[i] = pattern;
+     }
+     if (XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL) != 0){
+         return 0;
+     }
+     wait_transfer(cdma, CDMA1_STREAM_ID);
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         if (dst[i] != pattern){
+             return 0;
+         }
+     }
+     return 1;
+ }
+ 
+ // two tenants on the context bank: A maps DstBuf flat, B maps it TENANT_B_OFFSET higher
+ static void asid_switch_bench(XAxiCdma* cdma, u8 cb){
+     XTime startTime, endTime;
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     u32 dst_page = (UINTPTR)DstBuf & ~(GRANULE - 1);
+     volatile u8* dst_b = (volatile u8*)(UINTPTR)(TENANT_B_OFFSET + (UINTPTR)DstBuf);
+     u64 asid_counts = 0, tlbiall_counts = 0;
+     u32 errors = 0;
+     smmu_asid_ctx tenant_a, tenant_b;
+     smmu_asid_stats stats;
+ 
+     smmu_asid_ctx_init(&tenant_a, smmu_pt_alloc_table());
+     smmu_asid_ctx_init(&tenant_b, smmu_pt_alloc_table());
+     smmu_pt_map(tenant_a.l1_table, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW | SMMU_PT_ATTR_NG);
+     smmu_pt_map(tenant_b.l1_table, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW | SMMU_PT_ATTR_NG);
+     if (dst_page != src_page){
+         smmu_pt_map(tenant_a.l1_table, dst_page, dst_page, GRANULE, SMMU_PT_ATTR_RW | SMMU_PT_ATTR_NG);
+         smmu_pt_map(tenant_b.l1_table, dst_page, TENANT_B_OFFSET + dst_page, GRANULE, SMMU_PT_ATTR_RW | SMMU_PT_ATTR_NG);
+     }
+ 
+     // TTBR0/ASID swap: the TLB entries of both tenants stay cached
+     for (int i=0; i<N_SWITCHES; i++){
+         XTime_GetTime(&startTime);
+         smmu_asid_switch(cb, (i & 0x1) ? &tenant_b : &tenant_a);
+         XTime_GetTime(&endTime);
+         asid_counts += endTime - startTime;
+         errors += !checked_transfer(cdma, (i & 0x1) ? dst_b : DstBuf, i);
+     }
+ 
+     // TTBR0 swap with TLBIALL
+     for (int i=0; i<N_SWITCHES; i++){
+         smmu_asid_ctx* tenant = (i & 0x1) ? &tenant_b : &tenant_a;
+ 
+         XTime_GetTime(&startTime);
+         Xil_Out64(SMMU_CBn_TTBR0_base + cb*CBn_offset, (UINTPTR)tenant->l1_table);
+         invalidate_CBn_by_TLBIALL(cb);
+         sync_CBn_TLB(cb);
+         XTime_GetTime(&endTime);
+         tlbiall_counts += endTime - startTime;
+         errors += !checked_transfer(cdma, (i & 0x1) ? dst_b : DstBuf, i);
+     }
+ 
+     smmu_asid_get_stats(&stats);
+     xil_printf("# APU0: %u ASID switches, %u allocations, %u wrong transfers\r\n", stats.switches, stats.allocations, errors);
+     printf("# APU0: TTBR0/ASID switch in %fus on average\n\r", (float)asid_counts*1000000/(float)COUNTS_PER_SECOND/N_SWITCHES);
+     printf("# APU0: TTBR0 switch with TLBIALL in %fus on average\n\r", (float)tlbiall_counts*1000000/(float)COUNTS_PER_SECOND/N_SWITCHES);
+ 
+     smmu_asid_ctx_free(&tenant_a);
+     smmu_asid_ctx_free(&tenant_b);
+     smmu_pt_free_tree(tenant_a.l1_table);
+     smmu_pt_free_tree(tenant_b.l1_table);
+ }
+ #endif
+ 
+ #ifdef DOMAIN_BENCH
+ // activations of the domains in round robin over working sets of increasing size, then a CDMA1 transfer in domain 0
+ static void domain_bench(XAxiCdma* cdma){
+     const u32 working_sets[] = {4, 14, 16, 32, SMMU_MAX_DOMAINS};
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     u32 dst_page = (UINTPTR)DstBuf & ~(GRANULE - 1);
+     u64* l1_table = smmu_pt_alloc_table();
+     XTime startTime, endTime;
+     smmu_domain_stats before, after;
+     int ok = 1;
+ 
+     // all the domains share a flat mapping of the buffers
+     smmu_pt_map(l1_table, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW);
+     if (dst_page != src_page){
+         smmu_pt_map(l1_table, dst_page, dst_page, GRANULE, SMMU_PT_ATTR_RW);
+     }
+ 
+     smmu_domain_init(DOMAIN_CB_MASK, DOMAIN_FIRST_SMR);
+     for (int i=0; i<SMMU_MAX_DOMAINS; i++){
+         smmu_domain_create(l1_table, SMMU_MAIR0, SMMU_MAIR1);
+         if (i == 0){
+             smmu_domain_add_stream(i, (HPC0_TBU << 10) | CDMA1_MID, 0x0);
+         }
+         else {
+             smmu_domain_add_stream(i, (UNUSED_TBU << 10) | i, 0x0);
+         }
+     }
+ 
+     for (int w=0; w<sizeof(working_sets)/sizeof(working_sets[0]); w++){
+         smmu_domain_get_stats(&before);
+         XTime_GetTime(&startTime);
+         for (int i=0; i<N_ACTIVATIONS; i++){
+             smmu_domain_activate(i % working_sets[w]);
+         }
+         XTime_GetTime(&endTime);
+         smmu_domain_get_stats(&after);
+         printf("# APU0: %u domains: %u hits, %u misses, %u evictions, activation in %fus on average\n\r",
+                 working_sets[w], after.hits - before.hits, after.misses - before.misses, after.evictions - before.evictions,
+                 (float)(endTime - startTime)*1000000/(float)COUNTS_PER_SECOND/N_ACTIVATIONS);
+     }
+ 
+     // domain 0 has been evicted by the last working set: the stream of CDMA1 matches no SMR, its transfer raises
+     // an unidentified stream fault whose handler binds the domain, and the aborted transfer is retried
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         SrcBuf[i] = 0xA5;
+         DstBuf[i] = 0x00;
+     }
+     xil_printf("# APU0: domain 0 %s before the transfer\r\n", smmu_domain_bank(0) == SMMU_DOMAIN_UNBOUND ? "unbound" : "bound");
+     smmu_domain_get_stats(&before);
+     for (int attempt=0; attempt<DOMAIN_RETRIES; attempt++){
+         XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
+         if (wait_transfer(cdma, CDMA1_STREAM_ID) == XST_SUCCESS){
+             break;
+         }
+     }
+     smmu_domain_get_stats(&after);
+     xil_printf("# APU0: %u stream faults, domain 0 bound to CB%d\r\n", after.stream_faults - before.stream_faults, smmu_domain_bank(0));
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         if (DstBuf[i] != 0xA5){
+             ok = 0;
+         }
+     }
+     xil_printf("# APU0: CDMA1 transfer in domain 0 %s\r\n", ok ? "OK" : "FAILED");
+ 
+     for (int i=0; i<SMMU_MAX_DOMAINS; i++){
+         smmu_domain_destroy(i);
+     }
+ }
+ #endif
+ 
+ #ifdef OVERHEAD_BENCH
+ enum overhead_config {S2CR_BYPASS, CLIENTPD_BYPASS, STAGE1_1GB, STAGE1_2MB, STAGE1_4KB, NESTED, N_OVERHEAD_CONFIGS};
+ static const char* overhead_config_names[N_OVERHEAD_CONFIGS] = {"S2CR bypass", "CLIENTPD=1", "S1 1GB", "S1 2MB", "S1 4KB", "S1 4KB + S2"};
+ static const u32 overhead_sizes[] = {64, 4096, 65536, 262144};
+ #define N_OVERHEAD_SIZES (sizeof(overhead_sizes)/sizeof(overhead_sizes[0]))
+ 
+ // average transfer time of size bytes in counts, with the TLB invalidated before each transfer if cold (-1 on a failed transfer)
+ static s64 overhead_sweep(XAxiCdma* cdma, u8 cb, u32 size, int cold){
+     XTime startTime, endTime;
+     u64 counts = 0;
+ 
+     // the first transfer warms the TLB up
+     XAxiCdma_SimpleTransfer(cdma, OVERHEAD_SRC, OVERHEAD_DST, size, NULL, NULL);
+     wait_transfer(cdma, CDMA1_STREAM_ID);
+ 
+     for (int i=0; i<N_OVERHEAD_TRANSFERS; i++){
+         if (cold){
+             // all the secure entries, stage 2 and walk caches included
+             invalidate_by_STLBIALL();
+             invalidate_CBn_by_TLBIALL(cb);
+             sync_CBn_TLB(cb);
+         }
+         XTime_GetTime(&startTime);
+         if (XAxiCdma_SimpleTransfer(cdma, OVERHEAD_SRC, OVERHEAD_DST, size, NULL, NULL) != 0){
+             return -1;
+         }
+         wait_transfer(cdma, CDMA1_STREAM_ID);
+         XTime_GetTime(&endTime);
+         counts += endTime - startTime;
+     }
+ 
+     return counts / N_OVERHEAD_TRANSFERS;
+ }
+ 
+ // the translation of the configuration must deliver the data to OVERHEAD_DST
+ static int overhead_check(XAxiCdma* cdma){
+     volatile u8* src = (volatile u8*)OVERHEAD_SRC;
+     volatile u8* dst = (volatile u8*)OVERHEAD_DST;
+ 
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         src[i] = i;
+         dst[i] = 0x0;
+     }
+     XAxiCdma_SimpleTransfer(cdma, OVERHEAD_SRC, OVERHEAD_DST, DMA_BUF_SIZE, NULL, NULL);
+     wait_transfer(cdma, CDMA1_STREAM_ID);
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         if (dst[i] != (u8)i){
+             return 0;
+         }
+     }
+     return 1;
+ }
+ 
+ /* The transfer sweep of cdma (stream mapped by the S2CR s2cr_index to the context bank cb) in each configuration,
+  * hot and cold TLB. Prints the matrix of the transfer times and of the latency added to the S2CR bypass.
+  * cb_l1_table is the table of cb to restore at the end.
+  */
+ static void overhead_bench(XAxiCdma* cdma, u8 cb, u8 s2cr_index, u64* cb_l1_table){
+     u64* s1_tables[N_OVERHEAD_CONFIGS] = {NULL};
+     u64* s2_table = smmu_pt_alloc_table();
+     s64 results[N_OVERHEAD_CONFIGS][N_OVERHEAD_SIZES][2];
+ 
+     // stage 1 trees, flat: the whole first GB with a block, the window with 2MB blocks and with 4KB pages
+     s1_tables[STAGE1_1GB] = smmu_pt_alloc_table();
+     s1_tables[STAGE1_2MB] = smmu_pt_alloc_table();
+     s1_tables[STAGE1_4KB] = smmu_pt_alloc_table();
+     s1_tables[NESTED] = s1_tables[STAGE1_4KB];
+     // 4MB around the table page: the whole pool, wherever the next level tables are taken from
+     u32 pool_base = ((UINTPTR)s1_tables[STAGE1_4KB] - SMMU_PT_POOL_PAGES*GRANULE) & ~(SMMU_PT_BLOCK_2MB - 1);
+     smmu_pt_map_max_block(s1_tables[STAGE1_1GB], 0x0, 0x0, SMMU_PT_BLOCK_1GB, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_1GB);
+     smmu_pt_map_max_block(s1_tables[STAGE1_2MB], OVERHEAD_SRC, OVERHEAD_SRC, OVERHEAD_WINDOW, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_2MB);
+     smmu_pt_map_max_block(s1_tables[STAGE1_4KB], OVERHEAD_SRC, OVERHEAD_SRC, OVERHEAD_WINDOW, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+ 
+     // stage 2, flat: the window and the stage 1 table pages (the stage 1 walks are translated too)
+     smmu_pt_map_max_block(s2_table, OVERHEAD_SRC, OVERHEAD_SRC, OVERHEAD_WINDOW, SMMU_PT_ATTR_S2_RW, OVERHEAD_S2_BLOCK);
+     smmu_pt_map_max_block(s2_table, pool_base, pool_base, 2*SMMU_PT_BLOCK_2MB, SMMU_PT_ATTR_S2_RW, OVERHEAD_S2_BLOCK);
+     set_CBA2Rn_VA(OVERHEAD_S2_CB, VA_32);
+     set_CBARn_stage2(OVERHEAD_S2_CB, 0x1);
+     set_CBn_TCR_lpae_32_stage2(OVERHEAD_S2_CB, 0x0, 0x1, 0x1, 0x1, 0x1, 0x1); // 32-bit IPA, walks from level 1
+     set_CBnTTBR0_32_lpae_stage2(OVERHEAD_S2_CB, (UINTPTR)s2_table, 0x0);
+ 
+     for (int c=0; c<N_OVERHEAD_CONFIGS; c++){
+         int ok;
+ 
+         // S2CR bypass, otherwise translation through cb
+         set_S2CRn(s2cr_index, c == S2CR_BYPASS ? BYPASS : TRANSLATION_CB, cb);
+         if (c == CLIENTPD_BYPASS){
+             set_SMMU_sCR0(0x1, 0x1, 0x1, 0x1, 0x1);
+         }
+         if (s1_tables[c] != NULL){
+             if (c == NESTED){
+                 set_SMMU_CBn_SCTLR(OVERHEAD_S2_CB, 0x1, 0x1, 0x1);
+                 set_CBARn_nested(cb, OVERHEAD_S2_CB);
+             }
+             set_CBnTTBR0_32_lpae_stage1(cb, 0x0, (UINTPTR)s1_tables[c], 0x0);
+             invalidate_by_STLBIALL();
+             invalidate_CBn_by_TLBIALL(cb);
+             sync_CBn_TLB(cb);
+             smmu_pt_attach(cb, s1_tables[c]);
+         }
+ 
+         ok = overhead_check(cdma);
+         for (int s=0; s<N_OVERHEAD_SIZES; s++){
+             results[c][s][0] = ok ? overhead_sweep(cdma, cb, overhead_sizes[s], 0) : -1;
+             results[c][s][1] = ok ? overhead_sweep(cdma, cb, overhead_sizes[s], 1) : -1;
+         }
+         if (!ok){
+             // e.g. nested translation refused to the secure world (invalid context fault)
+             xil_printf("# APU0: %s: wrong transfer, configuration skipped\r\n", overhead_config_names[c]);
+             clear_error_status();
+         }
+ 
+         if (c == CLIENTPD_BYPASS){
+             set_SMMU_sCR0(0x0, 0x1, 0x1, 0x1, 0x1);
+         }
+         if (c == NESTED){
+             set_CBARn(cb, STAGE_1_BYPASS_2);
+             set_SMMU_CBn_SCTLR(OVERHEAD_S2_CB, 0x0, 0x0, 0x0);
+         }
+     }
+ 
+     // transfer time (us) and latency added to the S2CR bypass, hot/cold TLB
+     for (int s=0; s<N_OVERHEAD_SIZES; s++){
+         printf("# APU0: %u bytes\n\r", overhead_sizes[s]);
+         for (int c=0; c<N_OVERHEAD_CONFIGS; c++){
+             if (results[c][s][0] < 0 || results[c][s][1] < 0){
+                 printf("#   %-12s n/a\n\r", overhead_config_names[c]);
+                 continue;
+             }
+             printf("#   %-12s hot %fus (+%fus), cold %fus (+%fus)\n\r", overhead_config_names[c],
+                     (float)results[c][s][0]*1000000/(float)COUNTS_PER_SECOND,
+                     (float)(results[c][s][0] - results[S2CR_BYPASS][s][0])*1000000/(float)COUNTS_PER_SECOND,
+                     (float)results[c][s][1]*1000000/(float)COUNTS_PER_SECOND,
+                     (float)(results[c][s][1] - results[S2CR_BYPASS][s][1])*1000000/(float)COUNTS_PER_SECOND);
+         }
+     }
+ 
+     // back to the table of cb
+     set_CBnTTBR0_32_lpae_stage1(cb, 0x0, (UINTPTR)cb_l1_table, 0x0);
+     invalidate_by_STLBIALL();
+     invalidate_CBn_by_TLBIALL(cb);
+     sync_CBn_TLB(cb);
+     smmu_pt_attach(cb, NULL);
+     set_S2CRn(s2cr_index, TRANSLATION_CB, cb);
+     smmu_pt_unmap(s1_tables[STAGE1_1GB], 0x0, SMMU_PT_BLOCK_1GB);
+     smmu_pt_unmap(s1_tables[STAGE1_2MB], OVERHEAD_SRC, OVERHEAD_WINDOW);
+     smmu_pt_unmap(s1_tables[STAGE1_4KB], OVERHEAD_SRC, OVERHEAD_WINDOW);
+     smmu_pt_unmap(s2_table, OVERHEAD_SRC, OVERHEAD_WINDOW);
+     smmu_pt_unmap(s2_table, pool_base, 2*SMMU_PT_BLOCK_2MB);
+     smmu_pt_free_table(s1_tables[STAGE1_1GB]);
+     smmu_pt_free_table(s1_tables[STAGE1_2MB]);
+     smmu_pt_free_table(s1_tables[STAGE1_4KB]);
+     smmu_pt_free_table(s2_table);
+ }
+ #endif
+ 
+ #ifdef TLB_STRIDE_BENCH
+ static const u32 stride_sizes[] = {0x1000, 0x2000, 0x10000, 0x200000}; // 4KB, 8KB, 64KB, one level 3 table per page
+ #define N_STRIDES (sizeof(stride_sizes)/sizeof(stride_sizes[0]))
+ #define N_WORKING_SETS 15 // 1 to 16384 pages
+ 
+ // average time in counts of the 64B transfers of cdma to n_pages destinations stride bytes apart, in round robin
+ static u64 stride_transfers(XAxiCdma* cdma, u32 stride, u32 n_pages){
+     XTime startTime, endTime;
+     u64 counts = 0;
+ 
+     // the first round brings the working set in the TLB, as far as it fits
+     for (u32 i=0; i<n_pages; i++){
+         XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, STRIDE_WINDOW_VA + i*stride, DMA_BUF_SIZE, NULL, NULL);
+         wait_transfer(cdma, CDMA1_STREAM_ID);
+     }
+ 
+     for (u32 i=0; i<N_STRIDE_TRANSFERS; i++){
+         XTime_GetTime(&startTime);
+         XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, STRIDE_WINDOW_VA + (i % n_pages)*stride, DMA_BUF_SIZE, NULL, NULL);
+         wait_transfer(cdma, CDMA1_STREAM_ID);
+         XTime_GetTime(&endTime);
+         counts += endTime - startTime;
+     }
+ 
+     return counts / N_STRIDE_TRANSFERS;
+ }
+ 
+ /* lmbench-style sweep of the SMMU TLBs on the context bank cb, whose stream is cdma.
+  * The latency of a working set that fits in the TBU micro-TLB is the hit latency; the working sets above
+  * a capacity step up (micro-TLB, then TCU TLB); the 2MB stride puts each page in its own level 3 table,
+  * so the difference with the 4KB stride at the same working set is the walk cache effect.
+  */
+ static void tlb_stride_bench(XAxiCdma* cdma, u8 cb){
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     u64 results[N_STRIDES][N_WORKING_SETS];
+     u32 n_sets[N_STRIDES];
+ 
+     smmu_map(cb, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW);
+     smmu_pt_map_max_block(smmu_pt_root(cb), STRIDE_WINDOW_VA, STRIDE_WINDOW_PA, STRIDE_WINDOW_SIZE, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+ 
+     for (int s=0; s<N_STRIDES; s++){
+         n_sets[s] = 0;
+         for (u32 n_pages=1; n_sets[s]<N_WORKING_SETS && n_pages*stride_sizes[s]<=STRIDE_WINDOW_SIZE; n_pages<<=1){
+             results[s][n_sets[s]++] = stride_transfers(cdma, stride_sizes[s], n_pages);
+             printf("# APU0: stride 0x%x, %u pages: %fns\n\r", stride_sizes[s], n_pages,
+                     (float)results[s][n_sets[s] - 1]*1000000000/(float)COUNTS_PER_SECOND);
+         }
+     }
+ 
+     // capacity steps and miss penalty for each stride
+     for (int s=0; s<N_STRIDES; s++){
+         for (int w=1; w<n_sets[s]; w++){
+             if (results[s][w]*100 > results[s][w - 1]*(100 + STRIDE_KNEE_PERCENT)){
+                 printf("# APU0: stride 0x%x: step above %u pages, +%fns\n\r", stride_sizes[s], 1U << (w - 1),
+                         (float)(results[s][w] - results[s][w - 1])*1000000000/(float)COUNTS_PER_SECOND);
+             }
+         }
+         printf("# APU0: stride 0x%x: hit %fns, largest working set +%fns per transfer\n\r", stride_sizes[s],
+                 (float)results[s][0]*1000000000/(float)COUNTS_PER_SECOND,
+                 (float)(results[s][n_sets[s] - 1] - results[s][0])*1000000000/(float)COUNTS_PER_SECOND);
+     }
+ 
+     // same number of pages, one level 3 table each against 512 pages per table
+     for (int w=0; w<n_sets[N_STRIDES - 1]; w++){
+         printf("# APU0: %u pages: walk cache effect %fns\n\r", 1U << w,
+                 ((float)results[N_STRIDES - 1][w] - (float)results[0][w])*1000000000/(float)COUNTS_PER_SECOND);
+     }
+ 
+     smmu_unmap(cb, STRIDE_WINDOW_VA, STRIDE_WINDOW_SIZE);
+     smmu_unmap(cb, src_page, GRANULE);
+ }
+ #endif
+ 
+ #ifdef CONTENTION_BENCH
+ #ifdef XPAR_AXICDMA_2_DEVICE_ID
+ // third CDMA of the design, on another HP port (set according to the design)
+ #define CDMA2_TBU 0x3 // S_AXI_HP0_FPD
+ #define CDMA2_MID 0b1000000000
+ #define N_CDMA_MASTERS 3
+ XAxiCdma FpdCDma2;
+ #else
+ #define N_CDMA_MASTERS 2
+ #endif
+ #define N_MASTERS (N_CDMA_MASTERS + N_GDMA_MASTERS)
+ 
+ // a DMA master of the benchmark: a CDMA or a GDMA channel in simple mode
+ typedef struct {
+     const char* name;
+     u16 stream_id;
+     XAxiCdma* cdma; // NULL for a GDMA channel
+     u8 channel;
+     u8 in_flight;
+     XTime start;    // of the transfer in flight
+     u64 counts;     // sum of the transfer times
+     u32 done;
+     u32 failed;     // transfers aborted or past DMA_TIMEOUT_US
+ } dma_master;
+ 
+ static dma_master masters[N_MASTERS];
+ static const char* gdma_names[] = {"GDMA0", "GDMA1", "GDMA2", "GDMA3", "GDMA4", "GDMA5", "GDMA6", "GDMA7"};
+ 
+ static int masters_init(void){
+     masters[0] = (dma_master){"CDMA0", (HPC0_TBU << 10) | CDMA0_MID, &FpdCDma0};
+     masters[1] = (dma_master){"CDMA1", (HPC0_TBU << 10) | CDMA1_MID, &FpdCDma1};
+ #ifdef XPAR_AXICDMA_2_DEVICE_ID
+     XAxiCdma_Config* cdma2_config = XAxiCdma_LookupConfig(XPAR_AXICDMA_2_DEVICE_ID);
+     XAxiCdma_CfgInitialize(&FpdCDma2, cdma2_config, cdma2_config->BaseAddress);
+     masters[2] = (dma_master){"CDMA2", (CDMA2_TBU << 10) | CDMA2_MID, &FpdCDma2};
+ #endif
+     for (int i=0; i<N_GDMA_MASTERS; i++){
+         dma_master* master = &masters[N_CDMA_MASTERS + i];
+ 
+         if (smmu_gdma_init(i) != XST_SUCCESS){
+             return XST_FAILURE;
+         }
+         master->name = gdma_names[i];
+         master->stream_id = smmu_gdma_stream_id(i);
+         master->cdma = NULL;
+         master->channel = i;
+     }
+     return XST_SUCCESS;
+ }
+ 
+ static void master_start(dma_master* master, UINTPTR src, UINTPTR dst, u32 size){
+     XTime_GetTime(&master->start);
+     if (master->cdma != NULL){
+         XAxiCdma_SimpleTransfer(master->cdma, src, dst, size, NULL, NULL);
+     }
+     else {
+         smmu_gdma_transfer(master->channel, src, dst, size);
+     }
+     master->in_flight = 1;
+ }
+ 
+ static int master_busy(dma_master* master){
+     if (master->cdma != NULL){
+         return XAxiCdma_IsBusy(master->cdma);
+     }
+     return smmu_gdma_busy(master->channel);
+ }
+ 
+ // ends the transfer of master, completed or past its deadline: a failed one is reported with its cause, the engine reset
+ static void master_end(dma_master* master){
+     smmu_dma_result result;
+     int status;
+ 
+     if (master->cdma != NULL){
+         status = smmu_dma_wait_cdma(master->cdma, master->stream_id, 0, &result);
+     }
+     else {
+         status = smmu_dma_wait_gdma(master->channel, 0, &result);
+     }
+     if (status != XST_SUCCESS){
+         xil_printf("# APU0: %s: ", master->name);
+         smmu_dma_print(&result);
+         master->failed++;
+     }
+ }
+ 
+ // working set of master m, the first one for all the masters if overlap
+ static UINTPTR master_working_set(int m, int overlap){
+     return CONTENTION_WINDOW + (overlap ? 0 : m*CONTENTION_WS_SIZE);
+ }
+ 
+ /* The masters in master_set run N_CONTENTION_TRANSFERS transfers each, concurrently, over their working set.
+  * Prints the average latency of each master and the aggregate throughput.
+  */
+ static void contention_run(const char* name, u32 master_set, int overlap){
+     UINTPTR src = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     XTime startTime, endTime, now;
+     u32 active = 0;
+     u64 bytes = 0;
+ 
+     for (int m=0; m<N_MASTERS; m++){
+         masters[m].counts = 0;
+         masters[m].done = 0;
+         masters[m].failed = 0;
+         masters[m].in_flight = 0;
+     }
+     for (int cb=CONTENTION_FIRST_CB; cb<CONTENTION_FIRST_CB + N_MASTERS; cb++){
+         invalidate_CBn_by_TLBIALL(cb);
+         sync_CBn_TLB(cb);
+     }
+ 
+     XTime_GetTime(&startTime);
+     for (int m=0; m<N_MASTERS; m++){
+         if ((master_set >> m) & 0x1){
+             master_start(&masters[m], src, master_working_set(m, overlap), CONTENTION_SIZE);
+             active++;
+         }
+     }
+     while (active > 0){
+         for (int m=0; m<N_MASTERS; m++){
+             dma_master* master = &masters[m];
+ 
+             if (!master->in_flight){
+                 continue;
+             }
+             XTime_GetTime(&now);
+             if (master_busy(master) && now - master->start < (XTime)DMA_TIMEOUT_US*COUNTS_PER_SECOND/1000000){
+                 continue;
+             }
+             master_end(master);
+             master->counts += now - master->start;
+             master->in_flight = 0;
+             if (++master->done < N_CONTENTION_TRANSFERS){
+                 master_start(master, src, master_working_set(m, overlap) + (master->done*GRANULE) % CONTENTION_WS_SIZE, CONTENTION_SIZE);
+             }
+             else {
+                 active--;
+             }
+         }
+     }
+     XTime_GetTime(&endTime);
+ 
+     printf("# APU0: %s\n\r", name);
+     for (int m=0; m<N_MASTERS; m++){
+         if ((master_set >> m) & 0x1){
+             printf("#   %s: %fus per transfer, %u failed\n\r", masters[m].name,
+                     (float)masters[m].counts*1000000/(float)COUNTS_PER_SECOND/N_CONTENTION_TRANSFERS, masters[m].failed);
+             bytes += (u64)N_CONTENTION_TRANSFERS*CONTENTION_SIZE;
+         }
+     }
+     printf("#   aggregate %fMB/s\n\r", (float)bytes*COUNTS_PER_SECOND/(float)(endTime - startTime)/1000000);
+ }
+ 
+ // routes the masters to CONTENTION_FIRST_CB, or each to its own context bank
+ static void contention_route(int separate){
+     for (int m=0; m<N_MASTERS; m++){
+         smmu_smr_detach(masters[m].stream_id);
+         smmu_smr_attach(masters[m].stream_id, 0x0, TRANSLATION_CB, CONTENTION_FIRST_CB + (separate ? m : 0));
+     }
+ }
+ 
+ static void contention_bench(void){
+     // same TBU (HPC0), different TBUs (HPC0 and FPD DMA), everything
+     const u32 master_sets[] = {0x3, (1U << 1) | (1U << N_CDMA_MASTERS), (1U << N_MASTERS) - 1};
+     const char* set_names[] = {"CDMA0+CDMA1, same TBU", "CDMA1+GDMA0, different TBUs", "all masters"};
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     u64* l1_table = smmu_pt_alloc_table();
+     char name[96];
+ 
+     if (masters_init() != XST_SUCCESS){
+         return;
+     }
+ 
+     // one flat tree for all the banks: the source page and the working sets in 4KB pages
+     smmu_pt_map(l1_table, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW);
+     smmu_pt_map_max_block(l1_table, CONTENTION_WINDOW, CONTENTION_WINDOW, N_MASTERS*CONTENTION_WS_SIZE, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+     for (int cb=CONTENTION_FIRST_CB; cb<CONTENTION_FIRST_CB + N_MASTERS; cb++){
+         set_CBA2Rn_VA(cb, VA_32);
+         set_CBARn(cb, STAGE_1_BYPASS_2);
+         set_CBn_MAIR_stage1(cb, NORMAL_IO_NonCacheable);
+         set_CBn_TCR_lpae_32_stage1(cb, 0x0, 0x1, 0x1, 0x1, 0x0, 0x1);
+         set_CBn_TCR2_stage1(cb, 0x0, 0x0);
+         set_CBnTTBR0_32_lpae_stage1(cb, 0x0, (UINTPTR)l1_table, 0x0);
+         set_SMMU_CBn_SCTLR(cb, 0x1, 0x1, 0x1);
+     }
+     smmu_smr_init(CONTENTION_FIRST_SMR, N_MASTERS, NULL);
+ 
+     // each master alone: the reference for the interference
+     contention_route(0);
+     for (int m=0; m<N_MASTERS; m++){
+         contention_run(masters[m].name, 1U << m, 0);
+     }
+ 
+     for (int s=0; s<sizeof(master_sets)/sizeof(master_sets[0]); s++){
+         for (int separate=0; separate<2; separate++){
+             contention_route(separate);
+             for (int overlap=1; overlap>=0; overlap--){
+                 sprintf(name, "%s, %s, %s pages", set_names[s], separate ? "separate CBs" : "same CB", overlap ? "shared" : "disjoint");
+                 contention_run(name, master_sets[s], overlap);
+             }
+         }
+     }
+ 
+     for (int m=0; m<N_MASTERS; m++){
+         smmu_smr_detach(masters[m].stream_id);
+     }
+     for (int cb=CONTENTION_FIRST_CB; cb<CONTENTION_FIRST_CB + N_MASTERS; cb++){
+         set_SMMU_CBn_SCTLR(cb, 0x0, 0x0, 0x0);
+         invalidate_CBn_by_TLBIALL(cb);
+         sync_CBn_TLB(cb);
+     }
+     smmu_pt_unmap(l1_table, CONTENTION_WINDOW, N_MASTERS*CONTENTION_WS_SIZE);
+     smmu_pt_unmap(l1_table, src_page, GRANULE);
+     smmu_pt_free_table(l1_table);
+ }
+ #endif
+ 
+ #ifdef GDMA_BENCH
+ // n_channels channels at once, N_GDMA_TRANSFERS transfers each in simple mode or in lists of GDMA_LIST_LEN
+ static void gdma_run(const char* name, u8 n_channels, int list){
+     XZDma_Transfer lists[SMMU_GDMA_CHANNELS][GDMA_LIST_LEN];
+     u32 done[SMMU_GDMA_CHANNELS] = {0};
+     u64 counts[SMMU_GDMA_CHANNELS] = {0};
+     XTime start[SMMU_GDMA_CHANNELS];
+     u32 step = list ? GDMA_LIST_LEN : 1;
+     XTime startTime, endTime, now;
+     u32 active = n_channels;
+     u32 failed = 0;
+     float latency = 0;
+     smmu_dma_result result;
+ 
+     for (int ch=0; ch<n_channels; ch++){
+         for (int i=0; i<GDMA_LIST_LEN; i++){
+             lists[ch][i] = (XZDma_Transfer){GDMA_SRC + ch*GDMA_CH_WINDOW + (i*GDMA_SIZE) % GDMA_CH_WINDOW,
+                     GDMA_DST + ch*GDMA_CH_WINDOW + (i*GDMA_SIZE) % GDMA_CH_WINDOW, GDMA_SIZE, 0, 0, 0};
+         }
+     }
+ 
+     XTime_GetTime(&startTime);
+     for (int ch=0; ch<n_channels; ch++){
+         XTime_GetTime(&start[ch]);
+         if (list){
+             smmu_gdma_transfer_list(ch, lists[ch], GDMA_LIST_LEN);
+         }
+         else {
+             smmu_gdma_transfer(ch, lists[ch][0].SrcAddr, lists[ch][0].DstAddr, GDMA_SIZE);
+         }
+     }
+     while (active > 0){
+         for (int ch=0; ch<n_channels; ch++){
+             if (done[ch] >= N_GDMA_TRANSFERS){
+                 continue;
+             }
+             XTime_GetTime(&now);
+             if (smmu_gdma_busy(ch) && now - start[ch] < (XTime)DMA_TIMEOUT_US*COUNTS_PER_SECOND/1000000){
+                 continue;
+             }
+             // completed or past its deadline: a failed transfer is reported with its cause, the channel reset
+             if (smmu_dma_wait_gdma(ch, 0, &result) != XST_SUCCESS){
+                 xil_printf("# APU0: GDMA%d: ", ch);
+                 smmu_dma_print(&result);
+                 failed++;
+             }
+             counts[ch] += now - start[ch];
+             done[ch] += step;
+             if (done[ch] >= N_GDMA_TRANSFERS){
+                 active--;
+                 continue;
+             }
+             start[ch] = now;
+             if (list){
+                 smmu_gdma_transfer_list(ch, lists[ch], GDMA_LIST_LEN);
+             }
+             else {
+                 u32 i = done[ch] % GDMA_LIST_LEN;
+                 smmu_gdma_transfer(ch, lists[ch][i].SrcAddr, lists[ch][i].DstAddr, GDMA_SIZE);
+             }
+         }
+     }
+     XTime_GetTime(&endTime);
+ 
+     for (int ch=0; ch<n_channels; ch++){
+         latency += (float)counts[ch]*1000000/(float)COUNTS_PER_SECOND/done[ch];
+     }
+     printf("# APU0: %s, %u channels: %fus per transfer, aggregate %fMB/s, %u failed\n\r", name, n_channels, latency/n_channels,
+             (float)n_channels*N_GDMA_TRANSFERS*GDMA_SIZE*COUNTS_PER_SECOND/(float)(endTime - startTime)/1000000, failed);
+ }
+ 
+ // the data of each channel must land in its destination window
+ static int gdma_check(u8 n_channels){
+     smmu_dma_result result;
+     int ok = 1;
+ 
+     for (int ch=0; ch<n_channels; ch++){
+         volatile u8* src = (volatile u8*)(UINTPTR)(GDMA_SRC + ch*GDMA_CH_WINDOW);
+         volatile u8* dst = (volatile u8*)(UINTPTR)(GDMA_DST + ch*GDMA_CH_WINDOW);
+ 
+         for (int i=0; i<DMA_BUF_SIZE; i++){
+             src[i] = ch + i;
+             dst[i] = 0x0;
+         }
+         smmu_gdma_transfer(ch, (UINTPTR)src, (UINTPTR)dst, DMA_BUF_SIZE);
+         if (smmu_dma_wait_gdma(ch, DMA_TIMEOUT_US, &result) != XST_SUCCESS){
+             xil_printf("# APU0: GDMA%d: ", ch);
+             smmu_dma_print(&result);
+             ok = 0;
+             continue;
+         }
+         for (int i=0; i<DMA_BUF_SIZE; i++){
+             ok &= dst[i] == (u8)(ch + i);
+         }
+     }
+     return ok;
+ }
+ 
+ static void gdma_bench(void){
+     const u8 channel_counts[] = {1, 2, 4, SMMU_GDMA_CHANNELS};
+     u64* l1_table = smmu_pt_alloc_table();
+ 
+     // one flat tree for the banks of the channels: source and destination windows in 4KB pages
+     smmu_pt_map_max_block(l1_table, GDMA_SRC, GDMA_SRC, SMMU_GDMA_CHANNELS*GDMA_CH_WINDOW, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+     smmu_pt_map_max_block(l1_table, GDMA_DST, GDMA_DST, SMMU_GDMA_CHANNELS*GDMA_CH_WINDOW, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+     smmu_smr_init(GDMA_FIRST_SMR, SMMU_GDMA_CHANNELS, NULL);
+     for (int ch=0; ch<SMMU_GDMA_CHANNELS; ch++){
+         u8 cb = GDMA_FIRST_CB + ch;
+ 
+         set_CBA2Rn_VA(cb, VA_32);
+         set_CBARn(cb, STAGE_1_BYPASS_2);
+         set_CBn_MAIR_stage1(cb, NORMAL_IO_NonCacheable);
+         set_CBn_TCR_lpae_32_stage1(cb, 0x0, 0x1, 0x1, 0x1, 0x0, 0x1);
+         set_CBn_TCR2_stage1(cb, 0x0, 0x0);
+         set_CBnTTBR0_32_lpae_stage1(cb, 0x0, (UINTPTR)l1_table, 0x0);
+         set_SMMU_CBn_SCTLR(cb, 0x1, 0x1, 0x1);
+         smmu_pt_attach(cb, l1_table);
+         if (smmu_gdma_init(ch) != XST_SUCCESS){
+             return;
+         }
+     }
+ 
+     for (int translated=0; translated<2; translated++){
+         for (int ch=0; ch<SMMU_GDMA_CHANNELS; ch++){
+             smmu_gdma_detach(ch);
+             smmu_gdma_attach(ch, translated ? TRANSLATION_CB : BYPASS, GDMA_FIRST_CB + ch);
+         }
+         xil_printf("# APU0: GDMA %s check %s\r\n", translated ? "translated" : "bypass", gdma_check(SMMU_GDMA_CHANNELS) ? "OK" : "FAILED");
+         for (int c=0; c<sizeof(channel_counts); c++){
+             gdma_run(translated ? "translated, simple" : "bypass, simple", channel_counts[c], 0);
+             gdma_run(translated ? "translated, linked list" : "bypass, linked list", channel_counts[c], 1);
+         }
+     }
+ 
+     for (int ch=0; ch<SMMU_GDMA_CHANNELS; ch++){
+         smmu_gdma_detach(ch);
+         set_SMMU_CBn_SCTLR(GDMA_FIRST_CB + ch, 0x0, 0x0, 0x0);
+         smmu_pt_attach(GDMA_FIRST_CB + ch, NULL);
+     }
+     smmu_pt_unmap(l1_table, GDMA_SRC, SMMU_GDMA_CHANNELS*GDMA_CH_WINDOW);
+     smmu_pt_unmap(l1_table, GDMA_DST, SMMU_GDMA_CHANNELS*GDMA_CH_WINDOW);
+     smmu_pt_free_table(l1_table);
+ }
+ #endif
+ 
+ #ifdef IOVA_WINDOW_BENCH
+ // checks the DDR high destination against the pattern of the source
+ static bool window_check(u8 pattern){
+     volatile u8* dst = (volatile u8*)WINDOW_HIGH_DST;
+ 
+     for (int i=0; i<WINDOW_SIZE; i++){
+         if (dst[i] != pattern){
+             return false;
+         }
+     }
+     return true;
+ }
+ 
+ /* CDMA1 moves WINDOW_SIZE bytes to a destination in DDR high, which its 32-bit address bus cannot reach.
+  * bounce: the transfer lands in a DDR low buffer and the CPU copies it to DDR high;
+  * window: the destination is mapped in an IOVA window of cb (TCR2.PASize 40 bits), the transfer writes it directly.
+  */
+ static void iova_window_bench(XAxiCdma* cdma, u8 cb){
+     volatile u8* src = (volatile u8*)WINDOW_SRC;
+     volatile u64* bounce = (volatile u64*)WINDOW_BOUNCE;
+     volatile u64* dst = (volatile u64*)WINDOW_HIGH_DST;
+     XTime startTime, endTime;
+     u64 bounce_counts = 0, window_counts = 0;
+     smmu_iova_stats stats;
+     u32 dst_iova;
+ 
+     // source and bounce buffer: two 2MB blocks, flat
+     smmu_map(cb, WINDOW_SRC, WINDOW_SRC, 2*SMMU_PT_BLOCK_2MB, SMMU_PT_ATTR_RW);
+     if (smmu_iova_window_init(cb, WINDOW_IOVA, WINDOW_IOVA_SIZE) != XST_SUCCESS ||
+             smmu_iova_window_map(cb, WINDOW_HIGH_DST, WINDOW_SIZE, SMMU_PT_ATTR_RW, &dst_iova) != XST_SUCCESS){
+         xil_printf("# APU0: cannot map the DDR high destination in the IOVA window\r\n");
+         smmu_unmap(cb, WINDOW_SRC, 2*SMMU_PT_BLOCK_2MB);
+         return;
+     }
+     xil_printf("# APU0: DDR high 0x%016llX at IOVA 0x%08X\r\n", (u64)WINDOW_HIGH_DST, dst_iova);
+ 
+     for (int i=0; i<WINDOW_SIZE; i++){
+         src[i] = 0x3C;
+     }
+     for (int i=0; i<N_WINDOW_TRANSFERS; i++){
+         XTime_GetTime(&startTime);
+         XAxiCdma_SimpleTransfer(cdma, WINDOW_SRC, WINDOW_BOUNCE, WINDOW_SIZE, NULL, NULL);
+         wait_transfer(cdma, CDMA1_STREAM_ID);
+         for (int w=0; w<WINDOW_SIZE/8; w++){
+             dst[w] = bounce[w];
+         }
+         XTime_GetTime(&endTime);
+         bounce_counts += endTime - startTime;
+     }
+     xil_printf("# APU0: bounce readback %s\r\n", window_check(0x3C) ? "OK" : "FAILED");
+ 
+     for (int i=0; i<WINDOW_SIZE; i++){
+         src[i] = 0xC3;
+     }
+     for (int i=0; i<N_WINDOW_TRANSFERS; i++){
+         XTime_GetTime(&startTime);
+         XAxiCdma_SimpleTransfer(cdma, WINDOW_SRC, dst_iova, WINDOW_SIZE, NULL, NULL);
+         wait_transfer(cdma, CDMA1_STREAM_ID);
+         XTime_GetTime(&endTime);
+         window_counts += endTime - startTime;
+     }
+     xil_printf("# APU0: IOVA window readback %s\r\n", window_check(0xC3) ? "OK" : "FAILED");
+ 
+     bounce_counts /= N_WINDOW_TRANSFERS;
+     window_counts /= N_WINDOW_TRANSFERS;
+     printf("# APU0: bounce buffer %fus per transfer, %fMB/s\n\r", (float)bounce_counts*1000000/(float)COUNTS_PER_SECOND,
+             (float)WINDOW_SIZE*(float)COUNTS_PER_SECOND/(float)bounce_counts/1000000);
+     printf("# APU0: IOVA window %fus per transfer, %fMB/s\n\r", (float)window_counts*1000000/(float)COUNTS_PER_SECOND,
+             (float)WINDOW_SIZE*(float)COUNTS_PER_SECOND/(float)window_counts/1000000);
+ 
+     smmu_iova_get_stats(&stats);
+     xil_printf("# APU0: IOVA windows: %u maps, %u with blocks, %u full\r\n", stats.maps, stats.block_maps, stats.full);
+     smmu_iova_window_destroy(cb);
+     smmu_unmap(cb, WINDOW_SRC, 2*SMMU_PT_BLOCK_2MB);
+ }
+ #endif
+ 
+ #ifdef MEMTYPE_BENCH
+ static const char* memtype_names[SMMU_MEM_TYPES] = {"normal non-cacheable", "device nGnRE", "write-through", "write-back RA/WA", "streaming no-allocate"};
+ 
+ /* The same CDMA1 copy with the source and the destination mapped with each memory type of the managed MAIR
+  * table in the bank cb: the cacheability the SMMU gives the transactions is the only difference.
+  */
+ static void memtype_bench(XAxiCdma* cdma, u8 cb){
+     XTime startTime, endTime;
+ 
+     for (int type=0; type<SMMU_MEM_TYPES; type++){
+         u32 va = MEMTYPE_VA + type*SMMU_PT_BLOCK_2MB;
+         volatile u8* src = (volatile u8*)(UINTPTR)(MEMTYPE_PA + type*SMMU_PT_BLOCK_2MB);
+         volatile u8* dst = src + SMMU_PT_BLOCK_2MB/2;
+         u64 counts = 0;
+         bool readback = true;
+ 
+         if (smmu_map_mem(cb, va, MEMTYPE_PA + type*SMMU_PT_BLOCK_2MB, SMMU_PT_BLOCK_2MB, SMMU_PT_ATTR_RW, type) != XST_SUCCESS){
+             continue;
+         }
+         for (int i=0; i<MEMTYPE_SIZE; i++){
+             src[i] = type + 1;
+             dst[i] = 0x0;
+         }
+ 
+         for (int i=0; i<N_MEMTYPE_TRANSFERS; i++){
+             XTime_GetTime(&startTime);
+             XAxiCdma_SimpleTransfer(cdma, va, va + SMMU_PT_BLOCK_2MB/2, MEMTYPE_SIZE, NULL, NULL);
+             wait_transfer(cdma, CDMA1_STREAM_ID);
+             XTime_GetTime(&endTime);
+             counts += endTime - startTime;
+         }
+         for (int i=0; i<MEMTYPE_SIZE; i++){
+             if (dst[i] != type + 1){
+                 readback = false;
+             }
+         }
+ 
+         counts /= N_MEMTYPE_TRANSFERS;
+         printf("# APU0: %s (AttrIndx %d): %fus per transfer, %fMB/s, readback %s\n\r", memtype_names[type], type,
+                 (float)counts*1000000/(float)COUNTS_PER_SECOND, (float)MEMTYPE_SIZE*(float)COUNTS_PER_SECOND/(float)counts/1000000,
+                 readback ? "OK" : "FAILED");
+         smmu_unmap(cb, va, SMMU_PT_BLOCK_2MB);
+     }
+ }
+ #endif
+ 
+ #ifdef WALK_PLACEMENT_BENCH
+ static const char* placement_names[SMMU_PT_PLACEMENTS] = {"DDR low", "OCM", "DDR high"};
+ 
+ // average time in counts of the transfers of cdma: on the same page, or on rotating pages after a TLBIALL if cold
+ static u64 walk_transfers(XAxiCdma* cdma, u8 cb, bool cold){
+     XTime startTime, endTime;
+     u64 counts = 0;
+ 
+     for (int i=0; i<N_WALK_TRANSFERS; i++){
+         u32 dst = WALK_WINDOW_VA + (cold ? (i % (WALK_WINDOW_SIZE/GRANULE))*GRANULE : 0);
+ 
+         if (cold){
+             invalidate_CBn_by_TLBIALL(cb);
+             sync_CBn_TLB(cb);
+         }
+         XTime_GetTime(&startTime);
+         XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, dst, DMA_BUF_SIZE, NULL, NULL);
+         wait_transfer(cdma, CDMA1_STREAM_ID);
+         XTime_GetTime(&endTime);
+         counts += endTime - startTime;
+     }
+ 
+     return counts / N_WALK_TRANSFERS;
+ }
+ 
+ /* The same tree of 4KB pages built in each table pool and loaded in the bank cb with the walk attributes of
+  * the pool. A cold transfer walks the three levels for the source and for the destination: the difference
+  * with the hot transfer is the miss penalty of the placement.
+  */
+ static void walk_placement_bench(XAxiCdma* cdma, u8 cb){
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+ 
+     for (int p=0; p<SMMU_PT_PLACEMENTS; p++){
+         u64* l1_table = smmu_pt_alloc_table_in(p);
+         u64 hot, cold;
+ 
+         if (l1_table == NULL){
+             continue;
+         }
+         smmu_pt_map(l1_table, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW);
+         smmu_pt_map_max_block(l1_table, WALK_WINDOW_VA, WALK_WINDOW_PA, WALK_WINDOW_SIZE, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+         smmu_pt_attach(cb, l1_table);
+         smmu_pt_set_walk_attrs(cb, p);
+         set_CBnTTBR0_32_lpae_stage1(cb, 0x0, (UINTPTR)l1_table, 0x0);
+         invalidate_CBn_by_TLBIALL(cb);
+         sync_CBn_TLB(cb);
+ 
+         hot = walk_transfers(cdma, cb, false);
+         cold = walk_transfers(cdma, cb, true);
+         printf("# APU0: tables in %s (0x%llX): hot %fns, cold %fns, miss penalty %fns\n\r", placement_names[p],
+                 (unsigned long long)(UINTPTR)l1_table, (float)hot*1000000000/(float)COUNTS_PER_SECOND, (float)cold*1000000000/(float)COUNTS_PER_SECOND,
+                 ((float)cold - (float)hot)*1000000000/(float)COUNTS_PER_SECOND);
+ 
+         smmu_pt_attach(cb, NULL);
+         smmu_pt_unmap(l1_table, src_page, GRANULE);
+         smmu_pt_unmap(l1_table, WALK_WINDOW_VA, WALK_WINDOW_SIZE);
+         smmu_pt_free_table(l1_table);
+     }
+ }
+ #endif
+ 
+ #ifdef FAULT_INJECT_BENCH
+ static const char* finject_names[SMMU_FINJECT_KINDS] = {"unmapped VA", "permission", "unidentified stream"};
+ static const char* finject_phases[SMMU_FINJECT_PHASES] = {"submit to ISR", "decode", "clear", "total"};
+ 
+ static float counts_ns(XTime counts){
+     return (float)counts*1000000000/(float)COUNTS_PER_SECOND;
+ }
+ 
+ /* N_INJECTIONS faults of each kind from cdma, whose stream is routed by SMR INJECT_SMR to the bank cb. The engine
+  * gets an abort on each fault and is reset before the next injection; a reset that does not complete in
+  * SMMU_DMA_RESET_TIMEOUT_US is counted.
+  */
+ static void fault_inject_bench(XAxiCdma* cdma, u8 cb){
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     const u32 targets[SMMU_FINJECT_KINDS] = {INJECT_VA + GRANULE, INJECT_VA, INJECT_VA};
+     smmu_finject_stats stats;
+ 
+     smmu_map(cb, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW);
+     smmu_map(cb, INJECT_VA, INJECT_PA, GRANULE, SMMU_PT_ATTR_RO);
+     smmu_finject_reset_stats();
+ 
+     for (int kind=0; kind<SMMU_FINJECT_KINDS; kind++){
+         u32 reset_failures = 0;
+ 
+         if (kind == SMMU_FINJECT_UNIDENTIFIED){
+             // no SMR matches the stream: with USFCFG = 1 the transactions raise a global fault
+             set_SMRn(INJECT_SMR, false, 0x0, 0x0, 0x0);
+         }
+         for (int i=0; i<N_INJECTIONS; i++){
+             smmu_finject_arm(kind, cb);
+             XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, targets[kind], DMA_BUF_SIZE, NULL, NULL);
+             smmu_finject_wait((XTime)INJECT_TIMEOUT_US*COUNTS_PER_SECOND/1000000);
+ 
+             if (smmu_dma_reset_cdma(cdma) != XST_SUCCESS){
+                 reset_failures++;
+             }
+         }
+         if (kind == SMMU_FINJECT_UNIDENTIFIED){
+             set_SMRn(INJECT_SMR, true, 0x0, HPC0_TBU, CDMA1_MID);
+         }
+ 
+         smmu_finject_get_stats(kind, &stats);
+         xil_printf("# APU0: %s: %u injected, %u caught, %u unexpected, %u timeouts, %u failed resets\r\n", finject_names[kind],
+                 stats.injected, stats.caught, stats.unexpected, stats.timeouts, reset_failures);
+         for (int p=0; p<SMMU_FINJECT_PHASES; p++){
+             const smmu_finject_dist* dist = &stats.phase[p];
+ 
+             if (dist->samples == 0){
+                 continue;
+             }
+             printf("# APU0: %s, %s: min %fns, mean %fns, p50 <= %fns, p99 <= %fns, max %fns\n\r", finject_names[kind],
+                     finject_phases[p], counts_ns(dist->min), counts_ns(dist->total/dist->samples),
+                     counts_ns(smmu_finject_percentile(dist, 50)), counts_ns(smmu_finject_percentile(dist, 99)), counts_ns(dist->max));
+         }
+     }
+ 
+     smmu_unmap(cb, INJECT_VA, GRANULE);
+     smmu_unmap(cb, src_page, GRANULE);
+ }
+ #endif
+ 
+ #ifdef SMMU_IRQ_DISPATCH
+ static volatile u32 cb_last_fsr[N_CBs];
+ static volatile u32 last_sgfsr;
+ 
+ // records and clears the fault of the bank: with CFCFG = 0 the transaction has been terminated already
+ static void cb_fault_record(u8 cb, u32 fsr, void* arg){
+     cb_last_fsr[cb] = fsr;
+     Xil_Out32(SMMU_CBn_FSR_base + cb*CBn_offset, fsr & ~FIELD_MASK(FSR_SS));
+ }
+ 
+ static void global_fault_record(u32 sgfsr, void* arg){
+     last_sgfsr = sgfsr;
+     Xil_Out32(SMMU_SGFSR, sgfsr);
+ }
+ 
+ static void print_irq_stats(void){
+     smmu_irq_stats stats;
+ 
+     smmu_irq_get_stats(&stats);
+     xil_printf("# APU0: SMMU interrupts %u: global %u (last sGFSR 0x%08X), unhandled %u, spurious %u\r\n", stats.interrupts,
+             stats.global, last_sgfsr, stats.unhandled, stats.spurious);
+     for (int cb=0; cb<N_CBs; cb++){
+         if (stats.cb_faults[cb] > 0){
+             xil_printf("# APU0: CB%d: %u faults, last FSR 0x%08X\r\n", cb, stats.cb_faults[cb], cb_last_fsr[cb]);
+         }
+     }
+     if (stats.interrupts > 0){
+         printf("# APU0: ISR entry to bank handler %fns on average, %fns max\n\r",
+                 (float)stats.total_dispatch_counts*1000000000/(float)COUNTS_PER_SECOND/stats.interrupts,
+                 (float)stats.max_dispatch_counts*1000000000/(float)COUNTS_PER_SECOND);
+     }
+ }
+ #endif
+ 
+ #ifdef FAULT_STORM_BENCH
+ /* CDMA1 writes to an unmapped page of the bank cb back to back, the engine is reset after each abort: far
+  * above SMMU_IRQ_STORM_HIGH, the bank goes to the poller. When the storm stops the poller gives the bank its
+  * interrupt back. The time per fault is the cost of the storm for this core in each mode.
+  */
+ static void fault_storm_bench(XAxiCdma* cdma, u8 cb){
+     const XTime timeout = (XTime)STORM_TIMEOUT_US*COUNTS_PER_SECOND/1000000;
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     XTime startTime, endTime, now;
+     u64 counts[2] = {0, 0}; // interrupt mode, polled mode
+     u32 n[2] = {0, 0};
+     smmu_irq_bank_stats stats;
+ 
+     smmu_map(cb, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW);
+ 
+     for (int i=0; i<N_STORM_FAULTS; i++){
+         smmu_irq_get_bank_stats(cb, &stats);
+         XTime_GetTime(&startTime);
+         XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, STORM_VA, DMA_BUF_SIZE, NULL, NULL);
+         do {
+             XTime_GetTime(&now);
+         } while (XAxiCdma_IsBusy(cdma) && now - startTime < timeout);
+         if (smmu_dma_reset_cdma(cdma) != XST_SUCCESS){
+             // the CDMA is wedged: the next transfers could not start
+             xil_printf("# APU0: storm stopped after %d faults, the CDMA did not complete its reset\r\n", i);
+             break;
+         }
+         smmu_irq_poll();
+         XTime_GetTime(&endTime);
+ 
+         counts[stats.polled] += endTime - startTime;
+         n[stats.polled]++;
+     }
+     smmu_irq_get_bank_stats(cb, &stats);
+     xil_printf("# APU0: storm: %u faults, %u polled, peak rate %u/s, %u throttles\r\n", stats.faults, stats.polled_faults,
+             stats.peak_rate, stats.throttles);
+     for (int mode=0; mode<2; mode++){
+         if (n[mode] > 0){
+             printf("# APU0: %s: %u faults, %fus per fault\n\r", mode ? "polled" : "interrupt", n[mode],
+                     (float)counts[mode]*1000000/(float)COUNTS_PER_SECOND/n[mode]);
+         }
+     }
+ 
+     // no more faults: the poller restores the interrupt after a quiet window
+     XTime_GetTime(&startTime);
+     do {
+         smmu_irq_poll();
+         smmu_irq_get_bank_stats(cb, &stats);
+         XTime_GetTime(&now);
+     } while (stats.polled && now - startTime < (XTime)STORM_QUIET_MS*COUNTS_PER_SECOND/1000);
+     printf("# APU0: after the storm: CB%d %s, %u restores, last rate %u/s, %fms\n\r", cb, stats.polled ? "still polled" : "on interrupt",
+             stats.restores, stats.rate, (float)(now - startTime)*1000/(float)COUNTS_PER_SECOND);
+ 
+     smmu_unmap(cb, src_page, GRANULE);
+ }
+ #endif
+ 
+ #ifdef DMA_HANG_BENCH
+ // CDMA1 writes to an unmapped page: with the fault aborted the CDMA stops on an error, with the fault stalled
+ // it hangs until the deadline. Both are detected, decoded and recovered from by the bounded wait.
+ static void dma_hang_bench(XAxiCdma* cdma, u8 cb){
+     u32 src_page = (UINTPTR)SrcBuf & ~(GRANULE - 1);
+     u32 dst_page = (UINTPTR)DstBuf & ~(GRANULE - 1);
+     XTime startTime, endTime;
+     u64 counts[SMMU_DMA_CAUSES] = {0};
+     u32 n[SMMU_DMA_CAUSES] = {0};
+     smmu_dma_result result;
+     smmu_dma_stats stats;
+     bool readback_status = true;
+ 
+     smmu_map(cb, src_page, src_page, GRANULE, SMMU_PT_ATTR_RW);
+     if (dst_page != src_page){
+         smmu_map(cb, dst_page, dst_page, GRANULE, SMMU_PT_ATTR_RW);
+     }
+ 
+     for (int stall=0; stall<2; stall++){
+         smmu_fault_enable_stall(cb, stall);
+         for (int i=0; i<N_HANG_TRANSFERS; i++){
+             XTime_GetTime(&startTime);
+             XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, HANG_VA, DMA_BUF_SIZE, NULL, NULL);
+             smmu_dma_wait_cdma(cdma, CDMA1_STREAM_ID, HANG_TIMEOUT_US, &result);
+             XTime_GetTime(&endTime);
+ 
+             if (i == 0){
+                 xil_printf("# APU0: %s fault: ", stall ? "stalled" : "aborted");
+                 smmu_dma_print(&result);
+             }
+             counts[result.cause] += endTime - startTime;
+             n[result.cause]++;
+         }
+     }
+     smmu_fault_enable_stall(cb, 0x0);
+ 
+     for (int cause=0; cause<SMMU_DMA_CAUSES; cause++){
+         if (n[cause] > 0){
+             printf("# APU0: %s: %u transfers, %fus to detect and recover\n\r", smmu_dma_cause_name(cause), n[cause],
+                     (float)counts[cause]*1000000/(float)COUNTS_PER_SECOND/n[cause]);
+         }
+     }
+     smmu_dma_get_stats(&stats);
+     xil_printf("# APU0: %u waits, %u resets, %u resets not completed\r\n", stats.waits, stats.resets, stats.reset_failures);
+ 
+     // the CDMA works again after its resets
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         SrcBuf[i] = 0x5A;
+         DstBuf[i] = 0x00;
+     }
+     XAxiCdma_SimpleTransfer(cdma, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
+     if (wait_transfer(cdma, CDMA1_STREAM_ID) != XST_SUCCESS){
+         readback_status = false;
+     }
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         if (DstBuf[i] != 0x5A){
+             readback_status = false;
+         }
+     }
+     xil_printf("# APU0: CDMA1 after recovery: readback %s\r\n", readback_status ? "OK" : "FAILED");
+ 
+     smmu_unmap(cb, src_page, GRANULE);
+     if (dst_page != src_page){
+         smmu_unmap(cb, dst_page, GRANULE);
+     }
+ }
+ #endif
+ 
+ #ifdef DMAQ_BENCH
+ static void dmaq_set_job(smmu_dmaq_job* job, u32 n){
+     u32 offset = (n % DMAQ_BUFFERS)*DMAQ_SIZE;
+ 
+     *job = (smmu_dmaq_job){0};
+     job->src = DMAQ_SRC + offset;
+     job->dst = DMAQ_DST + offset;
+     job->size = DMAQ_SIZE;
+ }
+ 
+ static bool dmaq_check(void){
+     volatile u8* src = (volatile u8*)DMAQ_SRC;
+     volatile u8* dst = (volatile u8*)DMAQ_DST;
+ 
+     for (int i=0; i<DMAQ_BUFFERS*DMAQ_SIZE; i++){
+         if (dst[i] != src[i]){
+             return false;
+         }
+     }
+     return true;
+ }
+ 
+ static void dmaq_clear(u8 pattern){
+     volatile u8* src = (volatile u8*)DMAQ_SRC;
+     volatile u8* dst = (volatile u8*)DMAQ_DST;
+ 
+     for (int i=0; i<DMAQ_BUFFERS*DMAQ_SIZE; i++){
+         src[i] = (u8)(i ^ pattern);
+         dst[i] = 0x00;
+     }
+ }
+ 
+ /* N_DMAQ_JOBS copies of DMAQ_SIZE bytes by CDMA1, each mapped in an IOVA window of cb for its transfer only.
+  * sequential: map, transfer, wait and unmap with its TLB invalidation, one job after the other;
+  * pipeline: the jobs go through smmu_dmaq, which maps the next job during the transfer and invalidates the
+  * TLB once per batch of retired jobs.
+  */
+ static void dmaq_bench(XAxiCdma* cdma, u8 cb){
+     static smmu_dmaq_job jobs[SMMU_DMAQ_DEPTH];
+     smmu_dmaq q;
+     smmu_dmaq_job* job;
+     smmu_dmaq_stats stats;
+     XTime startTime, endTime;
+     u64 sync_counts, async_counts;
+     u32 src_iova, dst_iova;
+     u32 submitted = 0, completed = 0, sync_failed = 0;
+ 
+     if (smmu_iova_window_init(cb, DMAQ_IOVA, DMAQ_IOVA_SIZE) != XST_SUCCESS){
+         return;
+     }
  
- // I have put the translation tables here because in the main function setting it to 0 was blocking the program
- // Maybe it goes over the stack size limitation
+     dmaq_clear(0x00);
+     XTime_GetTime(&startTime);
+     for (int i=0; i<N_DMAQ_JOBS; i++){
+         u32 offset = (i % DMAQ_BUFFERS)*DMAQ_SIZE;
  
- // translation table locations
- // TTBR addresses must be aligned with the granule (4KB in aarch32 lpae)
- #define GRANULE 4096
- /* u64 cb0_tt_l1_base_64[4] __attribute__((aligned(GRANULE)));*/
+         smmu_iova_window_map(cb, DMAQ_SRC + offset, DMAQ_SIZE, SMMU_PT_ATTR_RO, &src_iova);
+         smmu_iova_window_map(cb, DMAQ_DST + offset, DMAQ_SIZE, SMMU_PT_ATTR_RW, &dst_iova);
+         XAxiCdma_SimpleTransfer(cdma, src_iova, dst_iova, DMAQ_SIZE, NULL, NULL);
+         if (wait_transfer(cdma, CDMA1_STREAM_ID) != XST_SUCCESS){
+             sync_failed++;
+         }
+         smmu_iova_window_unmap(cb, src_iova, DMAQ_SIZE);
+         smmu_iova_window_unmap(cb, dst_iova, DMAQ_SIZE);
+     }
+     XTime_GetTime(&endTime);
+     sync_counts = endTime - startTime;
+     xil_printf("# APU0: sequential readback %s, %u failed\r\n", dmaq_check() ? "OK" : "FAILED", sync_failed);
+ 
+     // the pipeline is kept full: a completed job is submitted again for the next copy
+     dmaq_clear(0x5A);
+     smmu_dmaq_init(&q, cdma, CDMA1_STREAM_ID, cb, DMA_TIMEOUT_US);
+     XTime_GetTime(&startTime);
+     for (int i=0; i<SMMU_DMAQ_DEPTH && submitted < N_DMAQ_JOBS; i++){
+         dmaq_set_job(&jobs[i], submitted++);
+         smmu_dmaq_submit(&q, &jobs[i]);
+     }
+     while (completed < N_DMAQ_JOBS){
+         if (smmu_dmaq_wait(&q, &job, DMA_TIMEOUT_US) != XST_SUCCESS){
+             xil_printf("# APU0: no job completed in %dus, the pipeline stops\r\n", DMA_TIMEOUT_US);
+             break;
+         }
+         completed++;
+         if (submitted < N_DMAQ_JOBS){
+             dmaq_set_job(job, submitted++);
+             smmu_dmaq_submit(&q, job);
+         }
+     }
+     XTime_GetTime(&endTime);
+     async_counts = endTime - startTime;
+     smmu_dmaq_get_stats(&q, &stats);
+     xil_printf("# APU0: pipeline readback %s, %u completed, %u failed\r\n", dmaq_check() ? "OK" : "FAILED",
+             stats.completed, stats.failed);
+ 
+     printf("# APU0: sequential %fus per job, %fMB/s\n\r", (float)sync_counts*1000000/(float)COUNTS_PER_SECOND/N_DMAQ_JOBS,
+             (float)N_DMAQ_JOBS*DMAQ_SIZE*(float)COUNTS_PER_SECOND/(float)sync_counts/1000000);
+     printf("# APU0: pipeline %fus per job, %fMB/s\n\r", (float)async_counts*1000000/(float)COUNTS_PER_SECOND/N_DMAQ_JOBS,
+             (float)N_DMAQ_JOBS*DMAQ_SIZE*(float)COUNTS_PER_SECOND/(float)async_counts/1000000);
+     printf("# APU0: pipeline: CDMA busy %f%% of the time, mapping %fus per job, %u jobs mapped ahead, %u TLB invalidations\n\r",
+             (float)stats.busy_counts*100/(float)async_counts, (float)stats.map_counts*1000000/(float)COUNTS_PER_SECOND/N_DMAQ_JOBS,
+             stats.prepared_ahead, stats.tlbi_batches);
+ 
+     smmu_iova_window_destroy(cb);
+ }
+ #endif
  
- // output addresses for the translation of 1GB
- // Note: those are the 10 bits [39:30] for the output address
- // DDR_LOW is DDR Low is 2 GB 0x0000_0000-0x7FFF_FFFF
- # define VIRT_BASE_ADDR 0x840000000
- u16 output_address_0 = 0x0; // flat [39:30]
- u16 output_address_1 = 0b0000100001; // not flat [39:30] --> 0x8_4000_0000
+ #ifdef DMAPOOL_BENCH
+ static const u16 dmapool_counts[SMMU_DMAPOOL_CLASSES] = {64, 64, 32, 32, 32, 16, 16, 8, 8, 4, 4, 2, 2, 1, 1, 1};
  
- /* -- NOTES -- */
+ static bool dmapool_check(const u8* src, const u8* dst, u32 size){
+     for (u32 i=0; i<size; i++){
+         if (dst[i] != src[i]){
+             return false;
+         }
+     }
+     return true;
+ }
  
- /*
-  * Aarch32 LPAE:
-  * -Uses 64-bit descriptors in its translation tables
-  * -Is added to the ARMv7 architecture by the Large Physical Address Extension (LPAE)
-  * -Supports the translation of VAs of up to 32 bits
-  * -Supports output addresses of up to 40 bits, that can be IPAs or VAs.
+ /* CDMA1 copies of 64B to 4KB between two buffers.
+  * mapped: the buffers are mapped in an IOVA window of cb before the transfer and unmapped after it, with the
+  * TLB invalidation, as a driver without persistent mappings does;
+  * pool: the buffers are allocated from the pool, mapped once at init, and freed after the transfer.
   */
+ static void dmapool_bench(XAxiCdma* cdma, u8 cb){
+     XTime startTime, endTime;
+     u64 map_counts, pool_counts;
+     u32 src_iova, dst_iova;
+     u8* src;
+     u8* dst;
+     smmu_iova_stats iova_before, iova_after;
+     smmu_dmapool_stats stats;
+     smmu_dmapool_class_stats class_stats;
+     bool readback_status = true;
  
- /* The configuration is a an entry block for the first stage of translation:
-  * The bits [32:30] are used to select one of the 4 entries of the translation table. Then, the entry will contain
-  * an output address of 39:30 set that will be attached to the remaining bits.
-  * In a flat configuration, those bits are set to 0x0.
-  * Supposing to have the output bits set to 0x400 (0b10000000000), the output will be that bits concatenated to the
-  * remaining ones [29:0].
-  */
+     if (smmu_dmapool_init(cb, DMAPOOL_BASE, DMAPOOL_IOVA, dmapool_counts, SMMU_MEM_NORMAL_NC) != XST_SUCCESS){
+         return;
+     }
+     if (smmu_iova_window_init(cb, DMAPOOL_MAP_IOVA, DMAPOOL_MAP_IOVA_SIZE) != XST_SUCCESS){
+         smmu_dmapool_destroy();
+         return;
+     }
+     smmu_dmapool_get_stats(&stats);
+     xil_printf("# APU0: DMA pool of %u bytes at IOVA 0x%08X\r\n", stats.size, DMAPOOL_IOVA);
+ 
+     for (u32 size=64; size<=4096; size<<=1){
+         src = smmu_dmapool_alloc(size, NULL);
+         dst = smmu_dmapool_alloc(size, NULL);
+         for (u32 i=0; i<size; i++){
+             src[i] = (u8)(i + size);
+         }
  
- /* -- NOTES -- */
+         XTime_GetTime(&startTime);
+         for (int i=0; i<N_DMAPOOL_TRANSFERS; i++){
+             smmu_iova_window_map(cb, (UINTPTR)src, size, SMMU_PT_ATTR_RO, &src_iova);
+             smmu_iova_window_map(cb, (UINTPTR)dst, size, SMMU_PT_ATTR_RW, &dst_iova);
+             XAxiCdma_SimpleTransfer(cdma, src_iova, dst_iova, size, NULL, NULL);
+             wait_transfer(cdma, CDMA1_STREAM_ID);
+             smmu_iova_window_unmap(cb, src_iova, size);
+             smmu_iova_window_unmap(cb, dst_iova, size);
+         }
+         XTime_GetTime(&endTime);
+         map_counts = endTime - startTime;
+         readback_status &= dmapool_check(src, dst, size);
+         smmu_dmapool_free(dst);
+         smmu_dmapool_free(src);
  
- // configure CDMA1-0 (PL)
- #define HPC_CHANNEL	1
- #define AXI_ATTR(prot, cache)	((prot << 4) | cache)
- #define NORM_WB_OUT_CACHE	0x605UL
- #define PROT_UP_S_D	0x0	/* Unprivileged, Secure, Data */
- #define AXI_PROT	PROT_UP_S_D
- #define	CACHE_OA_M	0xB /* Write-through No-allocate */
+         // the free lists are LIFO: the pool hands out the same two buffers, src keeps its data
+         smmu_iova_get_stats(&iova_before);
+         XTime_GetTime(&startTime);
+         for (int i=0; i<N_DMAPOOL_TRANSFERS; i++){
+             src = smmu_dmapool_alloc(size, &src_iova);
+             dst = smmu_dmapool_alloc(size, &dst_iova);
+             XAxiCdma_SimpleTransfer(cdma, src_iova, dst_iova, size, NULL, NULL);
+             wait_transfer(cdma, CDMA1_STREAM_ID);
+             smmu_dmapool_free(dst);
+             smmu_dmapool_free(src);
+         }
+         XTime_GetTime(&endTime);
+         pool_counts = endTime - startTime;
+         smmu_iova_get_stats(&iova_after);
+         readback_status &= dmapool_check(src, dst, size);
  
- XAxiCdma FpdCDma0;
- XAxiCdma FpdCDma1;
- XAxiCdma_Config *CDmaConfig0;
- XAxiCdma_Config *CDmaConfig1;
- static void FpdCdmaConfiguration(void)
- {
-     CDmaConfig0 = XAxiCdma_LookupConfig(XPAR_AXICDMA_0_DEVICE_ID);
-     if (!CDmaConfig0) {
-         xil_printf("Cannot find config structure \r\n");
-         return XST_FAILURE;
+         printf("# APU0: %u bytes: mapped per transfer %fus, pool %fus, %u mappings on the pool path\n\r", size,
+                 (float)map_counts*1000000/(float)COUNTS_PER_SECOND/N_DMAPOOL_TRANSFERS,
+                 (float)pool_counts*1000000/(float)COUNTS_PER_SECOND/N_DMAPOOL_TRANSFERS, iova_after.maps - iova_before.maps);
      }
-     CDmaConfig1 = XAxiCdma_LookupConfig(XPAR_AXICDMA_1_DEVICE_ID);
-     if (!CDmaConfig1) {
-         xil_printf("Cannot find config structure \r\n");
-         return XST_FAILURE;
+     xil_printf("# APU0: DMA pool readback %s\r\n", readback_status ? "OK" : "FAILED");
+ 
+     smmu_dmapool_get_stats(&stats);
+     xil_printf("# APU0: DMA pool: %u allocations, %u frees, %u failures\r\n", stats.allocs, stats.frees, stats.failures);
+     for (int cls=0; cls<SMMU_DMAPOOL_CLASSES; cls++){
+         smmu_dmapool_get_class_stats(cls, &class_stats);
+         if (class_stats.allocs > 0){
+             xil_printf("# APU0:   %u bytes: %u allocations, peak %u of %u, %u from smaller sizes\r\n",
+                     1U << (SMMU_DMAPOOL_MIN_SHIFT + cls), class_stats.allocs, class_stats.peak, class_stats.count,
+                     class_stats.fallbacks);
+         }
      }
-     XAxiCdma_CfgInitialize(&FpdCDma0, CDmaConfig0, CDmaConfig0->BaseAddress);
-     XAxiCdma_CfgInitialize(&FpdCDma1, CDmaConfig1, CDmaConfig1->BaseAddress);
+ 
+     smmu_iova_window_destroy(cb);
+     smmu_dmapool_destroy();
  }
+ #endif
  
- static void do_transfers(XAxiCdma** cdma_vector, u32 cdma_vector_len, u32 n_transfers){
-     u64 elapsed_counts;
-     int ret;
-     float time_elapsed;
-     float average_time = 0;
-     XTime startTime, endTime;
+ #ifdef ZCOPY_BENCH
+ static void zcopy_copy(volatile u64* dst, volatile u64* src, u32 size){
+     for (u32 w=0; w<size/8; w++){
+         dst[w] = src[w];
+     }
+ }
  
-     // note: the GetTime functions read the number of clock cycles of the processor
-     // The difference of counts divided by the counts per seconds gives me the elapsed time in seconds
-     for (int i=0; i<n_transfers; i++){
+ static bool zcopy_check(u32 size){
+     volatile u8* src = (volatile u8*)ZCOPY_APP_SRC;
+     volatile u8* dst = (volatile u8*)ZCOPY_APP_DST;
  
-         // NOTE: IL PROBLEMA E' CHE DOPO CHE CDMA1 FA UNA TRANSAZIONE, CDMA 0 NON PUO' PIU'
+     for (u32 i=0; i<size; i++){
+         if (dst[i] != src[i]){
+             return false;
+         }
+     }
+     return true;
+ }
  
-         /* try to comment this */
-         Xil_Out32(0xFD810618, 0xFFFFFFFF); //invalidate all
-         Xil_Out32(0xFD810600, 0x0); // invalidate by VA
-         Xil_Out32(0xFD800064, 0x0); // invalidate by VMID 0x0 (CBAR)
-         Xil_Out32(0xFD800060, 0x0); // invalidate STLBIALL
-         Xil_Out32(0xFD800068, 0x0); // SMMU_TLBIALLNSNH
-         /*memset(cb0_tt_l1_base_64, 0x0, sizeof(u64)*4);
-         set_Table_Entry_32_lpae(cb0_tt_l1_base_64, entry_index, entry_value_0);*/
-         //XAxiCdma_CfgInitialize(&FpdCDma0, CDmaConfig0, CDmaConfig0->BaseAddress);
-         /* try to comment this */
+ static void zcopy_clear(u32 size, u8 pattern){
+     volatile u8* src = (volatile u8*)ZCOPY_APP_SRC;
+     volatile u8* dst = (volatile u8*)ZCOPY_APP_DST;
  
-         /* try to comment this */
-         /*Xil_DCacheInvalidate();
-         Xil_ICacheInvalidate();*/
-         /* try to comment this */
-         XTime_GetTime(&startTime);
+     for (u32 i=0; i<size; i++){
+         src[i] = (u8)(i ^ pattern);
+         dst[i] = 0x00;
+     }
+ }
  
-         // CDMAs transfers
-         for (int i=0; i<cdma_vector_len; i++){
-             ret = XAxiCdma_SimpleTransfer(cdma_vector[i], (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
+ /* CDMA1 moves an application source buffer to an application destination buffer.
+  * copy: the CPU copies the source into a fixed DMA buffer, the CDMA copies it to a second one, the CPU
+  * copies that to the destination;
+  * zero-copy: the application buffers are mapped in the IOVA window of the bank of CDMA1 for the transfer,
+  * the source read-only and the destination read/write.
+  */
+ static void zcopy_bench(XAxiCdma* cdma, u8 cb){
+     XTime startTime, endTime;
+     u64 copy_counts, zcopy_counts;
+     smmu_zcopy_handle src, dst;
+     smmu_zcopy_stats stats;
+     bool copy_status = true, zcopy_status = true;
+ 
+     smmu_map(cb, ZCOPY_DMA_SRC, ZCOPY_DMA_SRC, 2*SMMU_PT_BLOCK_2MB, SMMU_PT_ATTR_RW);
+     if (smmu_iova_window_init(cb, ZCOPY_IOVA, ZCOPY_IOVA_SIZE) != XST_SUCCESS){
+         smmu_unmap(cb, ZCOPY_DMA_SRC, 2*SMMU_PT_BLOCK_2MB);
+         return;
+     }
  
-             // ret != XST_SUCCESS
-             if (ret != 0){
-                 xil_printf("# APU0: the transfer went wrong, loop breaks\r\n");
-                 break;
-             }
+     for (u32 size=0x1000; size<=ZCOPY_MAX_SIZE; size<<=2){
+         zcopy_clear(size, 0x00);
+         XTime_GetTime(&startTime);
+         for (int i=0; i<N_ZCOPY_TRANSFERS; i++){
+             zcopy_copy((volatile u64*)ZCOPY_DMA_SRC, (volatile u64*)ZCOPY_APP_SRC, size);
+             XAxiCdma_SimpleTransfer(cdma, ZCOPY_DMA_SRC, ZCOPY_DMA_DST, size, NULL, NULL);
+             wait_transfer(cdma, CDMA1_STREAM_ID);
+             zcopy_copy((volatile u64*)ZCOPY_APP_DST, (volatile u64*)ZCOPY_DMA_DST, size);
          }
+         XTime_GetTime(&endTime);
+         copy_counts = endTime - startTime;
+         copy_status &= zcopy_check(size);
  
-         // wait for all the cdmas to end
-         for (int i=0; i<cdma_vector_len; i++){
-             while (XAxiCdma_IsBusy(cdma_vector[i]));
+         zcopy_clear(size, 0xA5);
+         XTime_GetTime(&startTime);
+         for (int i=0; i<N_ZCOPY_TRANSFERS; i++){
+             if (smmu_zcopy_map(CDMA1_STREAM_ID, (void*)ZCOPY_APP_SRC, size, SMMU_ZCOPY_TO_DEVICE, &src) != XST_SUCCESS){
+                 break;
+             }
+             if (smmu_zcopy_map(CDMA1_STREAM_ID, (void*)ZCOPY_APP_DST, size, SMMU_ZCOPY_FROM_DEVICE, &dst) != XST_SUCCESS){
+                 smmu_zcopy_unmap(&src);
+                 break;
+             }
+             XAxiCdma_SimpleTransfer(cdma, src.iova, dst.iova, size, NULL, NULL);
+             wait_transfer(cdma, CDMA1_STREAM_ID);
+             smmu_zcopy_unmap(&dst);
+             smmu_zcopy_unmap(&src);
          }
- 
-         // measure endTime
          XTime_GetTime(&endTime);
+         zcopy_counts = endTime - startTime;
+         zcopy_status &= zcopy_check(size);
  
-         // printing the elapsed time in milliseconds
-         elapsed_counts = endTime - startTime;
-         time_elapsed = (float)elapsed_counts/(float)COUNTS_PER_SECOND;
-         average_time += time_elapsed;
+         printf("# APU0: %u bytes: copy path %fus, zero-copy %fus per transfer\n\r", size,
+                 (float)copy_counts*1000000/(float)COUNTS_PER_SECOND/N_ZCOPY_TRANSFERS,
+                 (float)zcopy_counts*1000000/(float)COUNTS_PER_SECOND/N_ZCOPY_TRANSFERS);
      }
+     xil_printf("# APU0: copy path readback %s, zero-copy readback %s\r\n", copy_status ? "OK" : "FAILED",
+             zcopy_status ? "OK" : "FAILED");
  
-     // print the average time in milliseconds
-     average_time = average_time / n_transfers;
-     printf("# APU0: transfer completed in %fms on average\n\r", average_time*1000); // xil_printf does not support floating point
+     smmu_zcopy_get_stats(&stats);
+     xil_printf("# APU0: zero-copy: %u maps, %u failures, %u unaligned destinations\r\n", stats.maps, stats.failures,
+             stats.unaligned);
+ 
+     smmu_iova_window_destroy(cb);
+     smmu_unmap(cb, ZCOPY_DMA_SRC, 2*SMMU_PT_BLOCK_2MB);
  }
+ #endif
  
+ #ifdef PT_SHARE_BENCH
+ static void pt_share_build(u64** roots, u64* template, bool shared){
+     for (int d=0; d<PT_SHARE_DOMAINS; d++){
+         if (shared){
+             smmu_pt_share(roots[d], template, PT_SHARE_VA, PT_SHARE_SIZE);
+         }
+         else {
+             smmu_pt_map_max_block(roots[d], PT_SHARE_VA, PT_SHARE_BASE, PT_SHARE_SIZE, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+         }
+     }
+ }
+
+ // every tree but the one of CB1 must still translate the region onto PT_SHARE_BASE
+ static bool pt_share_check_others(u64** roots){
+     u64 pa;
+
+     for (int d=1; d<PT_SHARE_DOMAINS; d++){
+         for (u32 offset=0; offset<PT_SHARE_SIZE; offset+=SMMU_PT_BLOCK_4KB){
+             if (walk_Table_32_lpae(roots[d], PT_SHARE_VA + offset, &pa) != XST_SUCCESS || pa != PT_SHARE_BASE + offset){
+                 return false;
+             }
+         }
+     }
+     return true;
+ }
+
+ /* A region (firmware mailboxes, shared rings) is mapped in PT_SHARE_DOMAINS trees, the first of them the one of
+  * the bank of CDMA1: private tables built in each tree against the L3 tables of a template tree linked into each.
+  * CDMA1 then copies through the shared tables, and CB1 replaces its first page: the L3 table of the page is
+  * split for CB1 alone (copy-on-write) and the other trees keep the original mapping.
+  */
+ static void pt_share_bench(XAxiCdma* cdma, u8 cb){
+     u64* roots[PT_SHARE_DOMAINS];
+     u64* template = smmu_pt_alloc_table();
+     volatile u32* region = (volatile u32*)PT_SHARE_BASE;
+     volatile u32* alt = (volatile u32*)PT_SHARE_ALT;
+     XTime startTime, endTime;
+     u32 free_pages;
+     smmu_pt_share_stats stats;
+     bool status = true;
+
+     if (template == NULL || smmu_pt_map_max_block(template, PT_SHARE_VA, PT_SHARE_BASE, PT_SHARE_SIZE, SMMU_PT_ATTR_RW,
+             SMMU_PT_BLOCK_4KB) != XST_SUCCESS){
+         return;
+     }
+     roots[0] = smmu_pt_root(cb);
+     for (int d=1; d<PT_SHARE_DOMAINS; d++){
+         roots[d] = smmu_pt_alloc_table();
+     }
+
+     for (int pass=0; pass<2; pass++){
+         bool shared = pass == 1;
+
+         free_pages = smmu_pt_free_pages();
+         XTime_GetTime(&startTime);
+         pt_share_build(roots, template, shared);
+         XTime_GetTime(&endTime);
+         free_pages -= smmu_pt_free_pages();
+
+         printf("# APU0: %s tables: %d trees built in %fus, %u table pages\n\r", shared ? "shared" : "private",
+                 PT_SHARE_DOMAINS, (float)(endTime - startTime)*1000000/(float)COUNTS_PER_SECOND, free_pages);
+         status &= pt_share_check_others(roots);
+
+         if (!shared){
+             for (int d=0; d<PT_SHARE_DOMAINS; d++){
+                 smmu_pt_unmap(roots[d], PT_SHARE_VA, PT_SHARE_SIZE);
+             }
+             invalidate_CBn_by_TLBIALL(cb);
+             sync_CBn_TLB(cb);
+         }
+     }
+
+     // CDMA1 through the shared tables: first half of the region to the second
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         region[i] = i;
+         region[PT_SHARE_SIZE/8 + i] = 0;
+     }
+     XAxiCdma_SimpleTransfer(cdma, PT_SHARE_VA, PT_SHARE_VA + PT_SHARE_SIZE/2, DMA_BUF_SIZE*4, NULL, NULL);
+     wait_transfer(cdma, CDMA1_STREAM_ID);
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         status &= region[PT_SHARE_SIZE/8 + i] == i;
+     }
+
+     // CB1 alone moves its first page to PT_SHARE_ALT
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         alt[i] = ~i;
+     }
+     XTime_GetTime(&startTime);
+     smmu_unmap(cb, PT_SHARE_VA, SMMU_PT_BLOCK_4KB);
+     smmu_map(cb, PT_SHARE_VA, PT_SHARE_ALT, SMMU_PT_BLOCK_4KB, SMMU_PT_ATTR_RW);
+     XTime_GetTime(&endTime);
+     printf("# APU0: copy-on-write remap of a page of CB1 in %fus\n\r", (float)(endTime - startTime)*1000000/(float)COUNTS_PER_SECOND);
+
+     XAxiCdma_SimpleTransfer(cdma, PT_SHARE_VA, PT_SHARE_VA + PT_SHARE_SIZE/2, DMA_BUF_SIZE*4, NULL, NULL);
+     wait_transfer(cdma, CDMA1_STREAM_ID);
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         status &= region[PT_SHARE_SIZE/8 + i] == ~i;
+     }
+     status &= pt_share_check_others(roots);
+     xil_printf("# APU0: shared tables readback %s\r\n", status ? "OK" : "FAILED");
+
+     smmu_pt_get_share_stats(&stats);
+     xil_printf("# APU0: %u links, %u copy-on-write splits, %u shared table pages sparing %u pages\r\n", stats.links,
+             stats.cow_splits, stats.shared_tables, stats.saved_pages);
+
+     smmu_unmap(cb, PT_SHARE_VA, PT_SHARE_SIZE);
+     for (int d=1; d<PT_SHARE_DOMAINS; d++){
+         smmu_pt_free_tree(roots[d]);
+     }
+     smmu_pt_free_tree(template);
+ }
+ #endif
+
  // Interrupt handler
  
  bool a = true;
  void SMMU_InterruptHandler(void *CallbackRef) {
  
+ #ifdef FAULT_INJECT_BENCH
+     // an injected fault: timestamped, decoded and cleared before anything else
+     if (smmu_finject_isr() >= 0){
+         return;
+     }
+ #endif
+ 
+ #if defined(STALL_FAULT_BENCH) || defined(LAZY_MAP_BENCH)
+     // the stalled transactions are resolved here and recorded in the fault queue; the line is acknowledged
+     // first, so that a fault raised meanwhile asserts it again
+     Xil_Out32(SMMU_REG_ISR0, Xil_In32(SMMU_REG_ISR0));
+     if (smmu_fault_service_all() > 0){
+         return;
+     }
+ #endif
+ 
+ #ifdef DOMAIN_BENCH
+     // a stream of an unbound domain: the domain is bound, the master retries the transaction
+     Xil_Out32(SMMU_REG_ISR0, Xil_In32(SMMU_REG_ISR0));
+     if (smmu_domain_service_global_fault() >= 0){
+         return;
+     }
+ #endif
+ 
      if (a){
          xil_printf("-- SMMU INTERRUPT HANDLER -- \n\r");
          // print errors
@@ -270,6 +2209,17 @@
      // Enable interrupts in the Processor.
      Xil_ExceptionEnable();
  
+#ifdef SMMU_IRQ_DISPATCH
+     // the handlers of the banks are called by smmu_irq_dispatch, on the housekeeping core only
+     Status = smmu_irq_init(&xInterruptController, SMMU_INTR_ID);
+     if (Status != XST_SUCCESS) {
+         return Status;
+     }
+     Status = smmu_irq_set_affinity(SMMU_IRQ_CPU, SMMU_IRQ_PRIORITY);
+     if (Status != XST_SUCCESS) {
+         return Status;
+     }
+#else
      // Connect the interrupt ID with the handler function
      // Connect the device driver handler that will be called when an interrupt for the device occurs
      Status = XScuGic_Connect(&xInterruptController, SMMU_INTR_ID, (Xil_ExceptionHandler)SMMU_InterruptHandler, NULL);
@@ -280,6 +2230,7 @@
      // The SMMU has the interrupt enabled. See psu_init_gpl SMMU_REG Interrrupt Enable
      // Enabling the SMMU interrupts in the gic
      XScuGic_Enable(&xInterruptController, SMMU_INTR_ID);
+#endif
  
      // Enable interrupts in the processor
      Xil_ExceptionEnableMask(XIL_EXCEPTION_IRQ);
@@ -298,6 +2249,9 @@
      XAxiCdma* cdma_vector[N_CDMA];
      cdma_vector[0] = &FpdCDma0;
      cdma_vector[1] = &FpdCDma1;
+     u16 stream_vector[N_CDMA];
+     stream_vector[0] = CDMA0_STREAM_ID;
+     stream_vector[1] = CDMA1_STREAM_ID;
  
      // Note: the TTBR addresses must be aligned at the GRANULE size, if the TTBR contains an address of an input address space less than 1GB, the translation starts from level 2!
      // need an higher address!
@@ -543,16 +2497,16 @@
       * translation scheme is selected. The SMMU_CBn_PRRR and SMMU_CBn_NMRR
       * registers are used when the AArch32 Short-descriptor translation scheme is selected.
       * See Memory attribute indirection on page 16-291. */
-     // set Attribute 0 Normal, Inner/Outer Non-Cacheable (the only available)
+     // load the managed attribute table of smmu_pgtable.h (enum smmu_mem_type), Attribute 0 is Normal, Inner/Outer Non-Cacheable
      // the field AttrIndex determines the attribute that must be applied for the page table
      // MAIR defines
      // type: normal or device memory
      // if normal it specifies the properties for inner and outer cacheability: WT, WB
      // if WT/WB, the read allocates and write allocates policy
-     // in this case entry 0 is Normal memory, Inner/Outer Non-Cacheable
+     // in this case entry 0 is Normal memory, Inner/Outer Non-Cacheable: the block entries below use AttrIndx 0
  
-     set_CBn_MAIR_stage1(cb_index_0, NORMAL_IO_NonCacheable);
-     set_CBn_MAIR_stage1(cb_index_1, NORMAL_IO_NonCacheable);
+     smmu_pt_set_mair(cb_index_0);
+     smmu_pt_set_mair(cb_index_1);
  
      /* -- Init MAIR -- */
  
@@ -576,7 +2530,7 @@
      // set TCR2 for context bank 0 and context bank 1
      // Note: This register does not exist for stage 2 CBs
      u8 tbi0    = 0b0;  // Top byte not ignored. It is used in the address calculation.
-     u8 pa_size = 0b00; // IPS: pa_size = 0 --> 32 bit PA space
+     u8 pa_size = PA_40; // IPS: 40 bit PA space, the tables and the CB1 block are in DDR high
      set_CBn_TCR2_stage1(cb_index_0, tbi0, pa_size);
      set_CBn_TCR2_stage1(cb_index_1, tbi0, pa_size);
  
@@ -585,7 +2539,7 @@
      /* -- Init CBn_TTBR */
  
      // pp.341 format for aarch32 lpae
-     // first 32 bits of the variables will be taken
+     // the table addresses are 40 bit: the tables are in DDR high
      // TTBR addresses must be granule-aligned. In case of an address that takes less than 1GB, the starting level will be 2 instead of 1.
      xil_printf("The value of cb0_tt_l1_base_64 address is 0x%016llX\n\r", cb0_tt_l1_base_64);
      xil_printf("The value of cb1_tt_l1_base_64 address is 0x%016llX\n\r", cb1_tt_l1_base_64);
@@ -602,6 +2556,16 @@
  
      set_SMMU_CBn_SCTLR(cb_index_0, m_bit, cfre, cfie);
      set_SMMU_CBn_SCTLR(cb_index_1, m_bit, cfre, cfie);
+#ifdef SMMU_IRQ_DISPATCH
+     smmu_irq_set_global_handler(global_fault_record, NULL);
+     smmu_irq_set_handler(cb_index_0, cb_fault_record, NULL);
+#if defined(STALL_FAULT_BENCH) || defined(LAZY_MAP_BENCH)
+     // the stalled transactions of CB1 are resolved by smmu_fault.c
+     smmu_irq_set_handler(cb_index_1, smmu_irq_fault_handler, NULL);
+#else
+     smmu_irq_set_handler(cb_index_1, cb_fault_record, NULL);
+#endif
+#endif
  
      /* -- set SMMU_CBn_SCTLR -- */
  
@@ -906,7 +2870,7 @@
          xil_printf("# APU0: the transfer for CDMA0 went wrong \r\n");
      }
  
-     while (XAxiCdma_IsBusy(&FpdCDma0));
+     wait_transfer(&FpdCDma0, CDMA0_STREAM_ID);
  
      // readback
      bool readback_status = true;
@@ -948,7 +2912,7 @@
          xil_printf("# APU0: the transfer for CDMA1 went wrong \r\n");
      }
  
-     while (XAxiCdma_IsBusy(&FpdCDma1));
+     wait_transfer(&FpdCDma1, CDMA1_STREAM_ID);
  
      // readback
      readback_status = true;
@@ -967,38 +2931,38 @@
      if (ret != 0){
          xil_printf("# APU0: the transfer for CDMA0 went wrong \r\n");
      }
-     while (XAxiCdma_IsBusy(&FpdCDma0));
+     wait_transfer(&FpdCDma0, CDMA0_STREAM_ID);
  
      ret = XAxiCdma_SimpleTransfer(&FpdCDma1, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
      if (ret != 0){
          xil_printf("# APU0: the transfer for CDMA0 went wrong \r\n");
      }
-     while (XAxiCdma_IsBusy(&FpdCDma1));
+     wait_transfer(&FpdCDma1, CDMA1_STREAM_ID);
  
      ret = XAxiCdma_SimpleTransfer(&FpdCDma1, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
      if (ret != 0){
          xil_printf("# APU0: the transfer for CDMA0 went wrong \r\n");
      }
-     while (XAxiCdma_IsBusy(&FpdCDma1));
+     wait_transfer(&FpdCDma1, CDMA1_STREAM_ID);
  
      ret = XAxiCdma_SimpleTransfer(&FpdCDma0, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
      if (ret != 0){
          xil_printf("# APU0: the transfer for CDMA0 went wrong \r\n");
      }
-     while (XAxiCdma_IsBusy(&FpdCDma0));
+     wait_transfer(&FpdCDma0, CDMA0_STREAM_ID);
  
      ret = XAxiCdma_SimpleTransfer(&FpdCDma0, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
      if (ret != 0){
          xil_printf("# APU0: the transfer for CDMA0 went wrong \r\n");
      }
-     while (XAxiCdma_IsBusy(&FpdCDma0));
+     wait_transfer(&FpdCDma0, CDMA0_STREAM_ID);
  
  
      /*ret = XAxiCdma_SimpleTransfer(&FpdCDma1, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
      if (ret != 0){
          xil_printf("# APU0: the transfer for CDMA1 went wrong \r\n");
      }
-     while (XAxiCdma_IsBusy(&FpdCDma1));
+     wait_transfer(&FpdCDma1, CDMA1_STREAM_ID);
  
  
  
@@ -1008,10 +2972,209 @@
      }
      while (XAxiCdma_IsBusy(&FpdCDma1));*/
  
+#ifdef STALL_FAULT_BENCH
+     xil_printf("# ------------- APU0: stall fault benchmark ------------- \n\r");
+     // CB1 temporarily uses an empty tree of the table pool: the pages of CDMA1 are mapped on its faults
+     smmu_fault_set_handler(cb_index_1, map_on_fault, NULL);
+     smmu_fault_enable_stall(cb_index_1, 0x1);
+ 
+     // per-context stalling must be allowed globally
+     set_SMMU_sCR0(clientpd, gfre, gfie, 0x0, usfcfg);
+ 
+     with_cb1_pool_tree(stall_fault_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+ 
+     set_SMMU_sCR0(clientpd, gfre, gfie, stalld, usfcfg);
+     smmu_fault_enable_stall(cb_index_1, 0x0);
+     smmu_fault_set_handler(cb_index_1, NULL, NULL);
+#endif
+
+#ifdef LAZY_MAP_BENCH
+     xil_printf("# ------------- APU0: lazy mapping benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool: the window is populated on the stall faults of CDMA1
+     smmu_lazy_install(cb_index_1);
+     set_SMMU_sCR0(clientpd, gfre, gfie, 0x0, usfcfg);
+ 
+     with_cb1_pool_tree(lazy_map_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+ 
+     set_SMMU_sCR0(clientpd, gfre, gfie, stalld, usfcfg);
+     smmu_fault_enable_stall(cb_index_1, 0x0);
+     smmu_fault_set_handler(cb_index_1, NULL, NULL);
+#endif
+
+#ifdef ASID_SWITCH_BENCH
+     xil_printf("# ------------- APU0: ASID switch benchmark ------------- \n\r");
+     asid_switch_bench(&FpdCDma1, cb_index_1);
+ 
+     // back to the CB1 block mapping
+     set_CBnTTBR0_32_lpae_stage1(cb_index_1, 0x0, (UINTPTR)cb1_tt_l1_base_64, t0sz);
+     invalidate_CBn_by_TLBIALL(cb_index_1);
+     sync_CBn_TLB(cb_index_1);
+     smmu_pt_attach(cb_index_1, NULL);
+#endif
+
+#ifdef DOMAIN_BENCH
+     xil_printf("# ------------- APU0: domain benchmark ------------- \n\r");
+     // CDMA1 moves from SMR1 to the SMRs of the domains for the benchmark
+     set_SMRn(smr_index_1, false, 0x0, 0x0, 0x0);
+     domain_bench(&FpdCDma1);
+     set_SMRn(smr_index_1, valid, stream_id_mask, HPC0_TBU, CDMA1_MID);
+#endif
+
+#ifdef OVERHEAD_BENCH
+     xil_printf("# ------------- APU0: translation overhead benchmark ------------- \n\r");
+     overhead_bench(&FpdCDma1, cb_index_1, smr_index_1, cb1_tt_l1_base_64);
+#endif
+
+#ifdef TLB_STRIDE_BENCH
+     xil_printf("# ------------- APU0: TLB stride benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool with the window in 4KB pages
+     with_cb1_pool_tree(tlb_stride_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+#endif
+
+#ifdef CONTENTION_BENCH
+     xil_printf("# ------------- APU0: multi-master contention benchmark ------------- \n\r");
+     // CDMA0 and CDMA1 move from SMR0-1 to the SMRs of the benchmark
+     set_SMRn(smr_index_0, false, 0x0, 0x0, 0x0);
+     set_SMRn(smr_index_1, false, 0x0, 0x0, 0x0);
+     contention_bench();
+     set_SMRn(smr_index_0, valid, stream_id_mask, HPC0_TBU, CDMA0_MID);
+     set_SMRn(smr_index_1, valid, stream_id_mask, HPC0_TBU, CDMA1_MID);
+#endif
+
+#ifdef GDMA_BENCH
+     xil_printf("# ------------- APU0: GDMA benchmark ------------- \n\r");
+     gdma_bench();
+#endif
+
+#ifdef IOVA_WINDOW_BENCH
+     xil_printf("# ------------- APU0: IOVA window benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool: flat DDR low and the IOVA window
+     with_cb1_pool_tree(iova_window_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+#endif
+
+#ifdef MEMTYPE_BENCH
+     xil_printf("# ------------- APU0: memory type benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool, a 2MB block per memory type
+     with_cb1_pool_tree(memtype_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+#endif
+
+#ifdef WALK_PLACEMENT_BENCH
+     xil_printf("# ------------- APU0: table placement benchmark ------------- \n\r");
+     walk_placement_bench(&FpdCDma1, cb_index_1);
+ 
+     // back to the CB1 block mapping and walk attributes
+     set_CBn_TCR_lpae_32_stage1(cb_index_1, t0sz, irgn0, orgn0, sh0, t1sz, eae);
+     set_CBnTTBR0_32_lpae_stage1(cb_index_1, 0x0, (UINTPTR)cb1_tt_l1_base_64, t0sz);
+     invalidate_CBn_by_TLBIALL(cb_index_1);
+     sync_CBn_TLB(cb_index_1);
+#endif
+
+#ifdef FAULT_INJECT_BENCH
+     xil_printf("# ------------- APU0: fault injection benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool
+     with_cb1_pool_tree(fault_inject_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+     set_SMRn(smr_index_1, valid, stream_id_mask, HPC0_TBU, CDMA1_MID);
+#endif
+
+#ifdef FAULT_STORM_BENCH
+     xil_printf("# ------------- APU0: fault storm benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool
+     with_cb1_pool_tree(fault_storm_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+#endif
+
+#ifdef DMA_HANG_BENCH
+     xil_printf("# ------------- APU0: DMA hang detection benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool; its fault interrupt is off so that the faults are left
+     // to the bounded wait
+     set_SMMU_CBn_SCTLR(cb_index_1, m_bit, cfre, 0x0);
+ 
+     // per-context stalling must be allowed globally
+     set_SMMU_sCR0(clientpd, gfre, gfie, 0x0, usfcfg);
+ 
+     with_cb1_pool_tree(dma_hang_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+ 
+     set_SMMU_sCR0(clientpd, gfre, gfie, stalld, usfcfg);
+     set_SMMU_CBn_SCTLR(cb_index_1, m_bit, cfre, cfie);
+#endif
+
+#ifdef DMAQ_BENCH
+     xil_printf("# ------------- APU0: DMA pipeline benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool with the IOVA window of the jobs
+     with_cb1_pool_tree(dmaq_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+#endif
+
+#ifdef DMAPOOL_BENCH
+     xil_printf("# ------------- APU0: DMA buffer pool benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool with the DMA pool and an IOVA window
+     with_cb1_pool_tree(dmapool_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+#endif
+
+#ifdef ZCOPY_BENCH
+     xil_printf("# ------------- APU0: zero-copy benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool: flat DMA buffers and the IOVA window of the application buffers
+     with_cb1_pool_tree(zcopy_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+#endif
+
+#ifdef PT_SHARE_BENCH
+     xil_printf("# ------------- APU0: shared translation tables benchmark ------------- \n\r");
+     // CB1 temporarily uses a tree of the table pool, linked to the shared tables of the region
+     with_cb1_pool_tree(pt_share_bench, &FpdCDma1, cb_index_1, cb1_tt_l1_base_64, t0sz);
+#endif
+
+#ifdef REMAP_TEST
+     xil_printf("# ------------- APU0: CDMA1 live remap test ------------- \n\r");
+     // migrate the CB1 1GB block from DDR high (output_address_1) to DDR low (output_address_0) while CB1 is live
+     u64 blackout_counts = smmu_remap(cb_index_1, cb1_tt_l1_base_64, entry_index, 0x0, entry_value_0);
+     xil_printf("# APU0: CB1 remapped, blackout of %llu counts\r\n", blackout_counts);
+     printf("# APU0: CB1 blackout of %fus\n\r", (float)blackout_counts*1000000/(float)COUNTS_PER_SECOND);
+
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         SrcBuf[i] = 0x55;
+         DstBuf[i] = 0x00;
+     }
+
+     ret = XAxiCdma_SimpleTransfer(&FpdCDma1, (UINTPTR)SrcBuf, (UINTPTR)DstBuf, DMA_BUF_SIZE, NULL, NULL);
+     if (ret != 0){
+         xil_printf("# APU0: the transfer for CDMA1 went wrong \r\n");
+     }
+     wait_transfer(&FpdCDma1, CDMA1_STREAM_ID);
+
+     // after the remap CDMA1 is flat: the data must be in the DDR low buffer
+     readback_status = true;
+     for (int i=0; i<DMA_BUF_SIZE; i++){
+         if (DstBuf[i] != 0x55){
+             readback_status = false;
+         }
+     }
+     xil_printf("# APU0: CDMA1 remap readback %s\r\n", readback_status ? "OK" : "FAILED");
+#endif
+
+#ifdef IOVA_LOOKUP_BENCH
+     xil_printf("# ------------- APU0: IOVA lookup benchmark ------------- \n\r");
+     // CB2 has no stream mapped to it: it gets a tree of 4KB pages from the table pool, so that every
+     // software walk and every ATS1PR miss goes through the three levels
+     u64* cb2_tt_l1_base_64 = smmu_pt_alloc_table();
+     smmu_pt_map_max_block(cb2_tt_l1_base_64, 0x0, 0x0, IOVA_BENCH_SIZE, SMMU_PT_ATTR_RW, SMMU_PT_BLOCK_4KB);
+     smmu_pt_attach(cb_index_2, cb2_tt_l1_base_64);
+     set_CBA2Rn_VA(cb_index_2, VA_32);
+     set_CBARn(cb_index_2, STAGE_1_BYPASS_2);
+     set_CBn_MAIR_stage1(cb_index_2, NORMAL_IO_NonCacheable);
+     set_CBn_TCR_lpae_32_stage1(cb_index_2, t0sz, irgn0, orgn0, sh0, t1sz, eae);
+     set_CBn_TCR2_stage1(cb_index_2, tbi0, pa_size);
+     set_CBnTTBR0_32_lpae_stage1(cb_index_2, 0x0, (UINTPTR)cb2_tt_l1_base_64, t0sz);
+     set_SMMU_CBn_SCTLR(cb_index_2, m_bit, cfre, cfie);
+ 
+     iova_lookup_bench(cb_index_2);
+#endif
+
      xil_printf("# APU0: calculating average access time to memory for CDMA0-1\n\r");
  
-     do_transfers(cdma_vector, N_CDMA, N_TRANSFERS); // always select the number of cdma to test!!!
+     do_transfers(cdma_vector, stream_vector, N_CDMA, N_TRANSFERS); // always select the number of cdma to test!!!
  
+#ifdef SMMU_IRQ_DISPATCH
+     print_irq_stats();
+#endif
+
      xil_printf("# APU0: end \r\n");
      // cleanup
      cleanup_platform();
@@ -0,0 +1,135 @@
+#include "smmu_asid.h"
+
+#define SMMU_ASID_GENERATION(asid) ((asid) & ~(u64)SMMU_ASID_MASK)
+
+static u64 smmu_asid_generation = SMMU_ASID_COUNT;
+static u32 smmu_asid_used[SMMU_ASID_COUNT / 32];  // allocated in the current generation
+static u32 smmu_asid_dirty[SMMU_ASID_COUNT / 32]; // can still have TLB entries
+static u32 smmu_asid_cursor = 1;
+static smmu_asid_ctx* smmu_asid_active[N_CBs];    // context loaded in each bank
+static smmu_asid_stats smmu_asid_counters;
+
+static int asid_test(const u32* map, u32 asid){
+	return (map[asid / 32] >> (asid % 32)) & 0x1;
+}
+
+static void asid_set(u32* map, u32 asid){
+	map[asid / 32] |= 1U << (asid % 32);
+}
+
+static void asid_clear(u32* map, u32 asid){
+	map[asid / 32] &= ~(1U << (asid % 32));
+}
+
+void smmu_asid_ctx_init(smmu_asid_ctx* ctx, u64* l1_table){
+	ctx->asid = 0;
+	ctx->l1_table = l1_table;
+}
+
+// The ASID of the context goes back to the allocator, its TLB entries are invalidated at the next reuse
+void smmu_asid_ctx_free(smmu_asid_ctx* ctx){
+	u32 asid = ctx->asid & SMMU_ASID_MASK;
+
+	if (ctx->asid != 0 && SMMU_ASID_GENERATION(ctx->asid) == smmu_asid_generation){
+		asid_clear(smmu_asid_used, asid);
+		asid_set(smmu_asid_dirty, asid);
+	}
+	for (int i=0; i<N_CBs; i++){
+		if (smmu_asid_active[i] == ctx){
+			smmu_asid_active[i] = NULL;
+		}
+	}
+	ctx->asid = 0;
+}
+
+static void smmu_asid_rollover(void){
+	smmu_asid_generation += SMMU_ASID_COUNT;
+
+	// any ASID handed out so far can have entries in the TLB
+	for (u32 i=0; i<SMMU_ASID_COUNT / 32; i++){
+		smmu_asid_dirty[i] |= smmu_asid_used[i];
+		smmu_asid_used[i] = 0x0;
+	}
+	asid_set(smmu_asid_used, 0);
+
+	// the loaded contexts keep their ASID, their entries stay valid
+	for (int i=0; i<N_CBs; i++){
+		smmu_asid_ctx* ctx = smmu_asid_active[i];
+
+		if (ctx != NULL){
+			ctx->asid = smmu_asid_generation | (ctx->asid & SMMU_ASID_MASK);
+			asid_set(smmu_asid_used, ctx->asid & SMMU_ASID_MASK);
+			asid_clear(smmu_asid_dirty, ctx->asid & SMMU_ASID_MASK);
+		}
+	}
+
+	smmu_asid_counters.rollovers++;
+}
+
+static u32 smmu_asid_find_free(void){
+	for (u32 i=0; i<SMMU_ASID_COUNT; i++){
+		u32 asid = (smmu_asid_cursor + i) & SMMU_ASID_MASK;
+
+		if (!asid_test(smmu_asid_used, asid)){
+			smmu_asid_cursor = asid + 1;
+			return asid;
+		}
+	}
+	return 0;
+}
+
+static void smmu_asid_alloc(u8 cb, smmu_asid_ctx* ctx){
+	u32 asid;
+
+	asid_set(smmu_asid_used, 0);
+	asid = smmu_asid_find_free();
+	if (asid == 0){
+		smmu_asid_rollover();
+		asid = smmu_asid_find_free();
+	}
+
+	// the previous owner of the ASID can still have entries in the TLB
+	if (asid_test(smmu_asid_dirty, asid)){
+		invalidate_CBn_by_ASID(cb, asid);
+		sync_CBn_TLB(cb);
+		asid_clear(smmu_asid_dirty, asid);
+		smmu_asid_counters.asid_invalidations++;
+	}
+
+	asid_set(smmu_asid_used, asid);
+	ctx->asid = smmu_asid_generation | asid;
+	smmu_asid_counters.allocations++;
+}
+
+/* Loads the context in the context bank: only TTBR0 is written, no TLB invalidation.
+ * The bank must be idle (no transaction in flight) during the switch.
+ */
+int smmu_asid_switch(u8 cb, smmu_asid_ctx* ctx){
+	u64 regVal;
+
+	if (ctx->l1_table == NULL){
+		return XST_FAILURE;
+	}
+
+	if (ctx->asid == 0 || SMMU_ASID_GENERATION(ctx->asid) != smmu_asid_generation){
+		smmu_asid_alloc(cb, ctx);
+	}
+
+#if SMMU_ASID_BITS > 8
+	regVal = FIELD_PREP(TTBR_ADDR, (UINTPTR)ctx->l1_table) | FIELD_PREP(TTBR64_ASID, ctx->asid & SMMU_ASID_MASK);
+#else
+	regVal = FIELD_PREP(TTBR_ADDR, (UINTPTR)ctx->l1_table) | FIELD_PREP(TTBR_ASID, ctx->asid & SMMU_ASID_MASK);
+#endif
+	Xil_Out64(SMMU_CBn_TTBR0_base + cb*CBn_offset, regVal);
+
+	smmu_asid_active[cb] = ctx;
+	smmu_pt_switch(cb, ctx->l1_table);
+	smmu_asid_counters.switches++;
+
+	return XST_SUCCESS;
+}
+
+void smmu_asid_get_stats(smmu_asid_stats* stats){
+	*stats = smmu_asid_counters;
+	stats->generation = smmu_asid_generation / SMMU_ASID_COUNT;
+}
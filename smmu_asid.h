@@ -0,0 +1,41 @@
+#ifndef __SMMU_ASID_H_
+#define __SMMU_ASID_H_
+
+#include "smmu_pgtable.h"
+
+/* ASID management for the stage 1 context banks.
+ * A context (smmu_asid_ctx) is a table tree mapped with non-global descriptors (SMMU_PT_ATTR_NG): its TLB
+ * entries are tagged with its ASID, so a context bank is moved from a context to another by rewriting
+ * TTBR0 (table address and ASID) only, without TLBIALL; the CPU-side translations of the contexts are kept
+ * as well (smmu_pt_switch). The tree of a context is changed with smmu_map/smmu_unmap while it is loaded.
+ * The stage 1 banks share VMID 0 (CBARn.VMID), so they share one ASID space: an ASID is owned by a single
+ * context at a time, whatever the bank it is loaded in.
+ * ASIDs are allocated in generations. When the space is exhausted a new generation starts: the contexts
+ * loaded in the banks keep their ASID, the others get a new one at their next switch. The TLB entries of
+ * an ASID are invalidated (TLBIASID) only when the ASID is handed out again, not at the rollover.
+ * ASID 0 is not allocated, it stays with the global mappings.
+ */
+
+#define SMMU_ASID_BITS            8 // aarch32 lpae TTBR0.ASID (16 with aarch64 banks and TCR2.AS = 1)
+#define SMMU_ASID_COUNT           (1U << SMMU_ASID_BITS)
+#define SMMU_ASID_MASK            (SMMU_ASID_COUNT - 1)
+
+typedef struct {
+	u64  asid;     // generation | ASID, 0 before the first switch
+	u64* l1_table;
+} smmu_asid_ctx;
+
+typedef struct {
+	u32 switches;
+	u32 allocations;
+	u32 rollovers;
+	u32 asid_invalidations; // TLBIASID issued on the reuse of an ASID
+	u64 generation;
+} smmu_asid_stats;
+
+void smmu_asid_ctx_init(smmu_asid_ctx* ctx, u64* l1_table);
+void smmu_asid_ctx_free(smmu_asid_ctx* ctx);
+int smmu_asid_switch(u8 cb, smmu_asid_ctx* ctx);
+void smmu_asid_get_stats(smmu_asid_stats* stats);
+
+#endif
@@ -0,0 +1,216 @@
+#include "smmu_dma.h"
+
+static smmu_dma_stats smmu_dma_counters;
+
+static const char* const smmu_dma_cause_names[SMMU_DMA_CAUSES] = {
+	"done", "context fault", "stalled fault", "unidentified stream", "engine error", "hang"
+};
+
+static XTime smmu_dma_counts(u32 us){
+	return (XTime)us*COUNTS_PER_SECOND/1000000;
+}
+
+// SMR matching the stream in the SMMU registers, -1 if none
+int smmu_dma_stream_smr(u16 stream_id){
+	for (int i=0; i<N_SMRs; i++){
+		u32 smr = Xil_In32(SMMU_SMR_base + i*4);
+
+		if (FIELD_GET(SMR_VALID, smr) && ((FIELD_GET(SMR_ID, smr) ^ stream_id) & ~FIELD_GET(SMR_MASK, smr) &
+				FIELD_MASK(SMR_ID)) == 0){
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Context bank translating the stream, from its SMR and S2CR: -1 if the stream is not matched or not translated
+int smmu_dma_stream_cb(u16 stream_id){
+	int smr = smmu_dma_stream_smr(stream_id);
+	u32 s2cr;
+
+	if (smr < 0){
+		return -1;
+	}
+	s2cr = Xil_In32(SMMU_S2CR_base + smr*4);
+	return FIELD_GET(S2CR_TYPE, s2cr) == TRANSLATION_CB ? (int)FIELD_GET(S2CR_CBNDX, s2cr) : -1;
+}
+
+// Finds the SMMU fault of the stream and clears it: a stalled transaction is terminated so that the engine gets its abort
+static void smmu_dma_correlate(u16 stream_id, smmu_dma_result* result){
+	u32 sgfsr;
+
+	result->smr = smmu_dma_stream_smr(stream_id);
+	if (result->smr >= 0){
+		u32 s2cr = Xil_In32(SMMU_S2CR_base + result->smr*4);
+
+		if (FIELD_GET(S2CR_TYPE, s2cr) == TRANSLATION_CB){
+			u8 cb = FIELD_GET(S2CR_CBNDX, s2cr);
+			u32 fsr = Xil_In32(SMMU_CBn_FSR_base + cb*CBn_offset);
+
+			result->cb = cb;
+			// the bank can be shared: its fault must come from the stream
+			if ((fsr & (FIELD_MASK(FSR_FAULTS) | FIELD_MASK(FSR_SS))) != 0 &&
+					FIELD_GET(CBFRSYNRA_SID, Xil_In32(SMMU_CBFRSYNRAn_base + cb*4)) == stream_id){
+				result->fsr = fsr;
+				result->fsynr0 = Xil_In32(SMMU_CBn_FSYNR0_base + cb*CBn_offset);
+				result->far = Xil_In64(SMMU_CB0_FAR_low_base + cb*CBn_offset);
+				result->cause = FIELD_GET(FSR_SS, fsr) ? SMMU_DMA_STALLED : SMMU_DMA_CONTEXT_FAULT;
+
+				Xil_Out32(SMMU_CBn_FSR_base + cb*CBn_offset, fsr & ~FIELD_MASK(FSR_SS));
+				if (FIELD_GET(FSR_SS, fsr)){
+					resume_CBn(cb, 0x1);
+				}
+				return;
+			}
+		}
+	}
+
+	sgfsr = Xil_In32(SMMU_SGFSR);
+	if (FIELD_GET(SGFSR_USF, sgfsr) && FIELD_GET(SGFSYNR1_SID, Xil_In32(SMMU_SGFSYNR1)) == stream_id){
+		result->sgfsr = sgfsr;
+		result->cause = SMMU_DMA_UNIDENTIFIED;
+		Xil_Out32(SMMU_SGFSR, sgfsr);
+		return;
+	}
+
+	result->cause = result->engine_error ? SMMU_DMA_ENGINE_ERROR : SMMU_DMA_HANG;
+}
+
+static void smmu_dma_init_result(smmu_dma_result* result, u16 stream_id){
+	*result = (smmu_dma_result){0};
+	result->cb = N_CBs;
+	result->smr = -1;
+	result->stream_id = stream_id;
+	smmu_dma_counters.waits++;
+}
+
+static int smmu_dma_complete(smmu_dma_result* result){
+	smmu_dma_counters.causes[result->cause]++;
+	if (result->cause == SMMU_DMA_DONE){
+		if (result->wait_counts > smmu_dma_counters.max_wait_counts){
+			smmu_dma_counters.max_wait_counts = result->wait_counts;
+		}
+		return XST_SUCCESS;
+	}
+	smmu_dma_counters.resets++;
+	smmu_dma_counters.reset_failures += result->reset_failed;
+	return XST_FAILURE;
+}
+
+/* Resets the CDMA and waits at most SMMU_DMA_RESET_TIMEOUT_US for the reset: it completes once the outstanding
+ * transactions have been answered. Returns XST_FAILURE if the CDMA is still resetting at the deadline.
+ */
+int smmu_dma_reset_cdma(XAxiCdma* cdma){
+	XTime startTime, now;
+	int done;
+
+	XAxiCdma_Reset(cdma);
+	XTime_GetTime(&startTime);
+	do {
+		done = XAxiCdma_ResetIsDone(cdma);
+		XTime_GetTime(&now);
+	} while (!done && now - startTime < smmu_dma_counts(SMMU_DMA_RESET_TIMEOUT_US));
+
+	return done ? XST_SUCCESS : XST_FAILURE;
+}
+
+/* Waits for the transfer of the CDMA issuing stream_id for at most timeout_us.
+ * Returns XST_SUCCESS if it completed without error, otherwise the CDMA has been reset and result holds the cause.
+ */
+int smmu_dma_wait_cdma(XAxiCdma* cdma, u16 stream_id, u32 timeout_us, smmu_dma_result* result){
+	XTime startTime, now;
+	int busy;
+
+	smmu_dma_init_result(result, stream_id);
+
+	XTime_GetTime(&startTime);
+	do {
+		busy = XAxiCdma_IsBusy(cdma);
+		XTime_GetTime(&now);
+	} while (busy && now - startTime < smmu_dma_counts(timeout_us));
+	result->wait_counts = now - startTime;
+
+	if (!busy){
+		result->engine_error = XAxiCdma_GetError(cdma);
+		if (result->engine_error == 0){
+			return smmu_dma_complete(result);
+		}
+	}
+
+	smmu_dma_correlate(stream_id, result);
+	result->reset_failed = smmu_dma_reset_cdma(cdma) != XST_SUCCESS;
+
+	return smmu_dma_complete(result);
+}
+
+// Same as smmu_dma_wait_cdma for a GDMA channel (smmu_gdma.c)
+int smmu_dma_wait_gdma(u8 ch, u32 timeout_us, smmu_dma_result* result){
+	XTime startTime, now;
+	int busy;
+
+	smmu_dma_init_result(result, smmu_gdma_stream_id(ch));
+	if (ch >= SMMU_GDMA_CHANNELS){
+		result->cause = SMMU_DMA_ENGINE_ERROR;
+		return smmu_dma_complete(result);
+	}
+
+	XTime_GetTime(&startTime);
+	do {
+		busy = smmu_gdma_busy(ch);
+		XTime_GetTime(&now);
+	} while (busy && now - startTime < smmu_dma_counts(timeout_us));
+	result->wait_counts = now - startTime;
+
+	if (!busy){
+		result->engine_error = smmu_gdma_errors(ch);
+		if (result->engine_error == 0){
+			return smmu_dma_complete(result);
+		}
+	}
+
+	smmu_dma_correlate(result->stream_id, result);
+	result->reset_failed = smmu_gdma_reset(ch) != XST_SUCCESS;
+
+	return smmu_dma_complete(result);
+}
+
+const char* smmu_dma_cause_name(smmu_dma_cause cause){
+	return cause < SMMU_DMA_CAUSES ? smmu_dma_cause_names[cause] : "unknown";
+}
+
+void smmu_dma_print(const smmu_dma_result* result){
+	xil_printf("DMA stream 0x%04X: %s after %llu counts", result->stream_id, smmu_dma_cause_name(result->cause),
+			result->wait_counts);
+	if (result->smr >= 0){
+		xil_printf(", SMR %d", result->smr);
+	}
+	if (result->cb != N_CBs){
+		xil_printf(", CB%d", result->cb);
+	}
+	xil_printf("\r\n");
+
+	switch (result->cause){
+	case SMMU_DMA_CONTEXT_FAULT:
+	case SMMU_DMA_STALLED:
+		xil_printf("  FSR 0x%08X (%s%s%s), FSYNR0 0x%08X (%s), FAR 0x%016llX\r\n", result->fsr,
+				FIELD_GET(FSR_TF, result->fsr) ? "translation " : "", FIELD_GET(FSR_PF, result->fsr) ? "permission " : "",
+				FIELD_GET(FSR_MULTI, result->fsr) ? "multiple " : "", result->fsynr0,
+				FIELD_GET(FSYNR0_WNR, result->fsynr0) ? "write" : "read", result->far);
+		break;
+	case SMMU_DMA_UNIDENTIFIED:
+		xil_printf("  sGFSR 0x%08X: no SMR matches the stream\r\n", result->sgfsr);
+		break;
+	default:
+		break;
+	}
+	if (result->engine_error != 0){
+		xil_printf("  engine error 0x%08X\r\n", result->engine_error);
+	}
+	if (result->reset_failed){
+		xil_printf("  the engine did not complete its reset\r\n");
+	}
+}
+
+void smmu_dma_get_stats(smmu_dma_stats* stats){
+	*stats = smmu_dma_counters;
+}
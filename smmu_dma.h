@@ -0,0 +1,62 @@
+#ifndef __SMMU_DMA_H_
+#define __SMMU_DMA_H_
+
+#include "xaxicdma.h"
+#include "smmu_gdma.h"
+
+/* Bounded-time completion of the DMA transfers.
+ * smmu_dma_wait_cdma and smmu_dma_wait_gdma poll the engine until an XTime deadline instead of waiting for
+ * it forever. A transfer that ends with an engine error, or is still running at the deadline, is correlated
+ * with the SMMU state of the stream of the engine: the SMRs give the context bank of the stream, a fault of
+ * the bank raised by that stream (CBFRSYNRA) is decoded, cleared and, if stalled, terminated; an unidentified
+ * stream fault of that stream is taken from sGFSR. The engine is then reset, with a bounded wait as well,
+ * and the decoded cause is returned in smmu_dma_result.
+ * With the fault interrupt enabled the handler can clear the fault before the deadline: the cause is then
+ * the engine error alone.
+ */
+
+#define SMMU_DMA_RESET_TIMEOUT_US 1000
+
+typedef enum {
+	SMMU_DMA_DONE = 0,
+	SMMU_DMA_CONTEXT_FAULT = 1, // fault of the bank of the stream, aborted (FSR fault bits)
+	SMMU_DMA_STALLED = 2,       // fault of the bank of the stream, stalled (FSR.SS): terminated here
+	SMMU_DMA_UNIDENTIFIED = 3,  // the stream matches no SMR (sGFSR.USF)
+	SMMU_DMA_ENGINE_ERROR = 4,  // the engine reports an error, no SMMU fault of its stream
+	SMMU_DMA_HANG = 5,          // still busy at the deadline, no SMMU fault of its stream
+	SMMU_DMA_CAUSES
+} smmu_dma_cause;
+
+typedef struct {
+	u8    cause;     // smmu_dma_cause
+	u8    cb;        // bank of the stream, N_CBs if the stream is not translated
+	u8    reset_failed;
+	u8    reserved;
+	u16   stream_id;
+	s16   smr;       // SMR matching the stream, -1 if none
+	u32   engine_error;
+	u32   fsr;
+	u32   fsynr0;
+	u32   sgfsr;
+	u64   far;
+	XTime wait_counts; // start of the wait to completion or deadline
+} smmu_dma_result;
+
+typedef struct {
+	u32 waits;
+	u32 causes[SMMU_DMA_CAUSES];
+	u32 resets;
+	u32 reset_failures;
+	XTime max_wait_counts; // of the completed transfers
+} smmu_dma_stats;
+
+int smmu_dma_reset_cdma(XAxiCdma* cdma);
+int smmu_dma_wait_cdma(XAxiCdma* cdma, u16 stream_id, u32 timeout_us, smmu_dma_result* result);
+int smmu_dma_wait_gdma(u8 ch, u32 timeout_us, smmu_dma_result* result);
+int smmu_dma_stream_smr(u16 stream_id);
+int smmu_dma_stream_cb(u16 stream_id);
+const char* smmu_dma_cause_name(smmu_dma_cause cause);
+void smmu_dma_print(const smmu_dma_result* result);
+void smmu_dma_get_stats(smmu_dma_stats* stats);
+
+#endif
@@ -0,0 +1,195 @@
+#include "smmu_dmapool.h"
+
+#define SMMU_DMAPOOL_NONE         0xFFFF
+#define SMMU_DMAPOOL_SHIFT(cls)   (SMMU_DMAPOOL_MIN_SHIFT + (cls))
+
+typedef struct {
+	u32 offset;      // of the first buffer in the region
+	u16 first;       // index of the first buffer
+	u16 free_head;   // SMMU_DMAPOOL_NONE if the class is empty
+	smmu_dmapool_class_stats stats;
+} smmu_dmapool_class;
+
+static smmu_dmapool_class smmu_dmapool_classes[SMMU_DMAPOOL_CLASSES];
+static u16 smmu_dmapool_next[SMMU_DMAPOOL_MAX_BUFFERS]; // free lists
+static u8 smmu_dmapool_busy[SMMU_DMAPOOL_MAX_BUFFERS / 8];
+static UINTPTR smmu_dmapool_base;
+static u32 smmu_dmapool_iova_base;
+static u8 smmu_dmapool_cb;
+static u8 smmu_dmapool_ready;
+static smmu_dmapool_stats smmu_dmapool_counters;
+
+// smallest class holding size bytes
+static int smmu_dmapool_class_of(u32 size){
+	int shift = size <= (1U << SMMU_DMAPOOL_MIN_SHIFT) ? SMMU_DMAPOOL_MIN_SHIFT : 32 - __builtin_clz(size - 1);
+
+	return shift - SMMU_DMAPOOL_MIN_SHIFT;
+}
+
+// Bytes of the region holding the buffers of counts, rounded up to a page
+u32 smmu_dmapool_region_size(const u16 counts[SMMU_DMAPOOL_CLASSES]){
+	u32 size = 0;
+
+	for (int cls=0; cls<SMMU_DMAPOOL_CLASSES; cls++){
+		size += (u32)counts[cls] << SMMU_DMAPOOL_SHIFT(cls);
+	}
+	return (size + GRANULARITY - 1) & ~(GRANULARITY - 1);
+}
+
+/* Carves [base, base + smmu_dmapool_region_size(counts)) into counts[cls] buffers of 64B << cls and maps it
+ * at iova in the bank cb, which must have a tree attached. base and iova must be 2MB aligned.
+ */
+int smmu_dmapool_init(u8 cb, UINTPTR base, u32 iova, const u16 counts[SMMU_DMAPOOL_CLASSES], enum smmu_mem_type type){
+	u32 size = smmu_dmapool_region_size(counts);
+	u32 offset = 0;
+	u32 n = 0;
+
+	for (int cls=0; cls<SMMU_DMAPOOL_CLASSES; cls++){
+		n += counts[cls];
+	}
+	if (smmu_dmapool_ready || ((base | iova) & (SMMU_PT_BLOCK_2MB - 1)) != 0 || size == 0 ||
+			n > SMMU_DMAPOOL_MAX_BUFFERS || smmu_pt_root(cb) == NULL){
+		xil_printf("Error, invalid DMA pool at 0x%08X (%d buffers) on CB%d\n\r", (u32)base, n, cb);
+		return XST_FAILURE;
+	}
+	if (smmu_map_mem(cb, iova, base, size, SMMU_PT_ATTR_RW, type) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+
+	// largest classes first: every buffer is aligned to its size
+	n = 0;
+	for (int cls=SMMU_DMAPOOL_CLASSES-1; cls>=0; cls--){
+		smmu_dmapool_class* class = &smmu_dmapool_classes[cls];
+
+		class->offset = offset;
+		class->first = n;
+		class->stats = (smmu_dmapool_class_stats){0};
+		class->stats.count = counts[cls];
+		class->free_head = counts[cls] > 0 ? n : SMMU_DMAPOOL_NONE;
+		for (u32 i=0; i<counts[cls]; i++){
+			smmu_dmapool_next[n + i] = i + 1 < counts[cls] ? n + i + 1 : SMMU_DMAPOOL_NONE;
+		}
+		offset += (u32)counts[cls] << SMMU_DMAPOOL_SHIFT(cls);
+		n += counts[cls];
+	}
+	for (u32 i=0; i<SMMU_DMAPOOL_MAX_BUFFERS / 8; i++){
+		smmu_dmapool_busy[i] = 0;
+	}
+
+	smmu_dmapool_base = base;
+	smmu_dmapool_iova_base = iova;
+	smmu_dmapool_cb = cb;
+	smmu_dmapool_counters = (smmu_dmapool_stats){0};
+	smmu_dmapool_counters.size = size;
+	smmu_dmapool_ready = 1;
+
+	return XST_SUCCESS;
+}
+
+// Unmaps the region, the buffers still allocated become invalid
+void smmu_dmapool_destroy(void){
+	if (!smmu_dmapool_ready){
+		return;
+	}
+	smmu_unmap(smmu_dmapool_cb, smmu_dmapool_iova_base, smmu_dmapool_counters.size);
+	smmu_dmapool_ready = 0;
+}
+
+// Returns a buffer of at least size bytes and its IOVA in *iova (if not NULL), NULL if there is none
+void* smmu_dmapool_alloc(u32 size, u32* iova){
+	int cls;
+
+	if (!smmu_dmapool_ready || size == 0 || size > (1U << SMMU_DMAPOOL_MAX_SHIFT)){
+		smmu_dmapool_counters.failures++;
+		return NULL;
+	}
+
+	for (cls=smmu_dmapool_class_of(size); cls<SMMU_DMAPOOL_CLASSES; cls++){
+		smmu_dmapool_class* class = &smmu_dmapool_classes[cls];
+		u16 index = class->free_head;
+		u32 offset;
+
+		if (index == SMMU_DMAPOOL_NONE){
+			continue;
+		}
+		class->free_head = smmu_dmapool_next[index];
+		smmu_dmapool_busy[index / 8] |= 1U << (index % 8);
+
+		class->stats.allocs++;
+		if (cls != smmu_dmapool_class_of(size)){
+			class->stats.fallbacks++;
+		}
+		if (++class->stats.in_use > class->stats.peak){
+			class->stats.peak = class->stats.in_use;
+		}
+		smmu_dmapool_counters.allocs++;
+
+		offset = class->offset + ((u32)(index - class->first) << SMMU_DMAPOOL_SHIFT(cls));
+		if (iova != NULL){
+			*iova = smmu_dmapool_iova_base + offset;
+		}
+		return (void*)(smmu_dmapool_base + offset);
+	}
+
+	smmu_dmapool_counters.failures++;
+	return NULL;
+}
+
+// class and buffer index of a pointer to the start of an allocated buffer, -1 otherwise
+static int smmu_dmapool_lookup(const void* buf, int* index){
+	u32 offset = (UINTPTR)buf - smmu_dmapool_base;
+
+	if (!smmu_dmapool_ready || (UINTPTR)buf < smmu_dmapool_base || offset >= smmu_dmapool_counters.size){
+		return -1;
+	}
+	for (int cls=SMMU_DMAPOOL_CLASSES-1; cls>=0; cls--){
+		smmu_dmapool_class* class = &smmu_dmapool_classes[cls];
+		u32 rel = offset - class->offset;
+
+		if (offset < class->offset || rel >= ((u32)class->stats.count << SMMU_DMAPOOL_SHIFT(cls))){
+			continue;
+		}
+		if ((rel & ((1U << SMMU_DMAPOOL_SHIFT(cls)) - 1)) != 0){
+			return -1;
+		}
+		*index = class->first + (rel >> SMMU_DMAPOOL_SHIFT(cls));
+		return (smmu_dmapool_busy[*index / 8] >> (*index % 8)) & 0x1 ? cls : -1;
+	}
+	return -1;
+}
+
+void smmu_dmapool_free(void* buf){
+	int index;
+	int cls = smmu_dmapool_lookup(buf, &index);
+	smmu_dmapool_class* class;
+
+	if (cls < 0){
+		smmu_dmapool_counters.bad_frees++;
+		return;
+	}
+	class = &smmu_dmapool_classes[cls];
+
+	smmu_dmapool_busy[index / 8] &= ~(1U << (index % 8));
+	smmu_dmapool_next[index] = class->free_head;
+	class->free_head = index;
+	class->stats.in_use--;
+	smmu_dmapool_counters.frees++;
+}
+
+// IOVA of an address in the region, 0 if it is outside
+u32 smmu_dmapool_iova(const void* buf){
+	u32 offset = (UINTPTR)buf - smmu_dmapool_base;
+
+	if (!smmu_dmapool_ready || (UINTPTR)buf < smmu_dmapool_base || offset >= smmu_dmapool_counters.size){
+		return 0;
+	}
+	return smmu_dmapool_iova_base + offset;
+}
+
+void smmu_dmapool_get_stats(smmu_dmapool_stats* stats){
+	*stats = smmu_dmapool_counters;
+}
+
+void smmu_dmapool_get_class_stats(u8 cls, smmu_dmapool_class_stats* stats){
+	*stats = cls < SMMU_DMAPOOL_CLASSES ? smmu_dmapool_classes[cls].stats : (smmu_dmapool_class_stats){0};
+}
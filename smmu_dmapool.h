@@ -0,0 +1,48 @@
+#ifndef __SMMU_DMAPOOL_H_
+#define __SMMU_DMAPOOL_H_
+
+#include "smmu_pgtable.h"
+
+/* Pool of DMA buffers mapped once in a context bank.
+ * smmu_dmapool_init carves a memory region into buffers of power of 2 size classes, 64B (a cache line) to
+ * 2MB, a count per class, and maps the whole region in the bank at an IOVA base with one smmu_map_mem: the
+ * largest classes come first, so every buffer is aligned to its size, the 2MB buffers are 2MB blocks and the
+ * classes of 4KB and more are page aligned. smmu_dmapool_alloc pops a buffer of the smallest class that
+ * fits from the free list of the class (the next classes if it is empty), smmu_dmapool_free pushes it back:
+ * both in constant time, without page table writes nor TLB invalidation.
+ * The buffers are mapped read/write with the memory type given at init; with a non-cacheable type the CPU
+ * side still needs the cache maintenance of its own mapping (Xil_DCacheFlushRange).
+ */
+
+#define SMMU_DMAPOOL_MIN_SHIFT    6  // 64B
+#define SMMU_DMAPOOL_MAX_SHIFT    21 // 2MB
+#define SMMU_DMAPOOL_CLASSES      (SMMU_DMAPOOL_MAX_SHIFT - SMMU_DMAPOOL_MIN_SHIFT + 1)
+#define SMMU_DMAPOOL_MAX_BUFFERS  4096
+
+typedef struct {
+	u16 count;
+	u16 in_use;
+	u16 peak;
+	u16 reserved;
+	u32 allocs;
+	u32 fallbacks;   // allocations of a smaller size served by this class
+} smmu_dmapool_class_stats;
+
+typedef struct {
+	u32 allocs;
+	u32 frees;
+	u32 failures;    // no free buffer large enough
+	u32 bad_frees;   // pointer not allocated from the pool
+	u32 size;        // bytes of the region
+} smmu_dmapool_stats;
+
+int smmu_dmapool_init(u8 cb, UINTPTR base, u32 iova, const u16 counts[SMMU_DMAPOOL_CLASSES], enum smmu_mem_type type);
+void smmu_dmapool_destroy(void);
+void* smmu_dmapool_alloc(u32 size, u32* iova);
+void smmu_dmapool_free(void* buf);
+u32 smmu_dmapool_iova(const void* buf);
+u32 smmu_dmapool_region_size(const u16 counts[SMMU_DMAPOOL_CLASSES]);
+void smmu_dmapool_get_stats(smmu_dmapool_stats* stats);
+void smmu_dmapool_get_class_stats(u8 cls, smmu_dmapool_class_stats* stats);
+
+#endif
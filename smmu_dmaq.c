@@ -0,0 +1,252 @@
+#include "smmu_dmaq.h"
+
+#ifdef SMMU_DMAQ_FREERTOS
+#define SMMU_DMAQ_LOCK()          taskENTER_CRITICAL()
+#define SMMU_DMAQ_UNLOCK()        taskEXIT_CRITICAL()
+#else
+#define SMMU_DMAQ_LOCK()
+#define SMMU_DMAQ_UNLOCK()
+#endif
+
+#define SMMU_DMAQ_SLOT(i)         ((i) & (SMMU_DMAQ_DEPTH - 1))
+
+int smmu_dmaq_init(smmu_dmaq* q, XAxiCdma* cdma, u16 stream_id, u8 cb, u32 timeout_us){
+	*q = (smmu_dmaq){0};
+	q->cdma = cdma;
+	q->stream_id = stream_id;
+	q->cb = cb;
+	q->timeout_us = timeout_us;
+#ifdef SMMU_DMAQ_FREERTOS
+	q->completions = xQueueCreate(SMMU_DMAQ_DEPTH, sizeof(smmu_dmaq_job*));
+	if (q->completions == NULL){
+		return XST_FAILURE;
+	}
+#endif
+	q->ready = 1;
+
+	return XST_SUCCESS;
+}
+
+// Queues the job, XST_FAILURE if the pipeline is full. The job must stay allocated until it completes.
+int smmu_dmaq_submit(smmu_dmaq* q, smmu_dmaq_job* job){
+	if (!q->ready || job->size == 0){
+		return XST_FAILURE;
+	}
+	job->state = SMMU_DMAQ_QUEUED;
+	job->cause = SMMU_DMA_DONE;
+	XTime_GetTime(&job->submit_time);
+
+	SMMU_DMAQ_LOCK();
+	if (q->head - q->tail >= SMMU_DMAQ_DEPTH){
+		SMMU_DMAQ_UNLOCK();
+		return XST_FAILURE;
+	}
+	q->jobs[SMMU_DMAQ_SLOT(q->head)] = job;
+	dsb();
+	q->head++;
+	q->stats.submitted++;
+	SMMU_DMAQ_UNLOCK();
+
+#ifdef SMMU_DMAQ_FREERTOS
+	if (q->task != NULL){
+		xTaskNotifyGive(q->task);
+	}
+#endif
+	return XST_SUCCESS;
+}
+
+static void smmu_dmaq_flush(smmu_dmaq* q){
+	if (q->unflushed > 0){
+		smmu_iova_window_flush(q->cb);
+		q->unflushed = 0;
+		q->stats.tlbi_batches++;
+	}
+}
+
+static int smmu_dmaq_map_job(smmu_dmaq* q, smmu_dmaq_job* job){
+	if (smmu_iova_window_map(q->cb, job->src, job->size, SMMU_PT_ATTR_RO, &job->src_iova) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+	if (smmu_iova_window_map(q->cb, job->dst, job->size, SMMU_PT_ATTR_RW, &job->dst_iova) != XST_SUCCESS){
+		smmu_iova_window_unmap(q->cb, job->src_iova, job->size);
+		return XST_FAILURE;
+	}
+	return XST_SUCCESS;
+}
+
+// Maps the queued jobs until n jobs are mapped and not started
+static void smmu_dmaq_map_ahead(smmu_dmaq* q, u32 n){
+	XTime startTime, endTime;
+
+	while (q->mapped != q->head && q->mapped - q->started < n){
+		smmu_dmaq_job* job = q->jobs[SMMU_DMAQ_SLOT(q->mapped)];
+		int status;
+
+		XTime_GetTime(&startTime);
+		status = smmu_dmaq_map_job(q, job);
+		// the window can be full of the IOVAs of retired jobs: they are released by the flush
+		if (status != XST_SUCCESS && q->unflushed > 0){
+			smmu_dmaq_flush(q);
+			status = smmu_dmaq_map_job(q, job);
+		}
+		XTime_GetTime(&endTime);
+		q->stats.map_counts += endTime - startTime;
+
+		if (status == XST_SUCCESS){
+			job->state = SMMU_DMAQ_MAPPED;
+			if (q->started != q->tail){
+				q->stats.prepared_ahead++;
+			}
+		}
+		else {
+			job->state = SMMU_DMAQ_FAILED;
+			job->cause = SMMU_DMA_CAUSES;
+			q->stats.map_failures++;
+		}
+		q->mapped++;
+	}
+}
+
+// Unmaps the job, TLB maintenance deferred, and signals it
+static void smmu_dmaq_retire(smmu_dmaq* q, smmu_dmaq_job* job, smmu_dma_cause cause){
+	if (job->state != SMMU_DMAQ_FAILED){
+		smmu_iova_window_unmap_deferred(q->cb, job->src_iova, job->size);
+		smmu_iova_window_unmap_deferred(q->cb, job->dst_iova, job->size);
+		q->unflushed++;
+		job->cause = cause;
+	}
+	XTime_GetTime(&job->done_time);
+	q->tail++;
+
+	if (job->cause == SMMU_DMA_DONE){
+		q->stats.completed++;
+	}
+	else {
+		q->stats.failed++;
+	}
+	if (q->unflushed >= SMMU_DMAQ_TLBI_BATCH){
+		smmu_dmaq_flush(q);
+	}
+
+	dsb();
+	job->state = job->cause == SMMU_DMA_DONE ? SMMU_DMAQ_DONE : SMMU_DMAQ_FAILED;
+	if (job->done != NULL){
+		job->done(job, job->arg);
+	}
+#ifdef SMMU_DMAQ_FREERTOS
+	xQueueSend(q->completions, &job, 0);
+#else
+	// the oldest completion not waited for is dropped
+	if (q->done_head - q->done_tail >= SMMU_DMAQ_DEPTH){
+		q->done_tail++;
+	}
+	q->done_jobs[SMMU_DMAQ_SLOT(q->done_head)] = job;
+	q->done_head++;
+#endif
+}
+
+/* Advances the pipeline without blocking: retires the running job if it has completed or is past its
+ * deadline, starts the next one and maps the following ones. Returns the number of jobs in the pipeline.
+ */
+int smmu_dmaq_process(smmu_dmaq* q){
+	smmu_dma_result result;
+	XTime now;
+
+	if (!q->ready){
+		return 0;
+	}
+
+	if (q->started != q->tail){
+		smmu_dmaq_job* job = q->jobs[SMMU_DMAQ_SLOT(q->tail)];
+
+		XTime_GetTime(&now);
+		if (XAxiCdma_IsBusy(q->cdma) && now - q->start_time < (XTime)q->timeout_us*COUNTS_PER_SECOND/1000000){
+			smmu_dmaq_map_ahead(q, SMMU_DMAQ_AHEAD);
+			return q->head - q->tail;
+		}
+		// completed or past the deadline: a zero wait decodes the failure and resets the CDMA
+		smmu_dma_wait_cdma(q->cdma, q->stream_id, 0, &result);
+		q->stats.busy_counts += now - q->start_time;
+		smmu_dmaq_retire(q, job, result.cause);
+	}
+
+	// the CDMA is free: start the next job, the jobs that could not be mapped are retired on the way
+	smmu_dmaq_map_ahead(q, 1);
+	while (q->started != q->mapped){
+		smmu_dmaq_job* job = q->jobs[SMMU_DMAQ_SLOT(q->started)];
+
+		q->started++;
+		if (job->state == SMMU_DMAQ_FAILED){
+			smmu_dmaq_retire(q, job, SMMU_DMA_CAUSES);
+			smmu_dmaq_map_ahead(q, 1);
+			continue;
+		}
+		XTime_GetTime(&q->start_time);
+		if (XAxiCdma_SimpleTransfer(q->cdma, job->src_iova, job->dst_iova, job->size, NULL, NULL) != XST_SUCCESS){
+			smmu_dmaq_retire(q, job, SMMU_DMA_ENGINE_ERROR);
+			smmu_dmaq_map_ahead(q, 1);
+			continue;
+		}
+		job->state = SMMU_DMAQ_RUNNING;
+		break;
+	}
+	smmu_dmaq_map_ahead(q, SMMU_DMAQ_AHEAD);
+
+	// idle: the TLB of the bank is invalidated for the jobs left
+	if (q->tail == q->head){
+		smmu_dmaq_flush(q);
+	}
+	return q->head - q->tail;
+}
+
+/* Returns the next completed job in *job, in completion order, XST_FAILURE if none completes within
+ * timeout_us. Without FreeRTOS the pipeline is run by the wait.
+ */
+int smmu_dmaq_wait(smmu_dmaq* q, smmu_dmaq_job** job, u32 timeout_us){
+#ifdef SMMU_DMAQ_FREERTOS
+	TickType_t ticks = pdMS_TO_TICKS((timeout_us + 999) / 1000);
+
+	return xQueueReceive(q->completions, job, ticks) == pdTRUE ? XST_SUCCESS : XST_FAILURE;
+#else
+	XTime startTime, now;
+
+	XTime_GetTime(&startTime);
+	do {
+		if (q->done_tail != q->done_head){
+			*job = q->done_jobs[SMMU_DMAQ_SLOT(q->done_tail)];
+			q->done_tail++;
+			return XST_SUCCESS;
+		}
+		smmu_dmaq_process(q);
+		XTime_GetTime(&now);
+	} while (now - startTime < (XTime)timeout_us*COUNTS_PER_SECOND/1000000);
+
+	return XST_FAILURE;
+#endif
+}
+
+// 1 if no job is queued or running
+int smmu_dmaq_idle(smmu_dmaq* q){
+	return q->tail == q->head;
+}
+
+void smmu_dmaq_get_stats(smmu_dmaq* q, smmu_dmaq_stats* stats){
+	*stats = q->stats;
+}
+
+#ifdef SMMU_DMAQ_FREERTOS
+// Pipeline task: runs smmu_dmaq_process, sleeps while the pipeline is empty until a job is submitted
+void smmu_dmaq_task(void* arg){
+	smmu_dmaq* q = arg;
+
+	q->task = xTaskGetCurrentTaskHandle();
+	for (;;){
+		if (smmu_dmaq_process(q) == 0){
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
+		else {
+			taskYIELD();
+		}
+	}
+}
+#endif
@@ -0,0 +1,103 @@
+#ifndef __SMMU_DMAQ_H_
+#define __SMMU_DMAQ_H_
+
+#include "smmu_dma.h"
+#include "smmu_iova.h"
+#ifdef SMMU_DMAQ_FREERTOS
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+#endif
+
+/* Asynchronous DMA jobs on a CDMA behind the SMMU.
+ * A job is a copy between two physical ranges: the pipeline maps the source read-only and the destination
+ * read/write in the IOVA window of the bank of the CDMA (smmu_iova.h), runs the transfer and unmaps them.
+ * smmu_dmaq_submit queues a job and returns; smmu_dmaq_process advances the pipeline without blocking:
+ *   - while job N transfers, the translations of the next SMMU_DMAQ_AHEAD jobs are prepared;
+ *   - when job N completes (smmu_dma.c decodes a failure, with the deadline of the pipeline), its ranges are
+ *     unmapped without TLB maintenance and it is signalled; the prepared job N+1 starts at once;
+ *   - the TLB of the bank is invalidated once per SMMU_DMAQ_TLBI_BATCH retired jobs, or when the pipeline
+ *     is idle, and only then are their IOVAs reused (smmu_iova_window_flush).
+ * Completion: the done callback of the job, called by smmu_dmaq_process, and smmu_dmaq_wait which returns
+ * the completed jobs in order. With SMMU_DMAQ_FREERTOS the completed jobs go to a FreeRTOS queue, so a task
+ * blocks in smmu_dmaq_wait while smmu_dmaq_task runs the pipeline; smmu_dmaq_submit can be called by any
+ * task. Bare metal, smmu_dmaq_wait runs the pipeline itself until a job completes. The last SMMU_DMAQ_DEPTH
+ * completions are kept for smmu_dmaq_wait, the job state and the callback report all of them.
+ * The window must hold the ranges of SMMU_DMAQ_DEPTH + SMMU_DMAQ_TLBI_BATCH jobs.
+ */
+
+#define SMMU_DMAQ_DEPTH           16 // jobs queued per pipeline (power of 2)
+#define SMMU_DMAQ_AHEAD           1  // jobs mapped ahead of the running one
+#define SMMU_DMAQ_TLBI_BATCH      8  // retired jobs per TLB invalidation
+
+typedef enum {
+	SMMU_DMAQ_QUEUED = 0,
+	SMMU_DMAQ_MAPPED = 1,
+	SMMU_DMAQ_RUNNING = 2,
+	SMMU_DMAQ_DONE = 3,
+	SMMU_DMAQ_FAILED = 4
+} smmu_dmaq_state;
+
+struct smmu_dmaq_job;
+typedef void (*smmu_dmaq_done)(struct smmu_dmaq_job* job, void* arg);
+
+typedef struct smmu_dmaq_job {
+	u64   src;       // physical ranges
+	u64   dst;
+	u32   size;
+	u32   src_iova;  // set by the pipeline
+	u32   dst_iova;
+	volatile u8 state; // smmu_dmaq_state
+	u8    cause;     // smmu_dma_cause of a failed job, SMMU_DMA_CAUSES if it could not be mapped
+	u16   reserved;
+	smmu_dmaq_done done; // optional
+	void* arg;
+	XTime submit_time;
+	XTime done_time;
+} smmu_dmaq_job;
+
+typedef struct {
+	u32 submitted;
+	u32 completed;
+	u32 failed;
+	u32 map_failures;
+	u32 prepared_ahead;  // jobs mapped while the previous one transferred
+	u32 tlbi_batches;
+	XTime busy_counts;   // time with a transfer running
+	XTime map_counts;    // time spent mapping, overlapped or not
+} smmu_dmaq_stats;
+
+typedef struct {
+	XAxiCdma* cdma;
+	u16   stream_id;
+	u8    cb;
+	u8    ready;
+	u32   timeout_us;
+	smmu_dmaq_job* jobs[SMMU_DMAQ_DEPTH];
+	volatile u32 head;   // next submitted
+	u32   mapped;        // next to map
+	u32   started;       // next to start
+	volatile u32 tail;   // next to retire
+	u32   unflushed;     // retired jobs waiting for the TLB invalidation
+	u32   done_head;     // completed jobs, for smmu_dmaq_wait without FreeRTOS
+	u32   done_tail;
+	smmu_dmaq_job* done_jobs[SMMU_DMAQ_DEPTH];
+	XTime start_time;
+#ifdef SMMU_DMAQ_FREERTOS
+	QueueHandle_t completions;
+	TaskHandle_t task;   // smmu_dmaq_task, woken by the submissions
+#endif
+	smmu_dmaq_stats stats;
+} smmu_dmaq;
+
+int smmu_dmaq_init(smmu_dmaq* q, XAxiCdma* cdma, u16 stream_id, u8 cb, u32 timeout_us);
+int smmu_dmaq_submit(smmu_dmaq* q, smmu_dmaq_job* job);
+int smmu_dmaq_process(smmu_dmaq* q);
+int smmu_dmaq_wait(smmu_dmaq* q, smmu_dmaq_job** job, u32 timeout_us);
+int smmu_dmaq_idle(smmu_dmaq* q);
+void smmu_dmaq_get_stats(smmu_dmaq* q, smmu_dmaq_stats* stats);
+#ifdef SMMU_DMAQ_FREERTOS
+void smmu_dmaq_task(void* q);
+#endif
+
+#endif
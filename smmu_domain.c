@@ -0,0 +1,266 @@
+#include "smmu_domain.h"
+
+// translation registers of the domains: aarch32 lpae, T0SZ = 0, 40-bit PA, walks with the attributes of the pool of the tree
+#define SMMU_DOMAIN_TCR           FIELD_PREP(TCR_EAE, 0x1)
+#define SMMU_DOMAIN_TCR2          FIELD_PREP(TCR2_PASIZE, 0x2)
+#define SMMU_DOMAIN_SCTLR         (FIELD_PREP(SCTLR_M, 0x1) | FIELD_PREP(SCTLR_CFRE, 0x1) | FIELD_PREP(SCTLR_CFIE, 0x1))
+
+typedef struct {
+	u8   used;
+	u8   cb;
+	u8   n_streams;
+	u8   reserved;
+	u16  stream_id[SMMU_DOMAIN_MAX_STREAMS];
+	u16  stream_mask[SMMU_DOMAIN_MAX_STREAMS];
+	u32  last_use;
+	u32  mair0;
+	u32  mair1;
+	u64* l1_table;
+} smmu_domain;
+
+static smmu_domain smmu_domains[SMMU_MAX_DOMAINS];
+static int smmu_domain_owner[N_CBs];
+static u16 smmu_domain_cb_mask;
+static u8 smmu_domain_first_smr;
+static u32 smmu_domain_clock;
+static smmu_domain_stats smmu_domain_counters;
+
+static u32 smmu_domain_smr(u8 cb, int stream){
+	return smmu_domain_first_smr + cb*SMMU_DOMAIN_MAX_STREAMS + stream;
+}
+
+static int smmu_domain_valid(int id){
+	return id >= 0 && id < SMMU_MAX_DOMAINS && smmu_domains[id].used;
+}
+
+static void smmu_domain_route_stream(u8 cb, int stream, const smmu_domain* domain){
+	u32 smr = smmu_domain_smr(cb, stream);
+
+	// S2CR before the SMR becomes valid
+	Xil_Out32(SMMU_S2CR_base + smr*4, FIELD_PREP(S2CR_TYPE, TRANSLATION_CB) | FIELD_PREP(S2CR_CBNDX, cb));
+	Xil_Out32(SMMU_SMR_base + smr*4, FIELD_PREP(SMR_VALID, 1) | FIELD_PREP(SMR_MASK, domain->stream_mask[stream]) |
+			FIELD_PREP(SMR_ID, domain->stream_id[stream]));
+}
+
+// The streams are detached first: no transaction of the domain reaches the bank after its SMRs are invalid
+static void smmu_domain_unbind(u8 cb){
+	int id = smmu_domain_owner[cb];
+
+	for (int i=0; i<SMMU_DOMAIN_MAX_STREAMS; i++){
+		Xil_Out32(SMMU_SMR_base + smmu_domain_smr(cb, i)*4, 0x0);
+	}
+	Xil_Out32(SMMU_CBn_SCTLR_base + cb*CBn_offset, 0x0);
+	smmu_pt_attach(cb, NULL);
+
+	smmu_domains[id].cb = SMMU_DOMAIN_UNBOUND;
+	smmu_domain_owner[cb] = -1;
+}
+
+// The bank is reloaded and invalidated while disabled, the streams are routed to it last
+static void smmu_domain_bind(int id, u8 cb){
+	smmu_domain* domain = &smmu_domains[id];
+	int placement = smmu_pt_placement_of(domain->l1_table);
+
+	Xil_Out32(SMMU_CBn_SCTLR_base + cb*CBn_offset, 0x0);
+	Xil_Out32(SMMU_CBAR_base + cb*4, FIELD_PREP(CBAR_TYPE, STAGE_1_BYPASS_2));
+	Xil_Out32(SMMU_CBA2Rn_base + cb*4, FIELD_PREP(CBA2R_VA64, VA_32));
+	Xil_Out32(SMMU_CBn_TCR2_base + cb*CBn_offset, SMMU_DOMAIN_TCR2);
+	Xil_Out32(SMMU_CBn_TCR_base + cb*CBn_offset, SMMU_DOMAIN_TCR);
+	// a tree outside the pools is walked as the DDR low pool
+	smmu_pt_set_walk_attrs(cb, placement < 0 ? SMMU_PT_DDR_LOW : placement);
+	Xil_Out32(SMMU_CBn_PRRR_MAIRn_base + cb*CBn_offset, domain->mair0);
+	Xil_Out32(SMMU_CBn_NMRR_MAIR1_base + cb*CBn_offset, domain->mair1);
+	Xil_Out64(SMMU_CBn_TTBR0_base + cb*CBn_offset, FIELD_PREP(TTBR_ADDR, (UINTPTR)domain->l1_table));
+
+	// the entries of the previous domain
+	invalidate_CBn_by_TLBIALL(cb);
+	sync_CBn_TLB(cb);
+
+	Xil_Out32(SMMU_CBn_SCTLR_base + cb*CBn_offset, SMMU_DOMAIN_SCTLR);
+
+	for (int i=0; i<domain->n_streams; i++){
+		smmu_domain_route_stream(cb, i, domain);
+	}
+
+	smmu_pt_attach(cb, domain->l1_table);
+	domain->cb = cb;
+	smmu_domain_owner[cb] = id;
+}
+
+/* Hands the context banks in cb_mask over to the domains, with the SMRs from first_smr.
+ * The banks are disabled and their SMRs invalidated.
+ */
+int smmu_domain_init(u16 cb_mask, u8 first_smr){
+	for (int i=0; i<N_CBs; i++){
+		if (((cb_mask >> i) & 0x1) && first_smr + (i + 1)*SMMU_DOMAIN_MAX_STREAMS > N_SMRs){
+			xil_printf("Error, not enough SMRs for the domains of CB%d\n\r", i);
+			return XST_FAILURE;
+		}
+	}
+
+	smmu_domain_cb_mask = cb_mask;
+	smmu_domain_first_smr = first_smr;
+
+	for (int i=0; i<SMMU_MAX_DOMAINS; i++){
+		smmu_domains[i].used = 0;
+	}
+
+	for (int i=0; i<N_CBs; i++){
+		smmu_domain_owner[i] = -1;
+		if ((cb_mask >> i) & 0x1){
+			for (int j=0; j<SMMU_DOMAIN_MAX_STREAMS; j++){
+				Xil_Out32(SMMU_SMR_base + smmu_domain_smr(i, j)*4, 0x0);
+			}
+			Xil_Out32(SMMU_CBn_SCTLR_base + i*CBn_offset, 0x0);
+		}
+	}
+
+	return XST_SUCCESS;
+}
+
+// Returns the domain id, -1 if no domain is left
+int smmu_domain_create(u64* l1_table, u32 mair0, u32 mair1){
+	for (int i=0; i<SMMU_MAX_DOMAINS; i++){
+		smmu_domain* domain = &smmu_domains[i];
+
+		if (!domain->used){
+			domain->used = 1;
+			domain->cb = SMMU_DOMAIN_UNBOUND;
+			domain->n_streams = 0;
+			domain->last_use = 0;
+			domain->mair0 = mair0;
+			domain->mair1 = mair1;
+			domain->l1_table = l1_table;
+			return i;
+		}
+	}
+
+	xil_printf("Error, no free translation domains\n\r");
+	return -1;
+}
+
+/* Adds a stream (SMR id and mask) to the domain. A stream can belong to one domain only, since two bound
+ * domains matching the same stream would raise a stream match conflict.
+ */
+int smmu_domain_add_stream(int id, u16 stream_id, u16 mask){
+	smmu_domain* domain;
+
+	if (!smmu_domain_valid(id) || smmu_domains[id].n_streams == SMMU_DOMAIN_MAX_STREAMS){
+		return XST_FAILURE;
+	}
+	domain = &smmu_domains[id];
+
+	for (int i=0; i<SMMU_MAX_DOMAINS; i++){
+		for (int j=0; smmu_domains[i].used && j<smmu_domains[i].n_streams; j++){
+			if (((smmu_domains[i].stream_id[j] ^ stream_id) & ~(smmu_domains[i].stream_mask[j] | mask)) == 0){
+				xil_printf("Error, stream 0x%04X already belongs to domain %d\n\r", stream_id, i);
+				return XST_FAILURE;
+			}
+		}
+	}
+
+	domain->stream_id[domain->n_streams] = stream_id;
+	domain->stream_mask[domain->n_streams] = mask;
+	domain->n_streams++;
+
+	if (domain->cb != SMMU_DOMAIN_UNBOUND){
+		smmu_domain_route_stream(domain->cb, domain->n_streams - 1, domain);
+	}
+
+	return XST_SUCCESS;
+}
+
+void smmu_domain_destroy(int id){
+	if (!smmu_domain_valid(id)){
+		return;
+	}
+	if (smmu_domains[id].cb != SMMU_DOMAIN_UNBOUND){
+		smmu_domain_unbind(smmu_domains[id].cb);
+	}
+	smmu_domains[id].used = 0;
+}
+
+// Binds the domain to a context bank if it is not bound yet, returns the bank (-1 on error)
+int smmu_domain_activate(int id){
+	smmu_domain* domain;
+	int victim = -1;
+
+	if (!smmu_domain_valid(id)){
+		return -1;
+	}
+	domain = &smmu_domains[id];
+
+	domain->last_use = ++smmu_domain_clock;
+	if (domain->cb != SMMU_DOMAIN_UNBOUND){
+		smmu_domain_counters.hits++;
+		return domain->cb;
+	}
+	smmu_domain_counters.misses++;
+
+	// a free bank, otherwise the least recently activated domain is evicted
+	for (int i=0; i<N_CBs; i++){
+		if (((smmu_domain_cb_mask >> i) & 0x1) == 0){
+			continue;
+		}
+		if (smmu_domain_owner[i] < 0){
+			victim = i;
+			break;
+		}
+		if (victim < 0 || smmu_domains[smmu_domain_owner[i]].last_use < smmu_domains[smmu_domain_owner[victim]].last_use){
+			victim = i;
+		}
+	}
+
+	if (victim < 0){
+		return -1;
+	}
+	if (smmu_domain_owner[victim] >= 0){
+		smmu_domain_unbind(victim);
+		smmu_domain_counters.evictions++;
+	}
+	smmu_domain_bind(id, victim);
+
+	return victim;
+}
+
+// Returns the domain of the stream, -1 if no domain has it
+int smmu_domain_find_stream(u16 stream_id){
+	for (int i=0; i<SMMU_MAX_DOMAINS; i++){
+		for (int j=0; smmu_domains[i].used && j<smmu_domains[i].n_streams; j++){
+			if (((smmu_domains[i].stream_id[j] ^ stream_id) & ~smmu_domains[i].stream_mask[j]) == 0){
+				return i;
+			}
+		}
+	}
+	return -1;
+}
+
+/* Activates the domain of the stream reported by an unidentified stream fault.
+ * Returns the bank of the domain, -1 if there is no such fault or the stream has no domain: sGFSR is then
+ * left set for the report of the caller.
+ */
+int smmu_domain_service_global_fault(void){
+	u32 sgfsr = Xil_In32(SMMU_SGFSR);
+	int id;
+
+	if (FIELD_GET(SGFSR_USF, sgfsr) == 0){
+		return -1;
+	}
+
+	id = smmu_domain_find_stream(FIELD_GET(SGFSYNR1_SID, Xil_In32(SMMU_SGFSYNR1)));
+	if (id < 0){
+		return -1;
+	}
+	Xil_Out32(SMMU_SGFSR, sgfsr);
+	smmu_domain_counters.stream_faults++;
+
+	return smmu_domain_activate(id);
+}
+
+u8 smmu_domain_bank(int id){
+	return smmu_domain_valid(id) ? smmu_domains[id].cb : SMMU_DOMAIN_UNBOUND;
+}
+
+void smmu_domain_get_stats(smmu_domain_stats* stats){
+	*stats = smmu_domain_counters;
+}
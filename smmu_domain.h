@@ -0,0 +1,39 @@
+#ifndef __SMMU_DOMAIN_H_
+#define __SMMU_DOMAIN_H_
+
+#include "smmu_pgtable.h"
+
+/* Translation domains multiplexed over the hardware context banks.
+ * A domain is a table tree with its translation registers and the streams of its masters. It is bound to
+ * a context bank only while it is active: smmu_domain_activate binds it to a free bank of the managed ones,
+ * or to the bank of the least recently activated domain, which is evicted.
+ * Binding a domain reloads the bank (CBAR, TCR, MAIR, TTBR0, SCTLR), invalidates the TLB of that bank only,
+ * and routes the streams of the domain to it. The streams of an unbound domain match no SMR: with
+ * SMMU_sCR0.USFCFG = 1 their transactions raise an unidentified stream fault, which
+ * smmu_domain_service_global_fault turns into the activation of the domain (the faulting transaction
+ * is aborted, the master has to retry it).
+ * Each managed bank n uses the SMRs first_smr + n*SMMU_DOMAIN_MAX_STREAMS onwards.
+ */
+
+#define SMMU_MAX_DOMAINS          64
+#define SMMU_DOMAIN_MAX_STREAMS   2
+#define SMMU_DOMAIN_UNBOUND       0xFF
+
+typedef struct {
+	u32 hits;      // activation of a bound domain
+	u32 misses;    // activation of an unbound domain
+	u32 evictions; // misses served by evicting another domain
+	u32 stream_faults;
+} smmu_domain_stats;
+
+int smmu_domain_init(u16 cb_mask, u8 first_smr);
+int smmu_domain_create(u64* l1_table, u32 mair0, u32 mair1);
+int smmu_domain_add_stream(int id, u16 stream_id, u16 mask);
+void smmu_domain_destroy(int id);
+int smmu_domain_activate(int id);
+int smmu_domain_find_stream(u16 stream_id);
+int smmu_domain_service_global_fault(void);
+u8 smmu_domain_bank(int id);
+void smmu_domain_get_stats(smmu_domain_stats* stats);
+
+#endif
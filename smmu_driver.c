@@ -68,46 +68,43 @@ void show_SMMU_SIDRn(u8 index){
 
 void set_SMMU_CBn_SCTLR(u8 offset, u8 m_bit, u8 cfre, u8 cfie){
 	u32 targetReg = SMMU_CBn_SCTLR_base + offset*CBn_offset;
-	u32 regVal = 0x0;
+	// M [0]: enable, CFRE [5]: abort on context fault, CFIE [6]: interrupt on context fault
+	u32 regVal = FIELD_PREP(SCTLR_M, m_bit) | FIELD_PREP(SCTLR_CFRE, cfre) | FIELD_PREP(SCTLR_CFIE, cfie);
 
-	// set the M bit (enable)
-	setBit32(&regVal, 0, m_bit);
+	// update
+	Xil_Out32(targetReg, regVal);
 
-	// set the cfre bit
-	setBit32(&regVal, 5, cfre);
+	// print
+	regVal = Xil_In32(targetReg);
+	xil_printf("SMMU_CB%d_SCTLR(0x%08X) has been set to: 0x%08X\n\r", offset, targetReg, regVal);
+}
 
-	// set the cfie bit
-	setBit32(&regVal, 6, cfie);
+// CFCFG [7]: 1 stalls the transaction on a context fault (until CBn_RESUME), 0 terminates it
+// Note: stalling also requires SMMU_sCR0.STALLD = 0
+void set_SMMU_CBn_CFCFG(u8 offset, u8 cfcfg){
+	u32 targetReg = SMMU_CBn_SCTLR_base + offset*CBn_offset;
+	u32 regVal = Xil_In32(targetReg);
 
-	// update
+	regVal = (regVal & ~FIELD_MASK(SCTLR_CFCFG)) | FIELD_PREP(SCTLR_CFCFG, cfcfg);
 	Xil_Out32(targetReg, regVal);
 
-	// print
 	regVal = Xil_In32(targetReg);
 	xil_printf("SMMU_CB%d_SCTLR(0x%08X) has been set to: 0x%08X\n\r", offset, targetReg, regVal);
 }
 
 // this will access the corresponding banked copy of SCR depending if secure or non-secure
 void set_SMMU_sCR0(u8 clientpd, u8 gfre, u8 gfie, u8 stalld, u8 usfcg){
-	u32 regVal = 0x0;
 	u32 targetReg = SMMU_sCR0;
 
 	// set:
 	// CLIENTPD [bit 0]: 0 (do not bypass transaction)
-	setBit32(&regVal, 0, clientpd);
-
 	// GFRE [bit 1]: 1 (raise a global fault)
-	setBit32(&regVal, 1, gfre);
-
 	// GFIE [bit 2]: 1 (raise a global interrupt in case of fault)
-	setBit32(&regVal, 2, gfie);
-
 	// STALLD [bit 8]
-	setBit32(&regVal, 8, stalld);
-
 	// USFCG [bit 10]: 1 to generate a Unidentified stream fault on any transaction that does not
 	// match any Stream mapping table entries.
-	setBit32(&regVal, 10, usfcg);
+	u32 regVal = FIELD_PREP(SCR0_CLIENTPD, clientpd) | FIELD_PREP(SCR0_GFRE, gfre) | FIELD_PREP(SCR0_GFIE, gfie) |
+			FIELD_PREP(SCR0_STALLD, stalld) | FIELD_PREP(SCR0_USFCFG, usfcg);
 
 	// GCFGFRE, GCFGFIE are read-only and are for global configuration faults but they are read-only.
 	// NOTE: in NSCR0 the bits from [31:28] are not implemented
@@ -121,22 +118,10 @@ void set_SMMU_sCR0(u8 clientpd, u8 gfre, u8 gfie, u8 stalld, u8 usfcg){
 
 void set_SMRn(u8 index, bool valid, u16 mask, u16 tbu_number, u16 mid){
 	u32 targetReg = SMMU_SMR_base + index*4;
-	u32 regVal = 0x0;
 
-	// set VALID
-	if ( valid ){
-		// Set the first bit to 1 (VALID)
-		setBit32(&regVal, 31, 0x1);
-	}
-
-	// Set bits 30 to 16 to the MASK
-	setBitRange32(&regVal, 30, 16, mask);
-
-	// Set bits 14 to 10 to the tbu_number
-	setBitRange32(&regVal, 14, 10, tbu_number);
-
-	// Set bits 9 to 0 to the mid
-	setBitRange32(&regVal, 9, 0, mid);
+	// VALID [31], MASK [30:16], TBU number [14:10], MID [9:0]
+	u32 regVal = FIELD_PREP(SMR_VALID, valid) | FIELD_PREP(SMR_MASK, mask) | FIELD_PREP(SMR_TBU, tbu_number) |
+			FIELD_PREP(SMR_MID, mid);
 
 	// Write the value to the target SMR register
 	Xil_Out32(targetReg, regVal);
@@ -146,21 +131,26 @@ void set_SMRn(u8 index, bool valid, u16 mask, u16 tbu_number, u16 mid){
 	xil_printf("SMR%d(0x%08X) has been set to: 0x%08X\n\r", index, targetReg, regVal);
 }
 
+// same as set_SMRn, with the 15-bit stream id (TBU number [14:10], MID [9:0]) given as a whole
+void set_SMRn_by_StreamID(u8 index, bool valid, u16 mask, u16 stream_id){
+	u32 targetReg = SMMU_SMR_base + index*4;
+
+	u32 regVal = FIELD_PREP(SMR_VALID, valid) | FIELD_PREP(SMR_MASK, mask) | FIELD_PREP(SMR_ID, stream_id);
+
+	Xil_Out32(targetReg, regVal);
+
+	regVal = Xil_In32(targetReg);
+	xil_printf("SMR%d(0x%08X) has been set to: 0x%08X\n\r", index, targetReg, regVal);
+}
 
 void set_S2CRn (u8 offset, enum s2cr_type type, u8 cb_index){
 	u32 regVal = 0x0;
 	u32 targetReg = SMMU_S2CR_base + offset*4;
 
 	if(type == TRANSLATION_CB){
-		// read the default values
-		//regVal = Xil_In32(targetReg);
-
-		// set the type bits [17:16]
-		setBitRange32(&regVal, 17, 16, type);
-
-		// set context bank index CBNDX[7:0]
+		// type bits [17:16], context bank index CBNDX[7:0]
 		// NOTE: the context banks are less than the SMRn and S2CRn. We can have more SMRs matching the same context bank!
-		setBitRange32(&regVal, 7, 0, cb_index);
+		regVal = FIELD_PREP(S2CR_TYPE, type) | FIELD_PREP(S2CR_CBNDX, cb_index);
 
 		// update the register
 		Xil_Out32(targetReg, regVal);
@@ -172,7 +162,7 @@ void set_S2CRn (u8 offset, enum s2cr_type type, u8 cb_index){
 	else{
 		// Note: set the register value to all 0s (default)
 		// set the type bits [17:16]
-		setBitRange32(&regVal, 17, 16, type);
+		regVal = FIELD_PREP(S2CR_TYPE, type);
 
 		// update the register
 		Xil_Out32(targetReg, regVal);
@@ -185,11 +175,10 @@ void set_S2CRn (u8 offset, enum s2cr_type type, u8 cb_index){
 }
 
 void set_CBARn(u8 offset, enum cbar_type type){
-	u32 regVal = 0x0;
 	u32 targetReg = SMMU_CBAR_base + offset*4;
 
 	// set the type bits [17:16]
-	setBitRange32(&regVal, 17, 16, type);
+	u32 regVal = FIELD_PREP(CBAR_TYPE, type);
 
 	// update the register
 	Xil_Out32(targetReg, regVal);
@@ -199,6 +188,32 @@ void set_CBARn(u8 offset, enum cbar_type type){
 	xil_printf("CBAR%d(0x%08X) has been set to: 0x%08X\n\r", offset, targetReg, regVal);
 }
 
+// stage 2 context bank of the virtual machine vmid
+void set_CBARn_stage2(u8 offset, u8 vmid){
+	u32 targetReg = SMMU_CBAR_base + offset*4;
+
+	// type bits [17:16], VMID [7:0]
+	u32 regVal = FIELD_PREP(CBAR_TYPE, STAGE_2_CONTEXT) | FIELD_PREP(CBAR_VMID, vmid);
+
+	Xil_Out32(targetReg, regVal);
+
+	regVal = Xil_In32(targetReg);
+	xil_printf("CBAR%d(0x%08X) has been set to: 0x%08X\n\r", offset, targetReg, regVal);
+}
+
+// stage 1 context bank whose output addresses (IPAs) are translated by the stage 2 context bank s2_offset
+void set_CBARn_nested(u8 offset, u8 s2_offset){
+	u32 targetReg = SMMU_CBAR_base + offset*4;
+
+	// type bits [17:16], stage 2 context bank index CBNDX [15:8]
+	u32 regVal = FIELD_PREP(CBAR_TYPE, STAGE_1_2) | FIELD_PREP(CBAR_CBNDX, s2_offset);
+
+	Xil_Out32(targetReg, regVal);
+
+	regVal = Xil_In32(targetReg);
+	xil_printf("CBAR%d(0x%08X) has been set to: 0x%08X\n\r", offset, targetReg, regVal);
+}
+
 // PP.341 OF THE MANUAL
 // TTBR is ASID[63:48], [47:x] base address, [x-1:0] reserved (SBZ)
 // x = 28 - TOSZ   by pp.79 (VMSAv8-64 using 4kb granule)
@@ -207,24 +222,24 @@ void set_CBARn(u8 offset, enum cbar_type type){
 // TTBR0 is RESERVED[63:56], ASID[55:48], base address [47:x], SBZ [x-1:0]
 // pp.71 and pp.31
 // Note that LPAE uses a 4KB granule by default
-void set_CBnTTBR0_32_lpae_stage1(u8 offset, u16 asid, u32 translation_table_addr, u8 t0sz){
+// The table can be anywhere in the 40-bit physical space (e.g. DDR high at 0x8_0000_0000): the walks of the
+// context bank must then be allowed to reach it with TCR2.PASize (set_CBn_TCR2_stage1)
+void set_CBnTTBR0_32_lpae_stage1(u8 offset, u16 asid, u64 translation_table_addr, u8 t0sz){
 	u32 targetReg = SMMU_CBn_TTBR0_base + CBn_offset*offset;
-	u64 regVal = 0x0;
-	u8 x = 5-t0sz; // unused
+
+	if (translation_table_addr & ~FIELD_MASK(TTBR_ADDR)){
+		xil_printf("Error, the translation table address 0x%016llX is beyond 40 bits\n\r", translation_table_addr);
+		return;
+	}
 
 	// set the table address
 	// the output address is said to be [39:x] but actually the address must start from 0 and the first
 	// 3 bit are 0b000 (4KB aligned)
 	// Remember that the granularity is fixed at 4Kb for aarch32 lpae
-	xil_printf("Writing on TTBR0 the translation table address: 0x%08X\n\r", translation_table_addr);
-	setBitRange64(&regVal, 31, 0, translation_table_addr);
-
-	// set the rest of the base address to 0
 	// AArch32 state does not support addresses larger than 40 bits, therefore bits[47:40] are always RES0.
-	setBitRange64(&regVal, 47, 40, 0x0);
-
-	// set the ASID [55:48]
-	setBitRange64(&regVal, 55, 48, asid);
+	// ASID [55:48]
+	xil_printf("Writing on TTBR0 the translation table address: 0x%016llX\n\r", translation_table_addr);
+	u64 regVal = FIELD_PREP(TTBR_ADDR, translation_table_addr) | FIELD_PREP(TTBR_ASID, asid);
 
 	// update register
 	Xil_Out64(targetReg, regVal);
@@ -234,7 +249,7 @@ void set_CBnTTBR0_32_lpae_stage1(u8 offset, u16 asid, u32 translation_table_addr
 	xil_printf("The CB%d_TTBR0(0x%08X) register has been set to: 0x%016llX\n\r", offset, targetReg, (u64)regVal);
 }
 
-void set_CBnTTBR0_64_stage1(u8 offset, u8 asid, u32 translation_table_addr, u8 t0sz, u8 first_lookup_level){
+void set_CBnTTBR0_64_stage1(u8 offset, u8 asid, u64 translation_table_addr, u8 t0sz, u8 first_lookup_level){
 	u32 targetReg = SMMU_CBn_TTBR0_base + offset*8;
 	u64 regVal = 0x0;
 	u8 x = 5-t0sz;
@@ -251,12 +266,11 @@ void set_CBnTTBR0_64_stage1(u8 offset, u8 asid, u32 translation_table_addr, u8 t
 		return;
 	}*/
 
-	// set the table address
+	// set the table address [47:x] and the ASID [63:48]
+	// translation_table_addr is the byte address of the table, written in place (it was shifted left by x
+	// before, which only suited a value already shifted right by x: no caller passes one)
 	xil_printf("Writing on TTBR0 the translation table address: 0x%016llX\n\r", translation_table_addr);
-	setBitRange64(&regVal, 47, x, translation_table_addr);
-
-	// set the ASID [55:48]
-	setBitRange64(&regVal, 63, 48, asid);
+	regVal = (translation_table_addr & (((1ULL << 48) - 1) & ~((1ULL << x) - 1))) | FIELD_PREP(TTBR64_ASID, asid);
 
 	// update register
 	Xil_Out64(targetReg, regVal);
@@ -266,7 +280,7 @@ void set_CBnTTBR0_64_stage1(u8 offset, u8 asid, u32 translation_table_addr, u8 t
 	xil_printf("The CB%d_TTBR0(0x%08X) register has been set to: 0x%016llX\n\r", offset, targetReg, (u64)regVal);
 }
 
-void set_CBnTTBR0_32_lpae_stage2(u8 offset, u32 translation_table_addr, u8 t0sz){
+void set_CBnTTBR0_32_lpae_stage2(u8 offset, u64 translation_table_addr, u8 t0sz){
 	u32 targetReg = SMMU_CBn_TTBR0_base + offset*CBn_offset;
 	u64 regVal = 0x0;
 	u8 x = 5-t0sz;
@@ -279,8 +293,11 @@ void set_CBnTTBR0_32_lpae_stage2(u8 offset, u32 translation_table_addr, u8 t0sz)
 
 	// set the table address
 	// if x = 5, the output address is in [39:5]
+	// translation_table_addr is the byte address of the table, written in place as for the stage 1 setters
+	// (it was shifted left by x before, which only suited a value already shifted right by x)
 	xil_printf("Writing on TTBR0...\n\r");
-	setBitRange64(&regVal, 39, x, translation_table_addr);
+	u64 addr_mask = FIELD_MASK(TTBR_ADDR) & ~((1ULL << x) - 1);
+	regVal = (regVal & ~addr_mask) | (translation_table_addr & addr_mask);
 
 	// update register
 	Xil_Out64(targetReg, regVal);
@@ -298,7 +315,7 @@ void set_CBA2Rn_VA(u8 offset, enum va_size size){
 	regVal = Xil_In32(targetReg);
 
 	// set the VA64 bit
-	setBit32(&regVal, 0, size);
+	regVal = (regVal & ~FIELD_MASK(CBA2R_VA64)) | FIELD_PREP(CBA2R_VA64, size);
 
 	// update the register
 	Xil_Out32(targetReg, regVal);
@@ -330,31 +347,16 @@ void set_CBn_MAIR_stage1(u8 offset, u32 mair_value){
 // following pp. 358 of the doc
 // Note that TCR properties applies for stage 2 translations
 void set_CBn_TCR_lpae_32_stage1(u8 offset, u8 t0sz, u8 irgn0, u8 orgn0, u8 sh0, u8 t1sz, u8 eae){
-	u32 regVal = 0x0;
 	u32 targetReg = SMMU_CBn_TCR_base + offset*CBn_offset;
 
-	// read the default values
-	// regVal = Xil_In32(targetReg);
-
 	// set the fields
-	// T0SZ[2:0]
-	// this field determine the size of the address in TTBR according to the algorithm pp.79
-	setBitRange32(&regVal, 2, 0, t0sz);
-
-	// IRGN0: Inner cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 9, 8, irgn0);
-
-	// ORGN0: Outer cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 11, 10, orgn0);
-
+	// T0SZ[2:0]: this field determine the size of the address in TTBR according to the algorithm pp.79
+	// IRGN0/ORGN0: Inner/Outer cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
 	// SH0: Shareability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 13, 12, sh0);
-
 	// T1SZ [18:16]: The size offset of the SMMU_CBn_TTBR1 addressed region.
-	setBitRange32(&regVal, 18, 16, t1sz);
-
 	// EAE: A value of 1 means that the translation system defined in the LPAE is used.
-	setBit32(&regVal, 31, eae);
+	u32 regVal = FIELD_PREP(TCR_T0SZ, t0sz) | FIELD_PREP(TCR_IRGN0, irgn0) | FIELD_PREP(TCR_ORGN0, orgn0) |
+			FIELD_PREP(TCR_SH0, sh0) | FIELD_PREP(TCR_T1SZ, t1sz) | FIELD_PREP(TCR_EAE, eae);
 
 	// update the register
 	xil_printf("Writing to CB%d_TCR_lpae(0x%08X) the value of: 0x%08X\n\r", offset, targetReg, regVal);
@@ -373,25 +375,15 @@ void set_CBn_TCR_lpae_32_stage2(u8 offset, u8 t0sz, u8 sl0, u8 irgn0, u8 orgn0,
 	regVal = Xil_In32(targetReg);
 
 	// set the fields
-	// T0SZ [2:0]
-	// this field determine the size of the address in TTBR according to the algorithm pp.79
-	setBitRange32(&regVal, 3, 0, t0sz);
-
-	// SL0 [7:6]
-	// starting lookup level for the SMMU_CBn_TTBR0 addressed region (for stage 2): 0 for level 2, 1 for level 1
-	setBitRange32(&regVal, 7, 6, sl0);
-
-	// IRGN0: Inner cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 9, 8, irgn0);
-
-	// ORGN0: Outer cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 11, 10, orgn0);
-
+	// T0SZ [3:0]: this field determine the size of the address in TTBR according to the algorithm pp.79
+	// SL0 [7:6]: starting lookup level for the SMMU_CBn_TTBR0 addressed region (for stage 2): 0 for level 2, 1 for level 1
+	// IRGN0/ORGN0: Inner/Outer cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
 	// SH0: Shareability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 13, 12, sh0);
-
 	// EAE: A value of 1 means that the translation system defined in the LPAE is used.
-	setBit32(&regVal, 31, eae);
+	u32 mask = FIELD_MASK(TCR_S2_T0SZ) | FIELD_MASK(TCR_S2_SL0) | FIELD_MASK(TCR_IRGN0) | FIELD_MASK(TCR_ORGN0) |
+			FIELD_MASK(TCR_SH0) | FIELD_MASK(TCR_EAE);
+	regVal = (regVal & ~mask) | FIELD_PREP(TCR_S2_T0SZ, t0sz) | FIELD_PREP(TCR_S2_SL0, sl0) | FIELD_PREP(TCR_IRGN0, irgn0) |
+			FIELD_PREP(TCR_ORGN0, orgn0) | FIELD_PREP(TCR_SH0, sh0) | FIELD_PREP(TCR_EAE, eae);
 
 	// update the register
 	Xil_Out32(targetReg, regVal);
@@ -409,24 +401,15 @@ void set_CBn_TCR_64_stage1(u8 offset, u8 t0sz, u8 t1sz, u8 irgn0, u8 orgn0, u8 s
 	regVal = Xil_In32(targetReg);
 
 	// set the fields
-	// T0SZ [2:0]
-	// this field determine the size of the address in TTBR according to the algorithm pp.79
-	setBitRange32(&regVal, 5, 0, t0sz);
-
-	// IRGN0: Inner cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 9, 8, irgn0);
-
-	// ORGN0: Outer cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 11, 10, orgn0);
-
+	// T0SZ [5:0]: this field determine the size of the address in TTBR according to the algorithm pp.79
+	// IRGN0/ORGN0: Inner/Outer cacheability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
 	// SH0: Shareability attributes for the memory associated with the translation table walks using SMMU_CBn_TTBR0.
-	setBitRange32(&regVal, 13, 12, sh0);
-
 	// TG0: granularity
-	setBitRange32(&regVal, 15, 14, tg0);
-
-	// T1SZ
-	setBitRange32(&regVal, 21, 16, t1sz);
+	// T1SZ [21:16]
+	u32 mask = FIELD_MASK(TCR64_T0SZ) | FIELD_MASK(TCR_IRGN0) | FIELD_MASK(TCR_ORGN0) | FIELD_MASK(TCR_SH0) |
+			FIELD_MASK(TCR64_TG0) | FIELD_MASK(TCR64_T1SZ);
+	regVal = (regVal & ~mask) | FIELD_PREP(TCR64_T0SZ, t0sz) | FIELD_PREP(TCR_IRGN0, irgn0) | FIELD_PREP(TCR_ORGN0, orgn0) |
+			FIELD_PREP(TCR_SH0, sh0) | FIELD_PREP(TCR64_TG0, tg0) | FIELD_PREP(TCR64_T1SZ, t1sz);
 
 	// update the register
 	Xil_Out32(targetReg, regVal);
@@ -437,15 +420,13 @@ void set_CBn_TCR_64_stage1(u8 offset, u8 t0sz, u8 t1sz, u8 irgn0, u8 orgn0, u8 s
 }
 
 // TCR2 does not exists in stage 2 CBs
-void set_CBn_TCR2_stage1(u8 offset, u8 tbi0, u8 pa_size){
-	u32 regVal = 0x0;
+// pa_size bounds the output addresses of the context bank, table walks included: PA_32 faults any access to
+// DDR high, PA_40 covers the whole ZynqMP physical space
+void set_CBn_TCR2_stage1(u8 offset, u8 tbi0, enum pa_size pa_size){
 	u32 targetReg = SMMU_CBn_TCR2_base + offset*CBn_offset;
 
-	// tbi0 [5]: Top Byte Ignored
-	setBit32(&regVal, 5, tbi0);
-
-	// pa_size [2:0]
-	setBitRange32(&regVal, 2, 0, pa_size);
+	// tbi0 [5]: Top Byte Ignored, pa_size [2:0]
+	u32 regVal = FIELD_PREP(TCR2_TBI0, tbi0) | FIELD_PREP(TCR2_PASIZE, pa_size);
 
 	// update the register
 	Xil_Out32(targetReg, regVal);
@@ -469,6 +450,36 @@ void set_Table_Entry_32_lpae(u64* table, u16 entry_index, u64 entry_value){
 	}
 }
 
+/* Software walk of an aarch32 lpae stage 1 table with T0SZ = 0 (the walk starts at level 1 with 4 entries).
+ * The tables are accessed through their physical address (flat mapping of the processor).
+ */
+int walk_Table_32_lpae(const u64* l1_table, u32 va, u64* pa){
+	const u64* table = l1_table;
+	u32 index = (va >> 30) & 0x3;
+
+	for (int level=1; level<=3; level++){
+		u64 desc = table[index];
+		u8 shift = 39 - 9*level; // 30, 21, 12
+
+		if ((desc & LPAE_DESC_VALID) == 0 || (level == 3 && (desc & LPAE_DESC_TABLE) == 0)){
+			return XST_FAILURE;
+		}
+
+		// block (level 1-2) or page (level 3)
+		if (level == 3 || (desc & LPAE_DESC_TABLE) == 0){
+			u64 offset_mask = (1ULL << shift) - 1;
+			*pa = (desc & LPAE_DESC_OA_MASK & ~offset_mask) | (va & offset_mask);
+			return XST_SUCCESS;
+		}
+
+		// table
+		table = (const u64*)(UINTPTR)(desc & LPAE_DESC_OA_MASK);
+		index = (va >> (shift - 9)) & (N_ENTRIES - 1);
+	}
+
+	return XST_FAILURE;
+}
+
 void printSMMUGlobalErr(){
 
 	u32 regVal = 0x0;
@@ -524,6 +535,12 @@ void printCBnErrors(int index){
 	xil_printf("The value of SMMU_CB%d_FSYNR0 is: 0x%08X\n\r", index, regVal);
 }
 
+// Restarts the transaction stalled on the context bank (TnR = 0, retry) or aborts it (TnR = 1, terminate).
+// The write is ignored when SMMU_CBn_FSR.SS is 0, the fault bits of the FSR must be cleared before.
+void resume_CBn(u8 offset, u8 terminate){
+	Xil_Out32(SMMU_CBn_RESUME_base + offset*CBn_offset, FIELD_PREP(RESUME_TNR, terminate));
+}
+
 void clear_error_status(){
 	// wtc: write 1 to clear
 
@@ -569,6 +586,154 @@ void invalidate_by_TLBIALLNSNH(){
 	Xil_Out32(SMMU_TLBIALLNSNH, 0xFFFFFFFF);
 }
 
+// Invalidates all the TLB entries of the context bank.
+void invalidate_CBn_by_TLBIALL(u8 offset){
+	Xil_Out32(SMMU_CBn_TLBIALL_base + offset*CBn_offset, 0x0);
+}
+
+// Invalidates the entries of the context bank that translate va, for any ASID.
+// With SMMU_CBA2Rn.VA64 = 0 the register takes VA[31:12], the lower bits are ignored.
+void invalidate_CBn_by_VAA(u8 offset, u32 va){
+	Xil_Out32(SMMU_CBn_TLBIVAA_base + offset*CBn_offset, va & ~(GRANULARITY - 1));
+}
+
+// Invalidates the non-global entries tagged with asid (in the VMID of the context bank).
+void invalidate_CBn_by_ASID(u8 offset, u16 asid){
+	Xil_Out32(SMMU_CBn_TLBIASID_base + offset*CBn_offset, asid);
+}
+
+// Waits for the TLB maintenance operations issued on the context bank to complete.
+int sync_CBn_TLB(u8 offset){
+	u32 statusReg = SMMU_CBn_TLBSTATUS_base + offset*CBn_offset;
+
+	Xil_Out32(SMMU_CBn_TLBSYNC_base + offset*CBn_offset, 0x0);
+
+	for (int i=0; i<TLBSYNC_TIMEOUT; i++){
+		if ((Xil_In32(statusReg) & TLBSTATUS_SACTIVE) == 0){
+			return XST_SUCCESS;
+		}
+	}
+
+	xil_printf("Error, TLB sync timeout on CB%d\n\r", offset);
+	return XST_FAILURE;
+}
+
+/* Hardware translation of va through the context bank (stage 1 privileged read, ATS1PR).
+ * The SMMU walks the tables (or hits in its TLB) as it would for a transaction of the context bank and
+ * reports the result in CBn_PAR, in the long-descriptor format since the banks use EAE = 1.
+ * Returns XST_FAILURE if the translation faults (PAR.F) or the operation does not complete.
+ */
+int translate_CBn_by_ATS1PR(u8 offset, u32 va, u64* pa){
+	u32 statusReg = SMMU_CBn_ATSR_base + offset*CBn_offset;
+	u64 par;
+
+	// with SMMU_CBA2Rn.VA64 = 0 the register takes VA[31:12]
+	Xil_Out64(SMMU_CBn_ATS1PR_base + offset*CBn_offset, va & ~(GRANULARITY - 1));
+
+	for (int i=0; i<TLBSYNC_TIMEOUT; i++){
+		if (FIELD_GET(ATSR_ACTIVE, Xil_In32(statusReg)) == 0){
+			par = Xil_In64(SMMU_CBn_PAR_base + offset*CBn_offset);
+			if (FIELD_GET(PAR_F, par)){
+				return XST_FAILURE;
+			}
+			*pa = (par & FIELD_MASK(PAR_PA)) | (va & (GRANULARITY - 1));
+			return XST_SUCCESS;
+		}
+	}
+
+	xil_printf("Error, ATS1PR timeout on CB%d\n\r", offset);
+	return XST_FAILURE;
+}
+
+// Publishes a table entry to the table walker: the tables can live in cacheable memory
+void publish_Table_Entry(u64* entry){
+	Xil_DCacheFlushRange((INTPTR)entry, sizeof(u64));
+	dsb();
+}
+
+/* Level (1-3) of table in the tree the TTBR0 of the context bank offset points to, following va: 0 if the
+ * walk of va does not go through table.
+ */
+static int remap_table_level(u8 offset, const u64* table, u32 va){
+	const u64* level_table = (const u64*)(UINTPTR)(Xil_In64(SMMU_CBn_TTBR0_base + offset*CBn_offset) & LPAE_DESC_OA_MASK);
+
+	for (int level=1; level<=3; level++){
+		u64 entry;
+
+		if (level_table == table){
+			return level;
+		}
+		entry = level_table[(va >> (39 - 9*level)) & (N_ENTRIES - 1)];
+		if ((entry & (LPAE_DESC_VALID | LPAE_DESC_TABLE)) != (LPAE_DESC_VALID | LPAE_DESC_TABLE)){
+			return 0;
+		}
+		level_table = (const u64*)(UINTPTR)(entry & LPAE_DESC_OA_MASK);
+	}
+	return 0;
+}
+
+/* Invalidates the TLB entries of the old entry of a remap: va alone for a page (level 3), the whole bank for
+ * a block or a table, whose 2MB or 1GB of translations (and walk cache entries) va does not cover.
+ */
+static void remap_invalidate(u8 offset, u64* table, u32 va, u64 old_value){
+	if ((old_value & LPAE_DESC_TABLE) != 0 && remap_table_level(offset, table, va) == 3){
+		invalidate_CBn_by_VAA(offset, va);
+	}
+	else {
+		invalidate_CBn_by_TLBIALL(offset);
+	}
+	sync_CBn_TLB(offset);
+}
+
+/* Replaces a live entry of the table used by the context bank offset, where va is any input address
+ * translated by the entry.
+ * When only the permissions (AP, PXN, XN) change the entry is replaced directly, so the old and the new
+ * translation are both valid at any time. Any other change of a valid entry (output address, block size,
+ * memory attributes, nG...) follows the break-before-make sequence required by the architecture:
+ * the entry is invalidated, the TLB entries for va are invalidated and synchronized, and only then the
+ * new entry is written.
+ * For a page only the TLB entries of va are invalidated, the other translations of the context bank stay
+ * cached; replacing a block or a table invalidates the whole bank.
+ * Returns the blackout window in XTime counts, i.e. the time in which va had no valid translation and
+ * transactions of the context bank to it fault (0 for a direct replacement).
+ * The CPU-side translation cache is left to the caller, see smmu_remap in smmu_pgtable.c.
+ */
+u64 remap_Table_Entry_32_lpae(u8 offset, u64* table, u16 entry_index, u32 va, u64 entry_value){
+	u64 old_value = table[entry_index];
+	XTime startTime, endTime;
+
+	// an invalid entry can not be cached in the TLB: no invalidation required
+	if ((old_value & LPAE_DESC_VALID) == 0){
+		table[entry_index] = entry_value;
+		publish_Table_Entry(&table[entry_index]);
+		return 0;
+	}
+
+	// direct replacement (or unmap when the new entry is invalid)
+	if ((entry_value & LPAE_DESC_VALID) == 0 || ((old_value ^ entry_value) & ~LPAE_DESC_NO_BBM_MASK) == 0){
+		table[entry_index] = entry_value;
+		publish_Table_Entry(&table[entry_index]);
+		remap_invalidate(offset, table, va, old_value);
+		return 0;
+	}
+
+	// break-before-make
+	XTime_GetTime(&startTime);
+
+	// break
+	table[entry_index] = 0x0;
+	publish_Table_Entry(&table[entry_index]);
+	remap_invalidate(offset, table, va, old_value);
+
+	// make
+	table[entry_index] = entry_value;
+	publish_Table_Entry(&table[entry_index]);
+
+	XTime_GetTime(&endTime);
+
+	return endTime - startTime;
+}
+
 void getSCR1(){
 	u32 regVal = Xil_In32(SMMU_SCR1);
 
@@ -578,9 +743,8 @@ void getSCR1(){
 void setSCR1(u32 nsnumcbo, u32 nsnumsmrgo){
 	u32 regVal = Xil_In32(SMMU_SCR1);
 
-	setBitRange32(&regVal, 4, 0, nsnumcbo);
-
-	setBitRange32(&regVal, 13, 8, nsnumsmrgo);
+	regVal &= ~(FIELD_MASK(SCR1_NSNUMCBO) | FIELD_MASK(SCR1_NSNUMSMRGO));
+	regVal |= FIELD_PREP(SCR1_NSNUMCBO, nsnumcbo) | FIELD_PREP(SCR1_NSNUMSMRGO, nsnumsmrgo);
 
 	// update value
 	Xil_Out32(SMMU_SCR1, regVal);
@@ -1,7 +1,14 @@
+#ifndef __SMMU_DRIVER_H_
+#define __SMMU_DRIVER_H_
+
 #include <stdbool.h>
 #include "xil_printf.h"
 #include "xil_io.h"
+#include "xstatus.h"
 #include "xil_cache.h"
+#include "xpseudo_asm.h"
+#include "xtime_l.h"
+#include "smmu_fields.h"
 
 #define CBn_offset                0x1000
 #define SMMU_sCR0                 0xFD800000
@@ -11,7 +18,9 @@
 #define SMMU_CBAR_base            0xFD801000
 #define SMMU_CBn_TTBR0_base       0xFD810020
 #define SMMU_CBA2Rn_base          0xFD801800
+#define SMMU_CBFRSYNRAn_base      0xFD801400
 #define SMMU_CBn_PRRR_MAIRn_base  0xFD810038 // for short-descriptor is PRRR, otherwise is MAIR
+#define SMMU_CBn_NMRR_MAIR1_base  0xFD81003C // for short-descriptor is NMRR, otherwise is MAIR1
 #define SMMU_CBn_TCR_base         0xFD810030
 #define SMMU_CBn_TCR2_base        0xFD810010
 #define SMMU_SIDRn_base           0xFD800020
@@ -31,15 +40,36 @@
 #define SMMU_NSGFAR_high          0xFD800444
 #define SMMU_STLBIALL             0xFD800060
 #define SMMU_TLBIALLNSNH          0xFD800068
+#define SMMU_CBn_TLBIVAA_base     0xFD810608
+#define SMMU_CBn_TLBIASID_base    0xFD810610
+#define SMMU_CBn_TLBIALL_base     0xFD810618
+#define SMMU_CBn_TLBSYNC_base     0xFD8107F0
+#define SMMU_CBn_TLBSTATUS_base   0xFD8107F4
+#define SMMU_CBn_RESUME_base      0xFD810008
+#define SMMU_CBn_PAR_base         0xFD810050
+#define SMMU_CBn_ATS1PR_base      0xFD810800
+#define SMMU_CBn_ATSR_base        0xFD8108F0
+#define TLBSTATUS_SACTIVE         0x1
+#define TLBSYNC_TIMEOUT           1000000 // polling iterations before giving up on a TLB sync
 #define GRANULARITY 	 	      4096 // 4KB (fixed for aarch32)
 #define N_ENTRIES                 512
 #define N_SMRs                    48
 #define N_CBs                     16
 
+// long-descriptor fields that can be changed on a live entry without break-before-make
+#define LPAE_DESC_VALID           FIELD_MASK(DESC_VALID)
+#define LPAE_DESC_AP              FIELD_MASK(DESC_AP)
+#define LPAE_DESC_PXN             FIELD_MASK(DESC_PXN)
+#define LPAE_DESC_XN              FIELD_MASK(DESC_XN)
+#define LPAE_DESC_NO_BBM_MASK     (LPAE_DESC_AP | LPAE_DESC_PXN | LPAE_DESC_XN)
+#define LPAE_DESC_TABLE           FIELD_MASK(DESC_TYPE) // table descriptor at level 1-2, page descriptor at level 3
+#define LPAE_DESC_OA_MASK         FIELD_MASK(DESC_OA) // output address (or next level table) [39:12]
+
 // enums
 enum s2cr_type {TRANSLATION_CB = 0b00, BYPASS = 0b01, FAULT = 0b10, RESERVED = 0b11};
 enum cbar_type {STAGE_2_CONTEXT = 0b00, STAGE_1_BYPASS_2 = 0b01, STAGE_1_FAULT_2 = 0b10, STAGE_1_2 = 0b11};
 enum va_size {VA_32 = 0, VA_64 = 1};
+enum pa_size {PA_32 = 0b000, PA_36 = 0b001, PA_40 = 0b010}; // TCR2.PASize, output address size
 
 // function prototypes
 void setBitRange16(u16* regVal, u8 end_bit, u8 start_bit, u16 value);
@@ -50,25 +80,38 @@ void setBit64(u64* regVal, u8 bit_position, u8 value);
 
 void show_SMMU_SIDRn(u8 index);
 void set_SMMU_CBn_SCTLR(u8 offset, u8 m_bit, u8 cfre, u8 cfie);
+void set_SMMU_CBn_CFCFG(u8 offset, u8 cfcfg);
 void set_SMMU_sCR0(u8 clientpd, u8 gfre, u8 gfie, u8 stalld, u8 usfcg);
 void set_SMRn(u8 index, bool valid, u16 mask, u16 tbu_number, u16 mid);
 void set_SMRn_by_StreamID(u8 index, bool valid, u16 mask, u16 stream_id);
 void set_S2CRn(u8 offset, enum s2cr_type type, u8 cb_index);
 void set_CBARn(u8 offset, enum cbar_type type);
-void set_CBnTTBR0_32_lpae_stage1(u8 offset, u16 asid, u32 translation_table_addr, u8 t0sz);
-void set_CBnTTBR0_32_lpae_stage2(u8 offset, u32 translation_table_addr, u8 t0sz);
+void set_CBARn_stage2(u8 offset, u8 vmid);
+void set_CBARn_nested(u8 offset, u8 s2_offset);
+void set_CBnTTBR0_32_lpae_stage1(u8 offset, u16 asid, u64 translation_table_addr, u8 t0sz);
+void set_CBnTTBR0_32_lpae_stage2(u8 offset, u64 translation_table_addr, u8 t0sz);
 void set_CBA2Rn_VA(u8 offset, enum va_size size);
 void set_CBn_MAIR_stage1(u8 offset, u32 mair_value);
 void set_CBn_TCR_lpae_32_stage1(u8 offset, u8 t0sz, u8 irgn0, u8 orgn0, u8 sh0, u8 t1sz, u8 eae);
 void set_CBn_TCR_lpae_32_stage2(u8 offset, u8 t0sz, u8 sl0, u8 irgn0, u8 orgn0, u8 sh0, u8 eae);
-void set_CBn_TCR2_stage1(u8 offset, u8 tbi0, u8 pa_size);
+void set_CBn_TCR2_stage1(u8 offset, u8 tbi0, enum pa_size pa_size);
 void set_Table_Entry_32_lpae(u64* table, u16 entry_index, u64 entry_value);
+int walk_Table_32_lpae(const u64* l1_table, u32 va, u64* pa);
 void check_CBn_FSYNR0(u8 offset);
 void invalidate_by_STLBIALL();
 void invalidate_by_TLBIALLNSNH();
+void invalidate_CBn_by_TLBIALL(u8 offset);
+void invalidate_CBn_by_VAA(u8 offset, u32 va);
+void invalidate_CBn_by_ASID(u8 offset, u16 asid);
+int sync_CBn_TLB(u8 offset);
+int translate_CBn_by_ATS1PR(u8 offset, u32 va, u64* pa);
+void publish_Table_Entry(u64* entry);
+u64 remap_Table_Entry_32_lpae(u8 offset, u64* table, u16 entry_index, u32 va, u64 entry_value);
 void printSMMUGlobalErr();
 void printCBnErrors(int index);
+void resume_CBn(u8 offset, u8 terminate);
 void clear_error_status();
 void getSCR1();
 void setSCR1(u32 nsnumcbo, u32 nsnumsmrgo);
 
+#endif
@@ -0,0 +1,106 @@
+#include "smmu_fault.h"
+
+typedef struct {
+	smmu_fault_handler handler;
+	void* arg;
+} smmu_fault_hook;
+
+static smmu_fault_hook smmu_fault_hooks[N_CBs];
+
+// written by the interrupt handler, read by the application
+static smmu_fault smmu_fault_queue[SMMU_FAULT_QUEUE_SIZE];
+static volatile u32 smmu_fault_head;
+static volatile u32 smmu_fault_tail;
+static smmu_fault_stats smmu_fault_counters;
+
+void smmu_fault_enable_stall(u8 cb, u8 enable){
+	set_SMMU_CBn_CFCFG(cb, enable);
+}
+
+void smmu_fault_set_handler(u8 cb, smmu_fault_handler handler, void* arg){
+	smmu_fault_hooks[cb].arg = arg;
+	smmu_fault_hooks[cb].handler = handler;
+}
+
+static void smmu_fault_push(const smmu_fault* fault){
+	if (smmu_fault_head - smmu_fault_tail >= SMMU_FAULT_QUEUE_SIZE){
+		smmu_fault_counters.dropped++;
+		return;
+	}
+	smmu_fault_queue[smmu_fault_head & (SMMU_FAULT_QUEUE_SIZE - 1)] = *fault;
+	dsb();
+	smmu_fault_head++;
+}
+
+int smmu_fault_pop(smmu_fault* fault){
+	if (smmu_fault_tail == smmu_fault_head){
+		return XST_FAILURE;
+	}
+	*fault = smmu_fault_queue[smmu_fault_tail & (SMMU_FAULT_QUEUE_SIZE - 1)];
+	dsb();
+	smmu_fault_tail++;
+	return XST_SUCCESS;
+}
+
+/* Captures and resolves the fault reported by the context bank, if any.
+ * Returns 1 if a fault has been serviced, 0 otherwise.
+ */
+int smmu_fault_service(u8 cb){
+	u32 fsr = Xil_In32(SMMU_CBn_FSR_base + cb*CBn_offset);
+	smmu_fault_hook* hook = &smmu_fault_hooks[cb];
+	smmu_fault fault = {0};
+	XTime endTime;
+
+	if ((fsr & (FIELD_MASK(FSR_FAULTS) | FIELD_MASK(FSR_SS))) == 0){
+		return 0;
+	}
+
+	XTime_GetTime(&fault.timestamp);
+	fault.cb = cb;
+	fault.fsr = fsr;
+	fault.stalled = FIELD_GET(FSR_SS, fsr);
+	fault.fsynr0 = Xil_In32(SMMU_CBn_FSYNR0_base + cb*CBn_offset);
+	fault.write = FIELD_GET(FSYNR0_WNR, fault.fsynr0);
+	fault.far = Xil_In64(SMMU_CB0_FAR_low_base + cb*CBn_offset);
+
+	fault.action = hook->handler != NULL ? hook->handler(&fault, hook->arg) : SMMU_FAULT_TERMINATE;
+
+	// clear the fault bits first: SS is cleared by the resume, which is ignored once SS is 0
+	Xil_Out32(SMMU_CBn_FSR_base + cb*CBn_offset, fsr & ~FIELD_MASK(FSR_SS));
+	if (fault.stalled){
+		resume_CBn(cb, fault.action);
+	}
+
+	XTime_GetTime(&endTime);
+	fault.resume_counts = endTime - fault.timestamp;
+
+	smmu_fault_counters.faults++;
+	if (fault.action == SMMU_FAULT_RETRY){
+		smmu_fault_counters.retried++;
+	}
+	else {
+		smmu_fault_counters.terminated++;
+	}
+	smmu_fault_counters.last_resume_counts = fault.resume_counts;
+	smmu_fault_counters.total_resume_counts += fault.resume_counts;
+	if (fault.resume_counts > smmu_fault_counters.max_resume_counts){
+		smmu_fault_counters.max_resume_counts = fault.resume_counts;
+	}
+
+	smmu_fault_push(&fault);
+	return 1;
+}
+
+// Services the faults of all the context banks, returns the number of faults serviced
+u32 smmu_fault_service_all(void){
+	u32 n_faults = 0;
+
+	for (int i=0; i<N_CBs; i++){
+		n_faults += smmu_fault_service(i);
+	}
+	return n_faults;
+}
+
+void smmu_fault_get_stats(smmu_fault_stats* stats){
+	*stats = smmu_fault_counters;
+}
@@ -0,0 +1,53 @@
+#ifndef __SMMU_FAULT_H_
+#define __SMMU_FAULT_H_
+
+#include "smmu_driver.h"
+
+/* Context fault handling.
+ * With SMMU_sCR0.STALLD = 0 and SMMU_CBn_SCTLR.CFCFG = 1 (smmu_fault_enable_stall) a faulting transaction is
+ * held by the SMMU instead of being aborted. smmu_fault_service captures the fault of a context bank into
+ * the fault queue, calls the handler of the bank, which can install the missing mapping, and resumes the
+ * stalled transaction: retried if the handler returns SMMU_FAULT_RETRY, terminated otherwise.
+ * Faults of banks without a handler are terminated. smmu_fault_service_all is meant for the SMMU interrupt.
+ */
+
+#define SMMU_FAULT_QUEUE_SIZE     32 // power of 2
+
+typedef enum {
+	SMMU_FAULT_RETRY = 0,
+	SMMU_FAULT_TERMINATE = 1
+} smmu_fault_action;
+
+typedef struct {
+	u8    cb;
+	u8    stalled;   // FSR.SS: the transaction waits for CBn_RESUME
+	u8    write;     // FSYNR0.WNR
+	u8    action;    // smmu_fault_action applied
+	u32   fsr;
+	u32   fsynr0;
+	u32   reserved;
+	u64   far;       // faulting input address
+	XTime timestamp; // capture time
+	XTime resume_counts; // capture to resume, in XTime counts
+} smmu_fault;
+
+typedef smmu_fault_action (*smmu_fault_handler)(const smmu_fault* fault, void* arg);
+
+typedef struct {
+	u32 faults;
+	u32 retried;
+	u32 terminated;
+	u32 dropped;     // faults not queued because the queue was full
+	XTime last_resume_counts;
+	XTime max_resume_counts;
+	XTime total_resume_counts;
+} smmu_fault_stats;
+
+void smmu_fault_enable_stall(u8 cb, u8 enable);
+void smmu_fault_set_handler(u8 cb, smmu_fault_handler handler, void* arg);
+int smmu_fault_service(u8 cb);
+u32 smmu_fault_service_all(void);
+int smmu_fault_pop(smmu_fault* fault);
+void smmu_fault_get_stats(smmu_fault_stats* stats);
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef __SMMU_FIELDS_H_
+#define __SMMU_FIELDS_H_
+
+/* Register field layout of the SMMU registers and of the aarch32 lpae descriptors.
+ * Each FIELD(register, field, lsb, width) entry expands into the compile-time constants
+ * <register>_<field>_SHIFT and <register>_<field>_WIDTH, used by:
+ *   FIELD_MASK(f):     mask of the field in the register
+ *   FIELD_PREP(f, v):  v placed in the field (extra bits of v are dropped)
+ *   FIELD_GET(f, r):   value of the field in r
+ * so a whole register value is composed in one constant-folded expression, e.g.
+ *   FIELD_PREP(SMR_VALID, 1) | FIELD_PREP(SMR_MASK, mask) | FIELD_PREP(SMR_ID, stream_id)
+ */
+
+#define SMMU_REGISTER_FIELDS(FIELD) \
+	/* sCR0 */ \
+	FIELD(SCR0, CLIENTPD,   0,  1) \
+	FIELD(SCR0, GFRE,       1,  1) \
+	FIELD(SCR0, GFIE,       2,  1) \
+	FIELD(SCR0, STALLD,     8,  1) \
+	FIELD(SCR0, USFCFG,    10,  1) \
+	FIELD(SCR0, SMCFCFG,   21,  1) \
+	/* sCR1 */ \
+	FIELD(SCR1, NSNUMCBO,   0,  5) \
+	FIELD(SCR1, NSNUMSMRGO, 8,  6) \
+	/* SMRn: stream id is TBU number [14:10], master id [9:0] */ \
+	FIELD(SMR, MID,         0, 10) \
+	FIELD(SMR, TBU,        10,  5) \
+	FIELD(SMR, ID,          0, 15) \
+	FIELD(SMR, MASK,       16, 15) \
+	FIELD(SMR, VALID,      31,  1) \
+	/* S2CRn */ \
+	FIELD(S2CR, CBNDX,      0,  8) \
+	FIELD(S2CR, TYPE,      16,  2) \
+	/* CBARn */ \
+	FIELD(CBAR, VMID,       0,  8) \
+	FIELD(CBAR, CBNDX,      8,  8) \
+	FIELD(CBAR, TYPE,      16,  2) \
+	/* CBA2Rn */ \
+	FIELD(CBA2R, VA64,      0,  1) \
+	/* CBn_SCTLR */ \
+	FIELD(SCTLR, M,         0,  1) \
+	FIELD(SCTLR, TRE,       1,  1) \
+	FIELD(SCTLR, AFE,       2,  1) \
+	FIELD(SCTLR, AFFD,      3,  1) \
+	FIELD(SCTLR, E,         4,  1) \
+	FIELD(SCTLR, CFRE,      5,  1) \
+	FIELD(SCTLR, CFIE,      6,  1) \
+	FIELD(SCTLR, CFCFG,     7,  1) \
+	FIELD(SCTLR, HUPCF,     8,  1) \
+	FIELD(SCTLR, ASIDPNE,  12,  1) \
+	/* CBn_TCR, aarch32 lpae stage 1 */ \
+	FIELD(TCR, T0SZ,        0,  3) \
+	FIELD(TCR, EPD0,        7,  1) \
+	FIELD(TCR, IRGN0,       8,  2) \
+	FIELD(TCR, ORGN0,      10,  2) \
+	FIELD(TCR, SH0,        12,  2) \
+	FIELD(TCR, T1SZ,       16,  3) \
+	FIELD(TCR, A1,         22,  1) \
+	FIELD(TCR, EPD1,       23,  1) \
+	FIELD(TCR, EAE,        31,  1) \
+	/* CBn_TCR, aarch32 lpae stage 2 */ \
+	FIELD(TCR_S2, T0SZ,     0,  4) \
+	FIELD(TCR_S2, SL0,      6,  2) \
+	/* CBn_TCR, aarch64 stage 1 */ \
+	FIELD(TCR64, T0SZ,      0,  6) \
+	FIELD(TCR64, TG0,      14,  2) \
+	FIELD(TCR64, T1SZ,     16,  6) \
+	/* CBn_TCR2 */ \
+	FIELD(TCR2, PASIZE,     0,  3) \
+	FIELD(TCR2, TBI0,       5,  1) \
+	/* CBn_TTBR0, aarch32 lpae: base address [39:x], ASID [55:48] */ \
+	FIELD(TTBR, ADDR,       0, 40) \
+	FIELD(TTBR, ASID,      48,  8) \
+	FIELD(TTBR64, ASID,    48, 16) \
+	/* CBn_PAR, long-descriptor format: F [0], PA [39:12] */ \
+	FIELD(PAR, F,           0,  1) \
+	FIELD(PAR, PA,         12, 28) \
+	/* CBn_ATSR */ \
+	FIELD(ATSR, ACTIVE,     0,  1) \
+	/* CBn_FSR: fault bits [8:1] are write 1 to clear, SS is cleared by a write to CBn_RESUME */ \
+	FIELD(FSR, TF,          1,  1) \
+	FIELD(FSR, AFF,         2,  1) \
+	FIELD(FSR, PF,          3,  1) \
+	FIELD(FSR, EF,          4,  1) \
+	FIELD(FSR, TLBMCF,      5,  1) \
+	FIELD(FSR, TLBLKF,      6,  1) \
+	FIELD(FSR, ASF,         7,  1) \
+	FIELD(FSR, UUT,         8,  1) \
+	FIELD(FSR, FAULTS,      1,  8) \
+	FIELD(FSR, SS,         30,  1) \
+	FIELD(FSR, MULTI,      31,  1) \
+	/* CBn_FSYNR0 */ \
+	FIELD(FSYNR0, PLVL,     0,  2) \
+	FIELD(FSYNR0, WNR,      4,  1) \
+	/* CBn_RESUME */ \
+	FIELD(RESUME, TNR,      0,  1) \
+	/* sGFSR, sGFSYNR1 */ \
+	FIELD(SGFSR, ICF,       0,  1) \
+	FIELD(SGFSR, USF,       1,  1) \
+	FIELD(SGFSR, SMCF,      2,  1) \
+	FIELD(SGFSYNR1, SID,    0, 15) \
+	/* CBFRSYNRAn: stream id of the last context fault of bank n */ \
+	FIELD(CBFRSYNRA, SID,   0, 15) \
+	/* lpae block/page/table descriptor */ \
+	FIELD(DESC, VALID,      0,  1) \
+	FIELD(DESC, TYPE,       1,  1) \
+	FIELD(DESC, ATTRINDX,   2,  3) \
+	FIELD(DESC, NS,         5,  1) \
+	FIELD(DESC, AP,         6,  2) \
+	FIELD(DESC, SH,         8,  2) \
+	FIELD(DESC, AF,        10,  1) \
+	FIELD(DESC, NG,        11,  1) \
+	FIELD(DESC, OA,        12, 28) \
+	FIELD(DESC, CONT,      52,  1) \
+	FIELD(DESC, PXN,       53,  1) \
+	FIELD(DESC, XN,        54,  1) \
+	/* lpae stage 2 block/page descriptor */ \
+	FIELD(DESC, MEMATTR,    2,  4) \
+	FIELD(DESC, S2AP,       6,  2)
+
+#define SMMU_FIELD_CONSTANTS(reg, field, lsb, width) \
+	reg##_##field##_SHIFT = (lsb), \
+	reg##_##field##_WIDTH = (width),
+
+enum smmu_register_fields { SMMU_REGISTER_FIELDS(SMMU_FIELD_CONSTANTS) };
+
+#define FIELD_MASK(f)       (((1ULL << f##_WIDTH) - 1) << f##_SHIFT)
+#define FIELD_PREP(f, v)    (((u64)(v) << f##_SHIFT) & FIELD_MASK(f))
+#define FIELD_GET(f, r)     (((u64)(r) & FIELD_MASK(f)) >> f##_SHIFT)
+
+#endif
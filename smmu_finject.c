@@ -0,0 +1,141 @@
+#include "smmu_finject.h"
+
+// written by the application before the transaction starts, by the interrupt handler after
+static volatile u8 smmu_finject_pending;
+static smmu_finject_kind smmu_finject_expected;
+static u8 smmu_finject_cb;
+static XTime smmu_finject_submit;
+static smmu_finject_stats smmu_finject_counters[SMMU_FINJECT_KINDS];
+
+static void dist_add(smmu_finject_dist* dist, XTime counts){
+	u8 bucket = 0;
+
+	while (bucket < SMMU_FINJECT_BUCKETS - 1 && (counts >> bucket) != 0){
+		bucket++;
+	}
+	if (dist->samples == 0 || counts < dist->min){
+		dist->min = counts;
+	}
+	if (counts > dist->max){
+		dist->max = counts;
+	}
+	dist->total += counts;
+	dist->histogram[bucket]++;
+	dist->samples++;
+}
+
+// Arms the fault expected from the next transaction, the submission time is now
+void smmu_finject_arm(smmu_finject_kind kind, u8 cb){
+	smmu_finject_expected = kind;
+	smmu_finject_cb = cb;
+	smmu_finject_counters[kind].injected++;
+	XTime_GetTime(&smmu_finject_submit);
+	dsb();
+	smmu_finject_pending = 1;
+}
+
+/* Decodes and clears the fault, for the SMMU interrupt handler.
+ * Returns the kind of the decoded fault, -1 if there was no armed injection.
+ */
+int smmu_finject_isr(void){
+	smmu_finject_stats* stats;
+	XTime entry, decoded, cleared;
+	u32 sgfsr, fsr = 0;
+	int kind = -1;
+	u8 cb = 0;
+
+	XTime_GetTime(&entry);
+	if (!smmu_finject_pending){
+		return -1;
+	}
+	stats = &smmu_finject_counters[smmu_finject_expected];
+
+	// decode: global faults first, then the context banks in order
+	sgfsr = Xil_In32(SMMU_SGFSR);
+	if (FIELD_GET(SGFSR_USF, sgfsr)){
+		kind = SMMU_FINJECT_UNIDENTIFIED;
+	}
+	else {
+		for (cb=0; cb<N_CBs; cb++){
+			fsr = Xil_In32(SMMU_CBn_FSR_base + cb*CBn_offset);
+			if (fsr & FIELD_MASK(FSR_FAULTS)){
+				break;
+			}
+		}
+		if (FIELD_GET(FSR_TF, fsr)){
+			kind = SMMU_FINJECT_UNMAPPED;
+		}
+		else if (FIELD_GET(FSR_PF, fsr)){
+			kind = SMMU_FINJECT_PERMISSION;
+		}
+	}
+	XTime_GetTime(&decoded);
+
+	// clear: write 1 to clear, then the SMMU_REG interrupt status
+	if (sgfsr != 0){
+		Xil_Out32(SMMU_SGFSR, sgfsr);
+	}
+	if (cb < N_CBs && fsr != 0){
+		Xil_Out32(SMMU_CBn_FSR_base + cb*CBn_offset, fsr & ~FIELD_MASK(FSR_SS));
+	}
+	Xil_Out32(SMMU_REG_ISR0, 0xFFFFFFFF);
+	XTime_GetTime(&cleared);
+
+	if (kind == smmu_finject_expected && (kind == SMMU_FINJECT_UNIDENTIFIED || cb == smmu_finject_cb)){
+		stats->caught++;
+		dist_add(&stats->phase[SMMU_FINJECT_ENTRY], entry - smmu_finject_submit);
+		dist_add(&stats->phase[SMMU_FINJECT_DECODE], decoded - entry);
+		dist_add(&stats->phase[SMMU_FINJECT_CLEAR], cleared - decoded);
+		dist_add(&stats->phase[SMMU_FINJECT_TOTAL], cleared - smmu_finject_submit);
+	}
+	else {
+		stats->unexpected++;
+	}
+	dsb();
+	smmu_finject_pending = 0;
+
+	return kind;
+}
+
+// Waits for the armed fault to be serviced, at most timeout_counts XTime counts
+int smmu_finject_wait(XTime timeout_counts){
+	XTime start, now;
+
+	XTime_GetTime(&start);
+	do {
+		if (!smmu_finject_pending){
+			return XST_SUCCESS;
+		}
+		XTime_GetTime(&now);
+	} while (now - start < timeout_counts);
+
+	smmu_finject_counters[smmu_finject_expected].timeouts++;
+	smmu_finject_pending = 0;
+	return XST_FAILURE;
+}
+
+void smmu_finject_get_stats(smmu_finject_kind kind, smmu_finject_stats* stats){
+	*stats = smmu_finject_counters[kind];
+}
+
+void smmu_finject_reset_stats(void){
+	for (int k=0; k<SMMU_FINJECT_KINDS; k++){
+		smmu_finject_counters[k] = (smmu_finject_stats){0};
+	}
+}
+
+// Upper bound in counts of the bucket holding the percentile
+XTime smmu_finject_percentile(const smmu_finject_dist* dist, u8 percent){
+	u32 target = (dist->samples*percent + 99) / 100;
+	u32 seen = 0;
+
+	for (int b=0; b<SMMU_FINJECT_BUCKETS; b++){
+		seen += dist->histogram[b];
+		if (seen >= target && seen > 0){
+			XTime bound = ((XTime)1 << b) - 1;
+
+			return b == SMMU_FINJECT_BUCKETS - 1 || bound > dist->max ? dist->max : bound;
+		}
+	}
+	return dist->max;
+}
@@ -0,0 +1,56 @@
+#ifndef __SMMU_FINJECT_H_
+#define __SMMU_FINJECT_H_
+
+#include "smmu_driver.h"
+
+/* Fault injection and fault latency.
+ * The application arms an expected fault with smmu_finject_arm right before starting the transaction that
+ * raises it (a master writing to an unmapped or read-only page of its bank, or a master without a valid SMR
+ * with SMMU_sCR0.USFCFG = 1). smmu_finject_isr, first call of the SMMU interrupt handler, decodes the fault as
+ * a generic handler does (sGFSR, then the FSR of each context bank), clears it and records the time of each
+ * phase: submission to ISR entry, entry to decoded, decoded to cleared, and submission to cleared.
+ * Each phase is kept as a distribution: min, max, mean and a log2 histogram of the XTime counts.
+ * The faults are terminated (SMMU_CBn_SCTLR.CFCFG = 0): the master gets an abort and must be reset.
+ */
+
+#define SMMU_FINJECT_BUCKETS      24 // bucket b holds the samples of 2^(b-1) to 2^b - 1 counts
+
+typedef enum {
+	SMMU_FINJECT_UNMAPPED = 0,     // translation fault, FSR.TF
+	SMMU_FINJECT_PERMISSION = 1,   // permission fault, FSR.PF
+	SMMU_FINJECT_UNIDENTIFIED = 2, // unidentified stream fault, sGFSR.USF
+	SMMU_FINJECT_KINDS
+} smmu_finject_kind;
+
+typedef enum {
+	SMMU_FINJECT_ENTRY = 0,  // submission to ISR entry
+	SMMU_FINJECT_DECODE = 1, // ISR entry to fault decoded
+	SMMU_FINJECT_CLEAR = 2,  // decoded to fault cleared
+	SMMU_FINJECT_TOTAL = 3,  // submission to fault cleared
+	SMMU_FINJECT_PHASES
+} smmu_finject_phase;
+
+typedef struct {
+	u32   samples;
+	XTime min;
+	XTime max;
+	XTime total;
+	u32   histogram[SMMU_FINJECT_BUCKETS];
+} smmu_finject_dist;
+
+typedef struct {
+	u32 injected;
+	u32 caught;      // the expected fault, on the expected context bank
+	u32 unexpected;  // another fault was decoded
+	u32 timeouts;    // no interrupt in the time allowed
+	smmu_finject_dist phase[SMMU_FINJECT_PHASES];
+} smmu_finject_stats;
+
+void smmu_finject_arm(smmu_finject_kind kind, u8 cb);
+int smmu_finject_isr(void);
+int smmu_finject_wait(XTime timeout_counts);
+void smmu_finject_get_stats(smmu_finject_kind kind, smmu_finject_stats* stats);
+void smmu_finject_reset_stats(void);
+XTime smmu_finject_percentile(const smmu_finject_dist* dist, u8 percent);
+
+#endif
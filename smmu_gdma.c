@@ -0,0 +1,189 @@
+#include "xparameters.h"
+#include "smmu_gdma.h"
+
+#define SMMU_GDMA_DESC_BYTES      (2*SMMU_GDMA_MAX_LIST*SMMU_GDMA_DESC_SIZE)
+
+typedef struct {
+	XZDma inst;
+	u8    ready;
+	u8    sg;   // the channel is in linked list mode
+	u8    cb;   // bank whose tree maps the descriptors, N_CBs if none
+	u8    reserved;
+	u32   isr;  // CH_ISR of the last transfer, cleared at its start
+} smmu_gdma_channel;
+
+static const u16 smmu_gdma_device_ids[SMMU_GDMA_CHANNELS] = {
+	XPAR_PSU_GDMA_0_DEVICE_ID, XPAR_PSU_GDMA_1_DEVICE_ID, XPAR_PSU_GDMA_2_DEVICE_ID, XPAR_PSU_GDMA_3_DEVICE_ID,
+	XPAR_PSU_GDMA_4_DEVICE_ID, XPAR_PSU_GDMA_5_DEVICE_ID, XPAR_PSU_GDMA_6_DEVICE_ID, XPAR_PSU_GDMA_7_DEVICE_ID
+};
+
+static smmu_gdma_channel smmu_gdma_channels[SMMU_GDMA_CHANNELS];
+
+// descriptor buffers, a page each: mapped flat in the bank of the channel
+static u8 smmu_gdma_desc[SMMU_GDMA_CHANNELS][GRANULARITY] __attribute__((aligned(GRANULARITY)));
+
+u16 smmu_gdma_stream_id(u8 ch){
+	return FIELD_PREP(SMR_TBU, SMMU_GDMA_TBU) | FIELD_PREP(SMR_MID, SMMU_GDMA_MID_BASE + ch);
+}
+
+int smmu_gdma_init(u8 ch){
+	smmu_gdma_channel* channel;
+	XZDma_Config* config;
+
+	if (ch >= SMMU_GDMA_CHANNELS){
+		return XST_FAILURE;
+	}
+	channel = &smmu_gdma_channels[ch];
+
+	config = XZDma_LookupConfig(smmu_gdma_device_ids[ch]);
+	if (config == NULL || XZDma_CfgInitialize(&channel->inst, config, config->BaseAddress) != XST_SUCCESS){
+		xil_printf("Error, cannot initialize GDMA channel %d\n\r", ch);
+		return XST_FAILURE;
+	}
+	XZDma_SetMode(&channel->inst, FALSE, XZDMA_NORMAL_MODE);
+	channel->sg = 0;
+	channel->cb = N_CBs;
+	channel->ready = 1;
+
+	return XST_SUCCESS;
+}
+
+// Routes the stream of the channel: type TRANSLATION_CB to the context bank cb, or BYPASS
+int smmu_gdma_attach(u8 ch, enum s2cr_type type, u8 cb){
+	smmu_gdma_channel* channel;
+
+	if (ch >= SMMU_GDMA_CHANNELS || !smmu_gdma_channels[ch].ready){
+		return XST_FAILURE;
+	}
+	channel = &smmu_gdma_channels[ch];
+
+	if (type == TRANSLATION_CB && smmu_pt_root(cb) != NULL){
+		if (smmu_map(cb, (UINTPTR)smmu_gdma_desc[ch], (UINTPTR)smmu_gdma_desc[ch], GRANULARITY, SMMU_PT_ATTR_RW) != XST_SUCCESS){
+			return XST_FAILURE;
+		}
+		channel->cb = cb;
+	}
+
+	if (smmu_smr_attach(smmu_gdma_stream_id(ch), 0x0, type, cb) != XST_SUCCESS){
+		if (channel->cb != N_CBs){
+			smmu_unmap(channel->cb, (UINTPTR)smmu_gdma_desc[ch], GRANULARITY);
+			channel->cb = N_CBs;
+		}
+		return XST_FAILURE;
+	}
+	return XST_SUCCESS;
+}
+
+void smmu_gdma_detach(u8 ch){
+	smmu_gdma_channel* channel;
+
+	if (ch >= SMMU_GDMA_CHANNELS || !smmu_gdma_channels[ch].ready){
+		return;
+	}
+	channel = &smmu_gdma_channels[ch];
+
+	smmu_smr_detach(smmu_gdma_stream_id(ch));
+	if (channel->cb != N_CBs){
+		smmu_unmap(channel->cb, (UINTPTR)smmu_gdma_desc[ch], GRANULARITY);
+		channel->cb = N_CBs;
+	}
+}
+
+// Programs the mode of the channel whatever it was set to before (after a reset the controller lost it)
+static int smmu_gdma_program_mode(smmu_gdma_channel* channel, u8 ch, u8 sg){
+	if (XZDma_SetMode(&channel->inst, sg, XZDMA_NORMAL_MODE) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+	if (sg){
+		XZDma_CreateBDList(&channel->inst, XZDMA_LINKEDLIST, (UINTPTR)smmu_gdma_desc[ch], SMMU_GDMA_DESC_BYTES);
+	}
+	channel->sg = sg;
+
+	return XST_SUCCESS;
+}
+
+static int smmu_gdma_set_mode(smmu_gdma_channel* channel, u8 ch, u8 sg){
+	if (channel->sg == sg){
+		return XST_SUCCESS;
+	}
+	return smmu_gdma_program_mode(channel, ch, sg);
+}
+
+// Simple mode transfer, not waited for
+int smmu_gdma_transfer(u8 ch, UINTPTR src, UINTPTR dst, u32 size){
+	XZDma_Transfer data = {src, dst, size, 0, 0, 0};
+	smmu_gdma_channel* channel;
+
+	if (ch >= SMMU_GDMA_CHANNELS || !smmu_gdma_channels[ch].ready){
+		return XST_FAILURE;
+	}
+	channel = &smmu_gdma_channels[ch];
+
+	if (smmu_gdma_set_mode(channel, ch, 0) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+	channel->isr = 0;
+	return XZDma_Start(&channel->inst, &data, 1);
+}
+
+// Linked list of n transfers (at most SMMU_GDMA_MAX_LIST), not waited for
+int smmu_gdma_transfer_list(u8 ch, XZDma_Transfer* list, u32 n){
+	smmu_gdma_channel* channel;
+
+	if (ch >= SMMU_GDMA_CHANNELS || !smmu_gdma_channels[ch].ready || n == 0 || n > SMMU_GDMA_MAX_LIST){
+		return XST_FAILURE;
+	}
+	channel = &smmu_gdma_channels[ch];
+
+	if (smmu_gdma_set_mode(channel, ch, 1) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+	channel->isr = 0;
+	return XZDma_Start(&channel->inst, list, n);
+}
+
+/* Returns 1 while the channel transfers; on completion the status is cleared as the channel interrupt handler
+ * would, and kept for smmu_gdma_errors: the channel can be polled again after its completion.
+ */
+int smmu_gdma_busy(u8 ch){
+	smmu_gdma_channel* channel;
+
+	if (ch >= SMMU_GDMA_CHANNELS || !smmu_gdma_channels[ch].ready){
+		return 0;
+	}
+	channel = &smmu_gdma_channels[ch];
+
+	if (XZDma_ChannelState(&channel->inst) == XZDMA_BUSY){
+		return 1;
+	}
+	channel->isr |= XZDma_ReadReg(channel->inst.Config.BaseAddress, XZDMA_CH_ISR_OFFSET);
+	XZDma_WriteReg(channel->inst.Config.BaseAddress, XZDMA_CH_ISR_OFFSET, XZDMA_IXR_ALL_INTR_MASK);
+	channel->inst.ChannelState = XZDMA_IDLE;
+
+	return 0;
+}
+
+// AXI errors of the last completed transfer, 0 if it went through or the channel is not initialized
+u32 smmu_gdma_errors(u8 ch){
+	if (ch >= SMMU_GDMA_CHANNELS || !smmu_gdma_channels[ch].ready){
+		return 0;
+	}
+	return smmu_gdma_channels[ch].isr & SMMU_GDMA_AXI_ERRORS;
+}
+
+// Aborts the transfer of the channel: the channel is back in simple mode, its stream and bank unchanged
+int smmu_gdma_reset(u8 ch){
+	smmu_gdma_channel* channel;
+
+	if (ch >= SMMU_GDMA_CHANNELS || !smmu_gdma_channels[ch].ready){
+		return XST_FAILURE;
+	}
+	channel = &smmu_gdma_channels[ch];
+
+	XZDma_Reset(&channel->inst);
+	XZDma_WriteReg(channel->inst.Config.BaseAddress, XZDMA_CH_ISR_OFFSET, XZDMA_IXR_ALL_INTR_MASK);
+	channel->inst.ChannelState = XZDMA_IDLE;
+	channel->isr = 0;
+
+	return smmu_gdma_program_mode(channel, ch, 0);
+}
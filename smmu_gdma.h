@@ -0,0 +1,36 @@
+#ifndef __SMMU_GDMA_H_
+#define __SMMU_GDMA_H_
+
+#include "xzdma.h"
+#include "smmu_pgtable.h"
+#include "smmu_smr.h"
+
+/* FPD DMA (GDMA) channels behind the SMMU.
+ * Channel n issues the stream id TBU5 | MID 0xE8 + n. smmu_gdma_attach routes the stream of a channel to a
+ * context bank (or to bypass) through the SMRs of smmu_smr.c, which must be initialized, and maps the
+ * descriptor buffer of the channel flat when the bank has a table tree attached (smmu_pt_attach): in linked
+ * list mode the channel fetches its descriptors through its own stream, at the CPU address of the buffer.
+ * The transfer addresses are IOVAs of the bank of the channel. Completion is polled with smmu_gdma_busy,
+ * smmu_gdma_errors then reports the AXI errors of the transfer (a fault aborted by the SMMU is one); see
+ * smmu_dma_wait_gdma (smmu_dma.h) for a wait bounded in time.
+ */
+
+#define SMMU_GDMA_CHANNELS        8
+#define SMMU_GDMA_TBU             0x5
+#define SMMU_GDMA_MID_BASE        0xE8
+#define SMMU_GDMA_MAX_LIST        32 // transfers of a linked list
+#define SMMU_GDMA_DESC_SIZE       32 // linked list descriptor, one for the source and one for the destination
+#define SMMU_GDMA_AXI_ERRORS      (XZDMA_IXR_AXI_WR_DATA_MASK | XZDMA_IXR_AXI_RD_DATA_MASK | \
+                                   XZDMA_IXR_AXI_RD_DST_DSCR_MASK | XZDMA_IXR_AXI_RD_SRC_DSCR_MASK)
+
+u16 smmu_gdma_stream_id(u8 ch);
+int smmu_gdma_init(u8 ch);
+int smmu_gdma_attach(u8 ch, enum s2cr_type type, u8 cb);
+void smmu_gdma_detach(u8 ch);
+int smmu_gdma_transfer(u8 ch, UINTPTR src, UINTPTR dst, u32 size);
+int smmu_gdma_transfer_list(u8 ch, XZDma_Transfer* list, u32 n);
+int smmu_gdma_busy(u8 ch);
+u32 smmu_gdma_errors(u8 ch);
+int smmu_gdma_reset(u8 ch);
+
+#endif
@@ -0,0 +1,255 @@
+#include "smmu_iova.h"
+
+#define SMMU_IOVA_BLOCK_PAGES     (SMMU_PT_BLOCK_2MB / GRANULARITY)
+
+typedef struct {
+	u8  used;
+	u8  cb;
+	u16 reserved;
+	u32 base;
+	u32 n_pages;
+	u32 n_stale;     // deferred unmaps waiting for the flush
+	u8  busy[SMMU_IOVA_WINDOW_PAGES / 8]; // one bit per page of the window
+	u8  stale[SMMU_IOVA_WINDOW_PAGES / 8]; // unmapped pages kept busy until the TLB invalidation
+} smmu_iova_window;
+
+static smmu_iova_window smmu_iova_windows[SMMU_IOVA_MAX_WINDOWS];
+static smmu_iova_stats smmu_iova_counters;
+
+static smmu_iova_window* smmu_iova_find(u8 cb){
+	for (int i=0; i<SMMU_IOVA_MAX_WINDOWS; i++){
+		if (smmu_iova_windows[i].used && smmu_iova_windows[i].cb == cb){
+			return &smmu_iova_windows[i];
+		}
+	}
+	return NULL;
+}
+
+static int page_busy(smmu_iova_window* window, u32 page){
+	return (window->busy[page / 8] >> (page % 8)) & 0x1;
+}
+
+static void set_bits(u8* bitmap, u32 first, u32 n, u8 value){
+	for (u32 page=first; page<first + n; page++){
+		if (value){
+			bitmap[page / 8] |= 1U << (page % 8);
+		}
+		else {
+			bitmap[page / 8] &= ~(1U << (page % 8));
+		}
+	}
+}
+
+static void set_pages(smmu_iova_window* window, u32 first, u32 n, u8 busy){
+	set_bits(window->busy, first, n, busy);
+}
+
+// first free run of n pages starting at skew + a multiple of align, -1 if there is none
+static int find_pages(smmu_iova_window* window, u32 n, u32 align, u32 skew){
+	for (u32 first=skew; first + n <= window->n_pages; first+=align){
+		u32 page = first;
+
+		while (page < first + n && !page_busy(window, page)){
+			page++;
+		}
+		if (page == first + n){
+			return first;
+		}
+	}
+	return -1;
+}
+
+// output address limit of the bank, from TCR2.PASize
+static u64 smmu_iova_pa_limit(u8 cb){
+	switch (FIELD_GET(TCR2_PASIZE, Xil_In32(SMMU_CBn_TCR2_base + cb*CBn_offset))){
+	case PA_32:
+		return 1ULL << 32;
+	case PA_36:
+		return 1ULL << 36;
+	default:
+		return SMMU_PT_PA_LIMIT;
+	}
+}
+
+// Reserves [base, base + size) of the context bank cb for the window, page aligned
+int smmu_iova_window_init(u8 cb, u32 base, u32 size){
+	if (((base | size) & (GRANULARITY - 1)) != 0 || size == 0 || size / GRANULARITY > SMMU_IOVA_WINDOW_PAGES ||
+			smmu_pt_root(cb) == NULL || smmu_iova_find(cb) != NULL){
+		xil_printf("Error, invalid IOVA window 0x%08X (0x%08X bytes) on CB%d\n\r", base, size, cb);
+		return XST_FAILURE;
+	}
+
+	for (int i=0; i<SMMU_IOVA_MAX_WINDOWS; i++){
+		smmu_iova_window* window = &smmu_iova_windows[i];
+
+		if (!window->used){
+			window->cb = cb;
+			window->base = base;
+			window->n_pages = size / GRANULARITY;
+			set_pages(window, 0, window->n_pages, 0);
+			set_bits(window->stale, 0, window->n_pages, 0);
+			window->n_stale = 0;
+			window->used = 1;
+			return XST_SUCCESS;
+		}
+	}
+
+	xil_printf("Error, no free IOVA windows\n\r");
+	return XST_FAILURE;
+}
+
+// Removes the mappings left in the window of cb and releases it
+void smmu_iova_window_destroy(u8 cb){
+	smmu_iova_window* window = smmu_iova_find(cb);
+
+	if (window == NULL){
+		return;
+	}
+	for (u32 page=0; page<window->n_pages; page++){
+		u32 n = 0;
+
+		while (page + n < window->n_pages && page_busy(window, page + n)){
+			n++;
+		}
+		if (n > 0){
+			smmu_unmap(cb, window->base + page*GRANULARITY, n*GRANULARITY);
+			page += n;
+		}
+	}
+	window->used = 0;
+}
+
+/* Maps [pa, pa + size) in the window of cb, *iova is the IOVA of pa. pa does not need to be page aligned:
+ * the pages around it are mapped and *iova keeps the offset in the page.
+ */
+int smmu_iova_window_map(u8 cb, u64 pa, u32 size, u64 attrs, u32* iova){
+	smmu_iova_window* window = smmu_iova_find(cb);
+	u64 pa_page = pa & ~(u64)(GRANULARITY - 1);
+	u32 n_pages = (u32)((pa + size - pa_page + GRANULARITY - 1) / GRANULARITY);
+	u32 align = 1;
+	int first;
+
+	if (window == NULL || size == 0){
+		return XST_FAILURE;
+	}
+	if (pa + size > smmu_iova_pa_limit(cb)){
+		xil_printf("Error, 0x%016llX is beyond the output address size of CB%d\n\r", pa, cb);
+		return XST_FAILURE;
+	}
+
+	if ((pa_page & (SMMU_PT_BLOCK_2MB - 1)) == 0 && (n_pages % SMMU_IOVA_BLOCK_PAGES) == 0){
+		align = SMMU_IOVA_BLOCK_PAGES;
+	}
+	// the window base need not be 2MB aligned: the IOVA is aligned, not the offset in the window
+	first = find_pages(window, n_pages, align, (align - (window->base / GRANULARITY) % align) % align);
+	if (first < 0 && align > 1){
+		align = 1;
+		first = find_pages(window, n_pages, 1, 0);
+	}
+	if (first < 0){
+		smmu_iova_counters.full++;
+		return XST_FAILURE;
+	}
+
+	if (smmu_map(cb, window->base + first*GRANULARITY, pa_page, n_pages*GRANULARITY, attrs) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+	set_pages(window, first, n_pages, 1);
+	if (align > 1){
+		smmu_iova_counters.block_maps++;
+	}
+	smmu_iova_counters.maps++;
+	*iova = window->base + first*GRANULARITY + (u32)(pa - pa_page);
+
+	return XST_SUCCESS;
+}
+
+// first page of a range returned by smmu_iova_window_map in its window, -1 if the range is not in it
+static int smmu_iova_range(smmu_iova_window* window, u32 iova, u32 size, u32* n_pages){
+	u32 iova_page = iova & ~(GRANULARITY - 1);
+
+	*n_pages = (iova + size - iova_page + GRANULARITY - 1) / GRANULARITY;
+	if (window == NULL || size == 0 || iova_page < window->base ||
+			(iova_page - window->base) / GRANULARITY + *n_pages > window->n_pages){
+		return -1;
+	}
+	return (iova_page - window->base) / GRANULARITY;
+}
+
+// Unmaps a range returned by smmu_iova_window_map, iova and size as mapped
+int smmu_iova_window_unmap(u8 cb, u32 iova, u32 size){
+	smmu_iova_window* window = smmu_iova_find(cb);
+	u32 iova_page = iova & ~(GRANULARITY - 1);
+	u32 n_pages;
+	int first = smmu_iova_range(window, iova, size, &n_pages);
+
+	if (first < 0){
+		return XST_FAILURE;
+	}
+
+	if (smmu_unmap(cb, iova_page, n_pages*GRANULARITY) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+	set_pages(window, first, n_pages, 0);
+	smmu_iova_counters.unmaps++;
+
+	return XST_SUCCESS;
+}
+
+/* Unmaps a range without TLB maintenance: its pages stay allocated until smmu_iova_window_flush, so that no
+ * new mapping takes the IOVAs while the TLB can still hold the old translation. The next level tables stay
+ * linked. For masters that are done with the range: a stale TLB entry can still be used until the flush.
+ */
+int smmu_iova_window_unmap_deferred(u8 cb, u32 iova, u32 size){
+	smmu_iova_window* window = smmu_iova_find(cb);
+	u32 n_pages;
+	int first = smmu_iova_range(window, iova, size, &n_pages);
+
+	if (first < 0){
+		return XST_FAILURE;
+	}
+
+	if (smmu_pt_unmap_keep_tables(smmu_pt_root(cb), window->base + first*GRANULARITY, n_pages*GRANULARITY) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+	set_bits(window->stale, first, n_pages, 1);
+	window->n_stale++;
+	smmu_iova_counters.deferred_unmaps++;
+
+	return XST_SUCCESS;
+}
+
+// Invalidates the TLB of the bank once for the deferred unmaps and releases their pages, returns their number
+u32 smmu_iova_window_flush(u8 cb){
+	smmu_iova_window* window = smmu_iova_find(cb);
+	u32 n_stale;
+
+	if (window == NULL || window->n_stale == 0){
+		return 0;
+	}
+
+	invalidate_CBn_by_TLBIALL(cb);
+	sync_CBn_TLB(cb);
+	smmu_tcache_invalidate_cb(cb);
+
+	for (u32 i=0; i<(window->n_pages + 7) / 8; i++){
+		window->busy[i] &= ~window->stale[i];
+		window->stale[i] = 0;
+	}
+	n_stale = window->n_stale;
+	window->n_stale = 0;
+	smmu_iova_counters.flushes++;
+
+	return n_stale;
+}
+
+// Deferred unmaps of the window of cb waiting for smmu_iova_window_flush
+u32 smmu_iova_window_pending(u8 cb){
+	smmu_iova_window* window = smmu_iova_find(cb);
+
+	return window != NULL ? window->n_stale : 0;
+}
+
+void smmu_iova_get_stats(smmu_iova_stats* stats){
+	*stats = smmu_iova_counters;
+}
@@ -0,0 +1,39 @@
+#ifndef __SMMU_IOVA_H_
+#define __SMMU_IOVA_H_
+
+#include "smmu_pgtable.h"
+
+/* IOVA windows: masters with a 32-bit address bus reach the 40-bit physical space (DDR high at
+ * 0x8_0000_0000) through a 32-bit IOVA range of their context bank, instead of a bounce buffer in DDR low.
+ * smmu_iova_window_init reserves [base, base + size) of a bank; smmu_iova_window_map allocates an IOVA range
+ * in the window and maps it onto a physical range with smmu_map, smmu_iova_window_unmap removes the mapping
+ * and releases the range. The allocation is first fit over the pages of the window: a physical range that
+ * is 2MB aligned and a multiple of 2MB gets a 2MB aligned IOVA range, mapped with blocks.
+ * smmu_iova_window_unmap_deferred leaves the TLB maintenance to smmu_iova_window_flush, which invalidates
+ * the bank once for all the deferred unmaps and only then releases their IOVAs.
+ * The bank must have a tree attached (smmu_pt_attach); the physical range must be below the limit set by
+ * the TCR2.PASize of the bank (PA_40 for DDR high).
+ */
+
+#define SMMU_IOVA_MAX_WINDOWS     4
+#define SMMU_IOVA_WINDOW_PAGES    16384 // 64MB at most per window
+
+typedef struct {
+	u32 maps;
+	u32 unmaps;
+	u32 block_maps;  // ranges given a 2MB aligned IOVA
+	u32 full;        // no IOVA range large enough in the window
+	u32 deferred_unmaps;
+	u32 flushes;     // TLB invalidations for deferred unmaps
+} smmu_iova_stats;
+
+int smmu_iova_window_init(u8 cb, u32 base, u32 size);
+void smmu_iova_window_destroy(u8 cb);
+int smmu_iova_window_map(u8 cb, u64 pa, u32 size, u64 attrs, u32* iova);
+int smmu_iova_window_unmap(u8 cb, u32 iova, u32 size);
+int smmu_iova_window_unmap_deferred(u8 cb, u32 iova, u32 size);
+u32 smmu_iova_window_flush(u8 cb);
+u32 smmu_iova_window_pending(u8 cb);
+void smmu_iova_get_stats(smmu_iova_stats* stats);
+
+#endif
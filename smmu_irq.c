@@ -0,0 +1,276 @@
+#include "smmu_irq.h"
+#include "smmu_fault.h"
+
+typedef struct {
+	smmu_irq_handler handler;
+	void* arg;
+} smmu_irq_hook;
+
+static XScuGic* smmu_irq_gic;
+static u32 smmu_irq_id;
+static smmu_irq_hook smmu_irq_hooks[N_CBs];
+static u16 smmu_irq_cb_mask;   // banks with a handler
+static smmu_irq_global_handler smmu_irq_global;
+static void* smmu_irq_global_arg;
+static smmu_irq_stats smmu_irq_counters;
+
+// fault storm accounting: a bank is either serviced by the interrupt or by the poller
+typedef struct {
+	u32   window_faults;
+	XTime window_start;
+} smmu_irq_window;
+
+static volatile u16 smmu_irq_polled_mask;
+static smmu_irq_window smmu_irq_windows[N_CBs];
+static smmu_irq_bank_stats smmu_irq_bank_counters[N_CBs];
+static u32 smmu_irq_storm_high = SMMU_IRQ_STORM_HIGH;
+static u32 smmu_irq_storm_low = SMMU_IRQ_STORM_LOW;
+static XTime smmu_irq_window_counts = (XTime)SMMU_IRQ_STORM_WINDOW_US*COUNTS_PER_SECOND/1000000;
+
+// Connects the SMMU line intr_id of the initialized GIC to smmu_irq_dispatch and enables it
+int smmu_irq_init(XScuGic* gic, u32 intr_id){
+	if (XScuGic_Connect(gic, intr_id, (Xil_ExceptionHandler)smmu_irq_dispatch, NULL) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+	smmu_irq_gic = gic;
+	smmu_irq_id = intr_id;
+	XScuGic_Enable(gic, intr_id);
+
+	return XST_SUCCESS;
+}
+
+// Targets the SMMU line to the APU core cpu only, with the GIC priority (0 highest, steps of 8)
+int smmu_irq_set_affinity(u8 cpu, u8 priority){
+	u8 old_priority, trigger;
+
+	if (smmu_irq_gic == NULL || cpu >= SMMU_IRQ_CPUS){
+		return XST_FAILURE;
+	}
+
+	XScuGic_Disable(smmu_irq_gic, smmu_irq_id);
+	for (u8 i=0; i<SMMU_IRQ_CPUS; i++){
+		if (i != cpu){
+			XScuGic_InterruptUnmapFromCpu(smmu_irq_gic, i, smmu_irq_id);
+		}
+	}
+	XScuGic_InterruptMaptoCpu(smmu_irq_gic, cpu, smmu_irq_id);
+	XScuGic_GetPriorityTriggerType(smmu_irq_gic, smmu_irq_id, &old_priority, &trigger);
+	XScuGic_SetPriorityTriggerType(smmu_irq_gic, smmu_irq_id, priority & 0xF8, trigger);
+	XScuGic_Enable(smmu_irq_gic, smmu_irq_id);
+
+	return XST_SUCCESS;
+}
+
+void smmu_irq_set_handler(u8 cb, smmu_irq_handler handler, void* arg){
+	smmu_irq_hooks[cb].arg = arg;
+	smmu_irq_hooks[cb].handler = handler;
+	if (handler != NULL){
+		smmu_irq_cb_mask |= 1U << cb;
+	}
+	else {
+		smmu_irq_cb_mask &= ~(1U << cb);
+	}
+}
+
+void smmu_irq_set_global_handler(smmu_irq_global_handler handler, void* arg){
+	smmu_irq_global_arg = arg;
+	smmu_irq_global = handler;
+}
+
+// Bank handler for the banks serviced by smmu_fault.c
+void smmu_irq_fault_handler(u8 cb, u32 fsr, void* arg){
+	smmu_fault_service(cb);
+}
+
+static void smmu_irq_set_cfie(u8 cb, u8 cfie){
+	u32 targetReg = SMMU_CBn_SCTLR_base + cb*CBn_offset;
+
+	Xil_Out32(targetReg, (Xil_In32(targetReg) & ~FIELD_MASK(SCTLR_CFIE)) | FIELD_PREP(SCTLR_CFIE, cfie));
+}
+
+/* Counts n faults of the bank in the current window. Returns the rate in faults per second when the window
+ * is complete, -1 otherwise.
+ */
+static s64 smmu_irq_rate(u8 cb, u32 n, XTime now){
+	smmu_irq_window* window = &smmu_irq_windows[cb];
+	smmu_irq_bank_stats* stats = &smmu_irq_bank_counters[cb];
+	XTime elapsed = now - window->window_start;
+	u32 rate;
+
+	window->window_faults += n;
+	stats->faults += n;
+	if (elapsed < smmu_irq_window_counts){
+		return -1;
+	}
+
+	rate = (u32)((u64)window->window_faults*COUNTS_PER_SECOND / elapsed);
+	stats->rate = rate;
+	if (rate > stats->peak_rate){
+		stats->peak_rate = rate;
+	}
+	window->window_faults = 0;
+	window->window_start = now;
+
+	return rate;
+}
+
+// Fault of a bank serviced by the interrupt: the bank goes to the poller above the high limit
+static void smmu_irq_storm_check(u8 cb, XTime now){
+	smmu_irq_window* window = &smmu_irq_windows[cb];
+	s64 rate = smmu_irq_rate(cb, 1, now);
+	// the limit of a window is reached before the window ends
+	u64 window_limit = (u64)smmu_irq_storm_high*smmu_irq_window_counts / COUNTS_PER_SECOND;
+
+	if (smmu_irq_storm_high == 0){
+		return;
+	}
+	if ((rate >= 0 && rate > smmu_irq_storm_high) || (rate < 0 && window->window_faults > window_limit)){
+		smmu_irq_set_cfie(cb, 0x0);
+		smmu_irq_polled_mask |= 1U << cb;
+		smmu_irq_bank_counters[cb].polled = 1;
+		smmu_irq_bank_counters[cb].throttles++;
+		window->window_faults = 0;
+		window->window_start = now;
+	}
+}
+
+static void smmu_irq_account(XTime entry){
+	XTime now, counts;
+
+	XTime_GetTime(&now);
+	counts = now - entry;
+	smmu_irq_counters.total_dispatch_counts += counts;
+	if (counts > smmu_irq_counters.max_dispatch_counts){
+		smmu_irq_counters.max_dispatch_counts = counts;
+	}
+}
+
+void smmu_irq_dispatch(void* ref){
+	u32 sgfsr, isr;
+	u16 pending;
+	u8 serviced = 0;
+	XTime entry;
+
+	XTime_GetTime(&entry);
+	smmu_irq_counters.interrupts++;
+
+	// acknowledge the line first: a fault raised from now on asserts it again
+	isr = Xil_In32(SMMU_REG_ISR0);
+	Xil_Out32(SMMU_REG_ISR0, isr);
+
+	sgfsr = Xil_In32(SMMU_SGFSR);
+	if (sgfsr != 0){
+		smmu_irq_counters.global++;
+		serviced = 1;
+		if (smmu_irq_global != NULL){
+			smmu_irq_account(entry);
+			smmu_irq_global(sgfsr, smmu_irq_global_arg);
+		}
+		else {
+			Xil_Out32(SMMU_SGFSR, sgfsr);
+		}
+	}
+
+	// the banks with a handler, lowest first, but the polled ones
+	pending = smmu_irq_cb_mask & ~smmu_irq_polled_mask;
+	while (pending != 0){
+		u8 cb = __builtin_ctz(pending);
+		u32 fsr = Xil_In32(SMMU_CBn_FSR_base + cb*CBn_offset);
+
+		pending &= pending - 1;
+		if ((fsr & (FIELD_MASK(FSR_FAULTS) | FIELD_MASK(FSR_SS))) == 0){
+			continue;
+		}
+		smmu_irq_counters.cb_faults[cb]++;
+		serviced = 1;
+		smmu_irq_account(entry);
+		smmu_irq_hooks[cb].handler(cb, fsr, smmu_irq_hooks[cb].arg);
+		smmu_irq_storm_check(cb, entry);
+	}
+
+	// the banks without a handler, at every interrupt: a stalled one would otherwise hang its master while the
+	// handled banks keep faulting. Cleared, a stalled transaction is terminated
+	for (u8 cb=0; cb<N_CBs; cb++){
+		u32 fsr;
+
+		if ((smmu_irq_cb_mask | smmu_irq_polled_mask) & (1U << cb)){
+			continue;
+		}
+		fsr = Xil_In32(SMMU_CBn_FSR_base + cb*CBn_offset);
+		if ((fsr & (FIELD_MASK(FSR_FAULTS) | FIELD_MASK(FSR_SS))) != 0){
+			Xil_Out32(SMMU_CBn_FSR_base + cb*CBn_offset, fsr & ~FIELD_MASK(FSR_SS));
+			if (FIELD_GET(FSR_SS, fsr)){
+				resume_CBn(cb, 0x1);
+			}
+			smmu_irq_counters.unhandled++;
+			serviced = 1;
+		}
+	}
+	if (!serviced){
+		smmu_irq_counters.spurious++;
+	}
+}
+
+void smmu_irq_get_stats(smmu_irq_stats* stats){
+	*stats = smmu_irq_counters;
+}
+
+// high 0 disables the throttling
+void smmu_irq_set_storm_limits(u32 high, u32 low, u32 window_us){
+	smmu_irq_storm_high = high;
+	smmu_irq_storm_low = low;
+	smmu_irq_window_counts = (XTime)window_us*COUNTS_PER_SECOND/1000000;
+}
+
+/* The dispatch sets the bits of smmu_irq_polled_mask from the ISR: out of it, the read-modify-write runs with
+ * the SMMU line disabled, so that no bit set meanwhile is lost.
+ */
+static void smmu_irq_clear_polled(u8 cb){
+	if (smmu_irq_gic != NULL){
+		XScuGic_Disable(smmu_irq_gic, smmu_irq_id);
+	}
+	smmu_irq_polled_mask &= ~(1U << cb);
+	if (smmu_irq_gic != NULL){
+		XScuGic_Enable(smmu_irq_gic, smmu_irq_id);
+	}
+}
+
+/* Services the polled banks, returns the number of faults found.
+ * A bank whose last window is at or below the low limit gets its interrupt back.
+ */
+u32 smmu_irq_poll(void){
+	u16 pending = smmu_irq_polled_mask & smmu_irq_cb_mask;
+	u32 n_faults = 0;
+	XTime now;
+
+	while (pending != 0){
+		u8 cb = __builtin_ctz(pending);
+		u32 fsr = Xil_In32(SMMU_CBn_FSR_base + cb*CBn_offset);
+		u32 n = 0;
+		s64 rate;
+
+		pending &= pending - 1;
+		if ((fsr & (FIELD_MASK(FSR_FAULTS) | FIELD_MASK(FSR_SS))) != 0){
+			n = 1 + FIELD_GET(FSR_MULTI, fsr);
+			smmu_irq_hooks[cb].handler(cb, fsr, smmu_irq_hooks[cb].arg);
+			smmu_irq_bank_counters[cb].polled_faults += n;
+			n_faults += n;
+		}
+
+		XTime_GetTime(&now);
+		rate = smmu_irq_rate(cb, n, now);
+		if (rate >= 0 && rate <= smmu_irq_storm_low){
+			smmu_irq_bank_counters[cb].polled = 0;
+			smmu_irq_bank_counters[cb].restores++;
+			smmu_irq_clear_polled(cb);
+			dsb();
+			smmu_irq_set_cfie(cb, 0x1);
+		}
+	}
+
+	return n_faults;
+}
+
+void smmu_irq_get_bank_stats(u8 cb, smmu_irq_bank_stats* stats){
+	*stats = smmu_irq_bank_counters[cb];
+}
@@ -0,0 +1,64 @@
+#ifndef __SMMU_IRQ_H_
+#define __SMMU_IRQ_H_
+
+#include "xscugic.h"
+#include "smmu_driver.h"
+
+/* SMMU interrupt dispatch.
+ * The ZynqMP SMMU signals its global and context faults on one GIC line (XPAR_XSMMU_FPD_INTR), summarized
+ * in SMMU_REG ISR0. smmu_irq_dispatch, connected to that line by smmu_irq_init, acknowledges ISR0, calls
+ * the global handler if sGFSR reports a fault, then reads the FSR of the banks with a handler only and calls
+ * the handler of each faulting bank, no printing. The handler owns the FSR of its bank: it clears the fault
+ * bits (and resumes a stalled transaction), e.g. smmu_irq_fault_handler forwards the bank to
+ * smmu_fault_service. The banks without a handler are then read as well, their faults cleared (a stalled
+ * transaction terminated) and counted as unhandled.
+ * smmu_irq_set_affinity targets the line to one APU core, so the faults are taken by a housekeeping core
+ * and not by the data-plane ones, and sets its GIC priority.
+ *
+ * Fault storms: the faults of each bank are counted over windows of window_us. A bank whose rate goes
+ * above the high limit has SMMU_CBn_SCTLR.CFIE cleared and is left to smmu_irq_poll, to be called from a
+ * low priority context (main loop, idle task), which runs its handler on the faults found in the FSR and
+ * sets CFIE again once the rate of a window is at or below the low limit. The FSR holds one fault between
+ * two polls (FSR.MULTI is set for the others, counted as one more): the polled rate is a lower bound.
+ */
+
+#define SMMU_IRQ_CPUS             4 // APU cores
+#define SMMU_IRQ_STORM_HIGH       1000  // faults per second above which a bank is polled
+#define SMMU_IRQ_STORM_LOW        100   // faults per second at or below which a polled bank gets interrupts again
+#define SMMU_IRQ_STORM_WINDOW_US  10000
+
+typedef void (*smmu_irq_handler)(u8 cb, u32 fsr, void* arg);
+typedef void (*smmu_irq_global_handler)(u32 sgfsr, void* arg);
+
+typedef struct {
+	u32 interrupts;
+	u32 global;
+	u32 unhandled;   // context faults of banks without a handler
+	u32 spurious;    // interrupts without a fault
+	u32 cb_faults[N_CBs];
+	XTime max_dispatch_counts;   // ISR entry to the handler call
+	XTime total_dispatch_counts;
+} smmu_irq_stats;
+
+typedef struct {
+	u32 faults;         // interrupt and polled
+	u32 polled_faults;
+	u32 rate;           // faults per second of the last complete window
+	u32 peak_rate;
+	u32 throttles;      // switches to polled mode
+	u32 restores;       // switches back to interrupts
+	u8  polled;
+} smmu_irq_bank_stats;
+
+int smmu_irq_init(XScuGic* gic, u32 intr_id);
+int smmu_irq_set_affinity(u8 cpu, u8 priority);
+void smmu_irq_set_handler(u8 cb, smmu_irq_handler handler, void* arg);
+void smmu_irq_set_global_handler(smmu_irq_global_handler handler, void* arg);
+void smmu_irq_dispatch(void* ref);
+void smmu_irq_fault_handler(u8 cb, u32 fsr, void* arg);
+void smmu_irq_get_stats(smmu_irq_stats* stats);
+void smmu_irq_set_storm_limits(u32 high, u32 low, u32 window_us);
+u32 smmu_irq_poll(void);
+void smmu_irq_get_bank_stats(u8 cb, smmu_irq_bank_stats* stats);
+
+#endif
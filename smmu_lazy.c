@@ -0,0 +1,141 @@
+#include "smmu_lazy.h"
+
+typedef struct {
+	u8  used;
+	u8  cb;
+	u8  prefetch;
+	u8  reserved;
+	u32 va;
+	u32 size;
+	u32 granule;
+	u64 pa;
+	u64 attrs;
+} smmu_lazy_range;
+
+static smmu_lazy_range smmu_lazy_ranges[SMMU_LAZY_MAX_RANGES];
+static smmu_lazy_stats smmu_lazy_counters;
+
+void smmu_lazy_install(u8 cb){
+	smmu_fault_set_handler(cb, smmu_lazy_fault_handler, NULL);
+	smmu_fault_enable_stall(cb, 0x1);
+}
+
+/* Reserves a lazy range. granule is SMMU_PT_BLOCK_4KB or SMMU_PT_BLOCK_2MB, va, pa and size must be
+ * aligned to it. prefetch is the number of granules mapped after the faulting one.
+ */
+int smmu_lazy_map(u8 cb, u32 va, u64 pa, u32 size, u64 attrs, u32 granule, u8 prefetch){
+	if ((granule != SMMU_PT_BLOCK_4KB && granule != SMMU_PT_BLOCK_2MB) || size == 0 ||
+			((va | pa | size) & (granule - 1)) != 0){
+		xil_printf("Error, lazy range 0x%08X (0x%08X bytes) is not aligned to the granule\n\r", va, size);
+		return XST_FAILURE;
+	}
+
+	for (int i=0; i<SMMU_LAZY_MAX_RANGES; i++){
+		smmu_lazy_range* range = &smmu_lazy_ranges[i];
+
+		if (range->used && range->cb == cb && va < range->va + range->size && range->va < va + size){
+			xil_printf("Error, lazy range 0x%08X overlaps the range at 0x%08X\n\r", va, range->va);
+			return XST_FAILURE;
+		}
+	}
+
+	for (int i=0; i<SMMU_LAZY_MAX_RANGES; i++){
+		smmu_lazy_range* range = &smmu_lazy_ranges[i];
+
+		if (!range->used){
+			range->cb = cb;
+			range->va = va;
+			range->pa = pa;
+			range->size = size;
+			range->attrs = attrs;
+			range->granule = granule;
+			range->prefetch = prefetch;
+			dsb();
+			range->used = 1;
+			smmu_lazy_counters.ranges++;
+			return XST_SUCCESS;
+		}
+	}
+
+	xil_printf("Error, no free lazy ranges\n\r");
+	return XST_FAILURE;
+}
+
+// Removes the lazy range starting at va, with the granules populated so far
+int smmu_lazy_unmap(u8 cb, u32 va){
+	for (int i=0; i<SMMU_LAZY_MAX_RANGES; i++){
+		smmu_lazy_range* range = &smmu_lazy_ranges[i];
+
+		if (range->used && range->cb == cb && range->va == va){
+			range->used = 0;
+			dsb();
+			smmu_lazy_counters.ranges--;
+			return smmu_unmap(cb, range->va, range->size);
+		}
+	}
+
+	return XST_FAILURE;
+}
+
+static const smmu_lazy_range* smmu_lazy_lookup(u8 cb, u32 va){
+	for (int i=0; i<SMMU_LAZY_MAX_RANGES; i++){
+		const smmu_lazy_range* range = &smmu_lazy_ranges[i];
+
+		if (range->used && range->cb == cb && va - range->va < range->size){
+			return range;
+		}
+	}
+	return NULL;
+}
+
+// Maps the granule of the range at va if it is not mapped yet
+static int smmu_lazy_populate(const smmu_lazy_range* range, u32 va){
+	u64 pa;
+
+	if (walk_Table_32_lpae(smmu_pt_root(range->cb), va, &pa) == XST_SUCCESS){
+		return 0;
+	}
+	if (smmu_map(range->cb, va, range->pa + (va - range->va), range->granule, range->attrs) != XST_SUCCESS){
+		return -1;
+	}
+	return 1;
+}
+
+smmu_fault_action smmu_lazy_fault_handler(const smmu_fault* fault, void* arg){
+	u32 far = (u32)fault->far;
+	const smmu_lazy_range* range = smmu_lazy_lookup(fault->cb, far);
+	int populated;
+	u32 va;
+
+	if (range == NULL || FIELD_GET(FSR_TF, fault->fsr) == 0 || smmu_pt_root(fault->cb) == NULL){
+		smmu_lazy_counters.unresolved++;
+		return SMMU_FAULT_TERMINATE;
+	}
+
+	// the granule can be mapped already when more transactions stalled on it
+	va = far & ~(range->granule - 1);
+	populated = smmu_lazy_populate(range, va);
+	if (populated < 0){
+		smmu_lazy_counters.unresolved++;
+		return SMMU_FAULT_TERMINATE;
+	}
+	smmu_lazy_counters.faults++;
+	smmu_lazy_counters.granules += populated;
+
+	// prefetch the next granules of the range: a failure here only costs a later fault
+	for (int i=0; i<range->prefetch; i++){
+		va += range->granule;
+		if (va - range->va >= range->size){
+			break;
+		}
+		if (smmu_lazy_populate(range, va) > 0){
+			smmu_lazy_counters.prefetched++;
+		}
+	}
+
+	return SMMU_FAULT_RETRY;
+}
+
+void smmu_lazy_get_stats(smmu_lazy_stats* stats){
+	*stats = smmu_lazy_counters;
+}
@@ -0,0 +1,33 @@
+#ifndef __SMMU_LAZY_H_
+#define __SMMU_LAZY_H_
+
+#include "smmu_pgtable.h"
+#include "smmu_fault.h"
+
+/* Lazy (demand-populated) mappings.
+ * smmu_lazy_map only reserves [va, va + size) -> [pa, pa + size) on a context bank: no descriptor is written.
+ * The first access of a master to a granule of the range takes a translation fault, stalled by the SMMU;
+ * smmu_lazy_fault_handler maps the granule (4KB page or 2MB block) and the next prefetch granules of the
+ * range that are still unmapped, then retries the transaction.
+ * The work done on a fault is bounded: a lookup among SMMU_LAZY_MAX_RANGES ranges and at most
+ * 1 + prefetch granules mapped.
+ * smmu_lazy_install sets the handler and enables stalling on the bank, SMMU_sCR0.STALLD must be 0.
+ */
+
+#define SMMU_LAZY_MAX_RANGES      16
+
+typedef struct {
+	u32 ranges;
+	u32 faults;      // faults resolved by the lazy ranges
+	u32 unresolved;  // faults outside the ranges, or not translation faults: terminated
+	u32 granules;    // granules mapped on a fault
+	u32 prefetched;  // granules mapped ahead of a fault
+} smmu_lazy_stats;
+
+void smmu_lazy_install(u8 cb);
+int smmu_lazy_map(u8 cb, u32 va, u64 pa, u32 size, u64 attrs, u32 granule, u8 prefetch);
+int smmu_lazy_unmap(u8 cb, u32 va);
+smmu_fault_action smmu_lazy_fault_handler(const smmu_fault* fault, void* arg);
+void smmu_lazy_get_stats(smmu_lazy_stats* stats);
+
+#endif
@@ -0,0 +1,688 @@
+#include <string.h>
+#include "smmu_pgtable.h"
+
+#define SMMU_TCACHE_VALID         0x80000000U
+#define SMMU_TCACHE_KEY(cb, vpn)  (SMMU_TCACHE_VALID | ((vpn) << 4) | (cb))
+#define SMMU_TCACHE_INDEX(cb, vpn) (((vpn) ^ ((u32)(cb) << 4)) & (SMMU_TCACHE_ENTRIES - 1))
+#define SMMU_TCACHE_ROOT(l1_table) ((u32)((UINTPTR)(l1_table) / GRANULARITY))
+
+typedef struct {
+	u32 key;  // valid, VA page [23:4], CB [3:0]
+	u32 root; // page of the level 1 table the entry was walked from
+	u64 pa;   // output address of the page
+} smmu_tcache_entry;
+
+// next level tables allocated by one map, for its rollback: L2 tables by VA[31:30], L3 tables by VA[31:21]
+typedef struct {
+	u32 n_tables;
+	u8  l2;
+	u8  l3[4*N_ENTRIES/8]; // valid once n_tables > 0
+} smmu_pt_new_tables;
+
+typedef struct {
+	u64 (*pages)[N_ENTRIES];
+	u16* refs;  // links to the page, 0 if free
+	u32 n_pages;
+	u32 walk_attrs; // TCR IRGN0, ORGN0, SH0 of the walks to the pool
+} smmu_pt_region;
+
+// table pages: the table walker accesses them by physical address (flat mapping of the processor)
+static u64 smmu_pt_pool[SMMU_PT_POOL_PAGES][N_ENTRIES] __attribute__((aligned(GRANULARITY)));
+static u64 smmu_pt_pool_ocm[SMMU_PT_OCM_PAGES][N_ENTRIES] __attribute__((section(".smmu_pt_ocm"), aligned(GRANULARITY)));
+static u64 smmu_pt_pool_ddr_high[SMMU_PT_DDR_HIGH_PAGES][N_ENTRIES] __attribute__((section(".smmu_pt_ddr_high"), aligned(GRANULARITY)));
+static u16 smmu_pt_pool_refs[SMMU_PT_POOL_PAGES];
+static u16 smmu_pt_pool_ocm_refs[SMMU_PT_OCM_PAGES];
+static u16 smmu_pt_pool_ddr_high_refs[SMMU_PT_DDR_HIGH_PAGES];
+
+static const smmu_pt_region smmu_pt_regions[SMMU_PT_PLACEMENTS] = {
+	[SMMU_PT_DDR_LOW]  = {smmu_pt_pool, smmu_pt_pool_refs, SMMU_PT_POOL_PAGES, SMMU_PT_WALK_WB},
+	[SMMU_PT_OCM]      = {smmu_pt_pool_ocm, smmu_pt_pool_ocm_refs, SMMU_PT_OCM_PAGES, SMMU_PT_WALK_NC},
+	[SMMU_PT_DDR_HIGH] = {smmu_pt_pool_ddr_high, smmu_pt_pool_ddr_high_refs, SMMU_PT_DDR_HIGH_PAGES, SMMU_PT_WALK_WB},
+};
+
+static u64* smmu_pt_roots[N_CBs];
+
+static smmu_tcache_entry smmu_tcache[SMMU_TCACHE_ENTRIES];
+static smmu_tcache_stats smmu_tcache_counters;
+static smmu_pt_share_stats smmu_pt_share_counters;
+static u32 smmu_pt_relinks; // tables split or freed by a map: the walk caches of the bank can point to them
+
+u64* smmu_pt_alloc_table_in(enum smmu_pt_placement placement){
+	const smmu_pt_region* region;
+
+	if (placement >= SMMU_PT_PLACEMENTS){
+		return NULL;
+	}
+	region = &smmu_pt_regions[placement];
+
+	for (u32 i=0; i<region->n_pages; i++){
+		if (!region->refs[i]){
+			region->refs[i] = 1;
+			memset(region->pages[i], 0x0, GRANULARITY);
+			Xil_DCacheFlushRange((INTPTR)region->pages[i], GRANULARITY);
+			return region->pages[i];
+		}
+	}
+
+	xil_printf("Error, no free translation table pages in pool %d\n\r", placement);
+	return NULL;
+}
+
+u64* smmu_pt_alloc_table(void){
+	return smmu_pt_alloc_table_in(SMMU_PT_DDR_LOW);
+}
+
+// Returns the pool of a table page, -1 if it is not a page of the pools
+int smmu_pt_placement_of(const u64* table){
+	for (int p=0; p<SMMU_PT_PLACEMENTS; p++){
+		const smmu_pt_region* region = &smmu_pt_regions[p];
+
+		if ((UINTPTR)table >= (UINTPTR)region->pages && (UINTPTR)table < (UINTPTR)(region->pages + region->n_pages)){
+			return p;
+		}
+	}
+	return -1;
+}
+
+// Reference count of a table page, NULL if it is not a page of the pools
+static u16* pt_refs_of(const u64* table){
+	int placement = smmu_pt_placement_of(table);
+	const smmu_pt_region* region;
+
+	if (placement < 0){
+		return NULL;
+	}
+	region = &smmu_pt_regions[placement];
+	return &region->refs[((UINTPTR)table - (UINTPTR)region->pages) / GRANULARITY];
+}
+
+// Drops a reference to the table page: the page is free once no tree links it
+void smmu_pt_free_table(u64* table){
+	u16* refs = pt_refs_of(table);
+
+	if (refs == NULL){
+		xil_printf("Error, 0x%08X is not a table page of the pools\n\r", (UINTPTR)table);
+		return;
+	}
+	if (*refs > 0){
+		(*refs)--;
+	}
+}
+
+// Number of table entries and banks linking the table page, 0 if it is free or not a page of the pools
+u32 smmu_pt_table_refs(const u64* table){
+	u16* refs = pt_refs_of(table);
+
+	return refs != NULL ? *refs : 0;
+}
+
+u32 smmu_pt_free_pages(void){
+	u32 n_free = 0;
+
+	for (int p=0; p<SMMU_PT_PLACEMENTS; p++){
+		for (u32 i=0; i<smmu_pt_regions[p].n_pages; i++){
+			n_free += !smmu_pt_regions[p].refs[i];
+		}
+	}
+	return n_free;
+}
+
+// Sets the walk attributes of the bank to the ones of the pool its tree lives in
+void smmu_pt_set_walk_attrs(u8 cb, enum smmu_pt_placement placement){
+	u32 targetReg = SMMU_CBn_TCR_base + cb*CBn_offset;
+	u32 mask = FIELD_MASK(TCR_IRGN0) | FIELD_MASK(TCR_ORGN0) | FIELD_MASK(TCR_SH0);
+
+	if (placement < SMMU_PT_PLACEMENTS){
+		Xil_Out32(targetReg, (Xil_In32(targetReg) & ~mask) | smmu_pt_regions[placement].walk_attrs);
+	}
+}
+
+static int pt_table_is_empty(const u64* table){
+	for (int i=0; i<N_ENTRIES; i++){
+		if (table[i] & LPAE_DESC_VALID){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int pt_is_table(u64 entry){
+	return (entry & (LPAE_DESC_VALID | LPAE_DESC_TABLE)) == (LPAE_DESC_VALID | LPAE_DESC_TABLE);
+}
+
+/* Copy-on-write of the shared table (at level) that entry links: entry is relinked to a private copy in the
+ * same pool and the shared table loses a reference, the tables the copy links gain one.
+ * The copy translates as the shared table, but the walk caches of the bank can still point to the shared
+ * one, which the other trees keep changing: the caller invalidates the TLB of the bank.
+ */
+static u64* pt_cow(u64* entry, int level){
+	u64* shared = (u64*)(UINTPTR)(*entry & LPAE_DESC_OA_MASK);
+	u64* copy;
+
+	for (int i=0; level < 3 && i<N_ENTRIES; i++){
+		if (pt_is_table(shared[i]) && smmu_pt_table_refs((u64*)(UINTPTR)(shared[i] & LPAE_DESC_OA_MASK)) >= SMMU_PT_MAX_REFS){
+			xil_printf("Error, too many links to the tables of 0x%08X\n\r", (UINTPTR)shared);
+			return NULL;
+		}
+	}
+	copy = smmu_pt_alloc_table_in(smmu_pt_placement_of(shared));
+	if (copy == NULL){
+		return NULL;
+	}
+
+	memcpy(copy, shared, GRANULARITY);
+	for (int i=0; level < 3 && i<N_ENTRIES; i++){
+		if (pt_is_table(copy[i])){
+			(*pt_refs_of((u64*)(UINTPTR)(copy[i] & LPAE_DESC_OA_MASK)))++;
+		}
+	}
+	Xil_DCacheFlushRange((INTPTR)copy, GRANULARITY);
+
+	*entry = ((u64)(UINTPTR)copy & LPAE_DESC_OA_MASK) | LPAE_DESC_TABLE | LPAE_DESC_VALID;
+	publish_Table_Entry(entry);
+	smmu_pt_free_table(shared);
+
+	smmu_pt_share_counters.cow_splits++;
+	smmu_pt_relinks++;
+	return copy;
+}
+
+/* Clears the entries of the table at level that translate [va, va + size), freeing the next level tables
+ * left empty. A block can only be removed as a whole. A shared table covered by the range is unlinked, one
+ * partly covered is split first (pt_cow): the other trees linking it keep their mappings.
+ * The freed pages can still be cached by the table walker: the TLB must be invalidated before they are
+ * reused, i.e. before the next map. freed_tables also counts the unlinked and split tables, which need the
+ * same invalidation.
+ */
+static int pt_unmap_level(u64* table, int level, u32 va, u64 size, u32* freed_tables){
+	u8 shift = 39 - 9*level; // 30, 21, 12
+	u64 block = 1ULL << shift;
+
+	while (size > 0){
+		u64* entry = &table[(va >> shift) & (N_ENTRIES - 1)];
+		u64 offset = va & (block - 1);
+		u64 chunk = block - offset;
+
+		if (chunk > size){
+			chunk = size;
+		}
+
+		if (*entry & LPAE_DESC_VALID){
+			if (level < 3 && (*entry & LPAE_DESC_TABLE)){
+				u64* next = (u64*)(UINTPTR)(*entry & LPAE_DESC_OA_MASK);
+
+				// shared table covered by the range: only the link of this tree goes
+				if (smmu_pt_table_refs(next) > 1 && chunk == block){
+					*entry = 0x0;
+					publish_Table_Entry(entry);
+					smmu_pt_free_table(next);
+					if (freed_tables != NULL){
+						(*freed_tables)++;
+					}
+				}
+				else {
+					if (smmu_pt_table_refs(next) > 1){
+						next = pt_cow(entry, level + 1);
+						if (next == NULL){
+							return XST_FAILURE;
+						}
+						if (freed_tables != NULL){
+							(*freed_tables)++;
+						}
+					}
+					if (pt_unmap_level(next, level + 1, va, chunk, freed_tables) != XST_SUCCESS){
+						return XST_FAILURE;
+					}
+					// freed_tables NULL: the emptied tables stay linked
+					if (freed_tables != NULL && pt_table_is_empty(next)){
+						*entry = 0x0;
+						publish_Table_Entry(entry);
+						smmu_pt_free_table(next);
+						(*freed_tables)++;
+					}
+				}
+			}
+			else if (chunk != block){
+				xil_printf("Error, partial unmap of the block at 0x%08X\n\r", (u32)(va - offset));
+				return XST_FAILURE;
+			}
+			else {
+				*entry = 0x0;
+				publish_Table_Entry(entry);
+			}
+		}
+
+		va += chunk;
+		size -= chunk;
+	}
+
+	return XST_SUCCESS;
+}
+
+static int pt_unmap(u64* l1_table, u32 va, u32 size, u32* freed_tables){
+	if (l1_table == NULL || ((va | size) & (GRANULARITY - 1)) != 0){
+		xil_printf("Error, unmap of 0x%08X (0x%08X bytes) is not page aligned\n\r", va, size);
+		return XST_FAILURE;
+	}
+	return pt_unmap_level(l1_table, 1, va, size, freed_tables);
+}
+
+int smmu_pt_unmap(u64* l1_table, u32 va, u32 size){
+	u32 freed_tables = 0;
+
+	return pt_unmap(l1_table, va, size, &freed_tables);
+}
+
+/* Same as smmu_pt_unmap, but the emptied next level tables stay linked: for a range mapped again soon, and
+ * for unmaps whose TLB maintenance is deferred, as a freed table could be reused while the walk caches of
+ * the bank still point to it.
+ */
+int smmu_pt_unmap_keep_tables(u64* l1_table, u32 va, u32 size){
+	return pt_unmap(l1_table, va, size, NULL);
+}
+
+// Unlinks and frees the tables allocated by the failed map, emptied by its rollback
+static void pt_free_new_tables(u64* l1_table, const smmu_pt_new_tables* new_tables){
+	for (u32 i=0; i<4; i++){
+		u64* l2;
+
+		if (!pt_is_table(l1_table[i])){
+			continue;
+		}
+		l2 = (u64*)(UINTPTR)(l1_table[i] & LPAE_DESC_OA_MASK);
+		for (u32 j=0; j<N_ENTRIES; j++){
+			u32 index = i*N_ENTRIES + j;
+
+			if (new_tables->l3[index / 8] & (1U << (index % 8))){
+				u64* l3 = (u64*)(UINTPTR)(l2[j] & LPAE_DESC_OA_MASK);
+
+				l2[j] = 0x0;
+				publish_Table_Entry(&l2[j]);
+				smmu_pt_free_table(l3);
+				smmu_pt_relinks++;
+			}
+		}
+		if (new_tables->l2 & (1U << i)){
+			l1_table[i] = 0x0;
+			publish_Table_Entry(&l1_table[i]);
+			smmu_pt_free_table(l2);
+			smmu_pt_relinks++;
+		}
+	}
+}
+
+/* Maps [va, va + size) to pa using the largest blocks allowed by the alignment of va and pa and not larger
+ * than max_block (1GB L1 blocks, 2MB L2 blocks, 4KB L3 pages). attrs are the descriptor attribute fields
+ * (AttrIndx, AP, SH, AF, nG, XN...), the descriptor type and output address are set here.
+ * The range must not be mapped already. The shared tables on the way are split (pt_cow).
+ * On failure the part mapped so far is removed, and the tables allocated here freed: the tables that were
+ * there before stay linked, even if left empty, as the walker can cache them. The tables allocated by the call
+ * are tracked on its stack, so a map from the fault handler can interrupt another one.
+ */
+int smmu_pt_map_max_block(u64* l1_table, u32 va, u64 pa, u32 size, u64 attrs, u32 max_block){
+	u32 start_va = va;
+	u64 remaining = size;
+	smmu_pt_new_tables new_tables;
+
+	if (l1_table == NULL || ((va | pa | size) & (GRANULARITY - 1)) != 0 || max_block < SMMU_PT_BLOCK_4KB){
+		xil_printf("Error, map of 0x%08X (0x%08X bytes) is not page aligned\n\r", va, size);
+		return XST_FAILURE;
+	}
+	if (pa + size > SMMU_PT_PA_LIMIT){
+		xil_printf("Error, map of 0x%08X onto 0x%016llX is beyond the 40-bit output addresses\n\r", va, pa);
+		return XST_FAILURE;
+	}
+
+	attrs &= ~(LPAE_DESC_VALID | LPAE_DESC_TABLE | LPAE_DESC_OA_MASK);
+	new_tables.n_tables = 0;
+	new_tables.l2 = 0;
+
+	while (remaining > 0){
+		u64* table = l1_table;
+
+		for (int level=1; level<=3; level++){
+			u8 shift = 39 - 9*level;
+			u64 block = 1ULL << shift;
+			u64* entry = &table[(va >> shift) & (N_ENTRIES - 1)];
+
+			// block (level 1-2) or page (level 3)
+			if (block <= max_block && ((va | pa) & (block - 1)) == 0 && remaining >= block){
+				if (*entry & LPAE_DESC_VALID){
+					xil_printf("Error, 0x%08X is already mapped\n\r", va);
+					goto rollback;
+				}
+				*entry = (pa & LPAE_DESC_OA_MASK) | attrs | LPAE_DESC_VALID | (level == 3 ? LPAE_DESC_TABLE : 0x0);
+				publish_Table_Entry(entry);
+
+				va += block;
+				pa += block;
+				remaining -= block;
+				break;
+			}
+
+			// next level table
+			if ((*entry & LPAE_DESC_VALID) == 0){
+				// the tree stays in the pool of its root, the pool of the program image for the other roots
+				int placement = smmu_pt_placement_of(l1_table);
+				u64* next = smmu_pt_alloc_table_in(placement < 0 ? SMMU_PT_DDR_LOW : placement);
+
+				if (next == NULL){
+					goto rollback;
+				}
+				*entry = ((u64)(UINTPTR)next & LPAE_DESC_OA_MASK) | LPAE_DESC_TABLE | LPAE_DESC_VALID;
+				publish_Table_Entry(entry);
+
+				if (new_tables.n_tables++ == 0){
+					memset(new_tables.l3, 0x0, sizeof(new_tables.l3));
+				}
+				if (level == 1){
+					new_tables.l2 |= 1U << (va >> 30);
+				}
+				else {
+					new_tables.l3[va >> 24] |= 1U << ((va >> 21) & 0x7);
+				}
+			}
+			else if ((*entry & LPAE_DESC_TABLE) == 0){
+				xil_printf("Error, 0x%08X is already mapped by a block\n\r", va);
+				goto rollback;
+			}
+			else if (smmu_pt_table_refs((u64*)(UINTPTR)(*entry & LPAE_DESC_OA_MASK)) > 1 && pt_cow(entry, level + 1) == NULL){
+				goto rollback;
+			}
+			table = (u64*)(UINTPTR)(*entry & LPAE_DESC_OA_MASK);
+		}
+	}
+
+	return XST_SUCCESS;
+
+rollback:
+	// the entries written so far were never reachable by a completed map: no TLB maintenance needed for them
+	smmu_pt_unmap_keep_tables(l1_table, start_va, va - start_va);
+	if (new_tables.n_tables > 0){
+		pt_free_new_tables(l1_table, &new_tables);
+	}
+	return XST_FAILURE;
+}
+
+int smmu_pt_map(u64* l1_table, u32 va, u64 pa, u32 size, u64 attrs){
+	return smmu_pt_map_max_block(l1_table, va, pa, size, attrs, SMMU_PT_BLOCK_1GB);
+}
+
+/* Links in dst_l1 the next level tables of src_l1 translating [va, va + size) instead of building them again:
+ * the L2 table of each 1GB of the range, the L3 table of each remaining 2MB (the blocks are copied). A shared
+ * table gains a reference per link, it is split when a tree maps or unmaps part of it, removed from a tree
+ * when its whole range is unmapped and freed with its last link.
+ * va and size must be 2MB aligned, the range mapped in src_l1 with tables of the pool of dst_l1 and not mapped
+ * in dst_l1. On failure the part linked so far is removed.
+ */
+int smmu_pt_share(u64* dst_l1, u64* src_l1, u32 va, u32 size){
+	int placement = smmu_pt_placement_of(dst_l1);
+	u32 start_va = va;
+	u64 remaining = size;
+
+	if (dst_l1 == NULL || src_l1 == NULL || dst_l1 == src_l1 || size == 0 || ((va | size) & (SMMU_PT_BLOCK_2MB - 1)) != 0){
+		xil_printf("Error, share of 0x%08X (0x%08X bytes) is not 2MB aligned\n\r", va, size);
+		return XST_FAILURE;
+	}
+	if (placement < 0){
+		placement = SMMU_PT_DDR_LOW;
+	}
+
+	while (remaining > 0){
+		u64* src_entry = &src_l1[va >> 30];
+		u64* dst_entry = &dst_l1[va >> 30];
+		u32 block = SMMU_PT_BLOCK_1GB;
+
+		// less than 1GB: link the L3 tables from a private L2 table
+		if ((va & (SMMU_PT_BLOCK_1GB - 1)) != 0 || remaining < SMMU_PT_BLOCK_1GB){
+			u64* dst_l2;
+
+			if (!pt_is_table(*src_entry)){
+				xil_printf("Error, 0x%08X is not mapped by an L2 table\n\r", va);
+				goto rollback;
+			}
+			if ((*dst_entry & LPAE_DESC_VALID) == 0){
+				dst_l2 = smmu_pt_alloc_table_in(placement);
+				if (dst_l2 == NULL){
+					goto rollback;
+				}
+				*dst_entry = ((u64)(UINTPTR)dst_l2 & LPAE_DESC_OA_MASK) | LPAE_DESC_TABLE | LPAE_DESC_VALID;
+				publish_Table_Entry(dst_entry);
+			}
+			else if ((*dst_entry & LPAE_DESC_TABLE) == 0){
+				xil_printf("Error, 0x%08X is already mapped by a block\n\r", va);
+				goto rollback;
+			}
+			else if (smmu_pt_table_refs((u64*)(UINTPTR)(*dst_entry & LPAE_DESC_OA_MASK)) > 1 && pt_cow(dst_entry, 2) == NULL){
+				goto rollback;
+			}
+			dst_l2 = (u64*)(UINTPTR)(*dst_entry & LPAE_DESC_OA_MASK);
+
+			src_entry = &((u64*)(UINTPTR)(*src_entry & LPAE_DESC_OA_MASK))[(va >> 21) & (N_ENTRIES - 1)];
+			dst_entry = &dst_l2[(va >> 21) & (N_ENTRIES - 1)];
+			block = SMMU_PT_BLOCK_2MB;
+		}
+
+		if ((*src_entry & LPAE_DESC_VALID) == 0 || (*dst_entry & LPAE_DESC_VALID) != 0){
+			xil_printf("Error, 0x%08X is not mapped in the source or already mapped\n\r", va);
+			goto rollback;
+		}
+		if (*src_entry & LPAE_DESC_TABLE){
+			u64* shared = (u64*)(UINTPTR)(*src_entry & LPAE_DESC_OA_MASK);
+			u16* refs = pt_refs_of(shared);
+
+			if (refs == NULL || smmu_pt_placement_of(shared) != placement || *refs >= SMMU_PT_MAX_REFS){
+				xil_printf("Error, the table of 0x%08X cannot be linked from another pool\n\r", va);
+				goto rollback;
+			}
+			(*refs)++;
+		}
+		*dst_entry = *src_entry;
+		publish_Table_Entry(dst_entry);
+		smmu_pt_share_counters.links++;
+
+		va += block;
+		remaining -= block;
+	}
+
+	return XST_SUCCESS;
+
+rollback:
+	smmu_pt_unmap(dst_l1, start_va, va - start_va);
+	return XST_FAILURE;
+}
+
+static void pt_release(u64* table, int level){
+	// the next level tables of a shared table stay linked by it
+	if (level < 3 && smmu_pt_table_refs(table) == 1){
+		for (int i=0; i<N_ENTRIES; i++){
+			if (pt_is_table(table[i])){
+				pt_release((u64*)(UINTPTR)(table[i] & LPAE_DESC_OA_MASK), level + 1);
+			}
+		}
+	}
+	smmu_pt_free_table(table);
+}
+
+/* Frees a tree built in the pools, whatever is still mapped: its shared tables only lose the links of the
+ * tree. The tree must no longer be used by a bank.
+ */
+void smmu_pt_free_tree(u64* l1_table){
+	// the translations walked from the tree must not hit once its root is reused
+	for (int i=0; i<SMMU_TCACHE_ENTRIES; i++){
+		if (smmu_tcache[i].root == SMMU_TCACHE_ROOT(l1_table)){
+			smmu_tcache[i].key = 0x0;
+		}
+	}
+	pt_release(l1_table, 1);
+}
+
+void smmu_pt_get_share_stats(smmu_pt_share_stats* stats){
+	*stats = smmu_pt_share_counters;
+	stats->shared_tables = 0;
+	stats->saved_pages = 0;
+	for (int p=0; p<SMMU_PT_PLACEMENTS; p++){
+		for (u32 i=0; i<smmu_pt_regions[p].n_pages; i++){
+			if (smmu_pt_regions[p].refs[i] > 1){
+				stats->shared_tables++;
+				stats->saved_pages += smmu_pt_regions[p].refs[i] - 1;
+			}
+		}
+	}
+}
+
+// Same as smmu_pt_map, the AttrIndx of attrs is replaced by the memory type
+int smmu_pt_map_mem(u64* l1_table, u32 va, u64 pa, u32 size, u64 attrs, enum smmu_mem_type type){
+	if (type >= SMMU_MEM_TYPES){
+		xil_printf("Error, invalid memory type %d\n\r", type);
+		return XST_FAILURE;
+	}
+	return smmu_pt_map(l1_table, va, pa, size, (attrs & ~FIELD_MASK(DESC_ATTRINDX)) | SMMU_PT_ATTR_MEM(type));
+}
+
+// Registers the table tree used by the context bank (the one TTBR0 points to)
+void smmu_pt_attach(u8 cb, u64* l1_table){
+	smmu_pt_roots[cb] = l1_table;
+	smmu_tcache_invalidate_cb(cb);
+}
+
+/* Moves the context bank to another tree without flushing its translation cache: the entries are tagged with
+ * the tree they were walked from, those of the other trees of the bank stay until it is switched back.
+ * A tree switched out must not be changed but through smmu_map/smmu_unmap once switched back in.
+ */
+void smmu_pt_switch(u8 cb, u64* l1_table){
+	smmu_pt_roots[cb] = l1_table;
+}
+
+u64* smmu_pt_root(u8 cb){
+	return cb < N_CBs ? smmu_pt_roots[cb] : NULL;
+}
+
+// The walk caches of the bank can still point to the tables split or freed by a map since relinks
+static void pt_invalidate_relinks(u8 cb, u32 relinks){
+	if (smmu_pt_relinks != relinks){
+		invalidate_CBn_by_TLBIALL(cb);
+		sync_CBn_TLB(cb);
+	}
+}
+
+// A new mapping replaces only invalid entries, which are never cached: no TLB maintenance needed but for
+// split tables and the tables freed by a failed map
+int smmu_map(u8 cb, u32 va, u64 pa, u32 size, u64 attrs){
+	u32 relinks = smmu_pt_relinks;
+	int status = smmu_pt_map(smmu_pt_root(cb), va, pa, size, attrs);
+
+	pt_invalidate_relinks(cb, relinks);
+	return status;
+}
+
+int smmu_map_mem(u8 cb, u32 va, u64 pa, u32 size, u64 attrs, enum smmu_mem_type type){
+	u32 relinks = smmu_pt_relinks;
+	int status = smmu_pt_map_mem(smmu_pt_root(cb), va, pa, size, attrs, type);
+
+	pt_invalidate_relinks(cb, relinks);
+	return status;
+}
+
+// Same as smmu_pt_share between the trees of two banks: the links replace invalid entries, as for smmu_map
+int smmu_share(u8 cb, u8 src_cb, u32 va, u32 size){
+	u32 relinks = smmu_pt_relinks;
+	int status = smmu_pt_share(smmu_pt_root(cb), smmu_pt_root(src_cb), va, size);
+
+	pt_invalidate_relinks(cb, relinks);
+	return status;
+}
+
+// Loads the managed attribute table in MAIR0/MAIR1 of the stage 1 context bank
+void smmu_pt_set_mair(u8 cb){
+	Xil_Out32(SMMU_CBn_PRRR_MAIRn_base + cb*CBn_offset, SMMU_MAIR0);
+	Xil_Out32(SMMU_CBn_NMRR_MAIR1_base + cb*CBn_offset, SMMU_MAIR1);
+}
+
+/* Same as remap_Table_Entry_32_lpae on a table of the bank, plus the translation cache maintenance: the
+ * CPU-side translations are dropped unless only the permissions of a valid entry change.
+ */
+u64 smmu_remap(u8 cb, u64* table, u16 entry_index, u32 va, u64 entry_value){
+	u64 old_value = table[entry_index];
+	u64 blackout_counts = remap_Table_Entry_32_lpae(cb, table, entry_index, va, entry_value);
+
+	if ((old_value & LPAE_DESC_VALID) != 0 &&
+			((entry_value & LPAE_DESC_VALID) == 0 || ((old_value ^ entry_value) & ~LPAE_DESC_NO_BBM_MASK) != 0)){
+		smmu_tcache_invalidate_cb(cb);
+	}
+	return blackout_counts;
+}
+
+int smmu_unmap(u8 cb, u32 va, u32 size){
+	u32 freed_tables = 0;
+	int status = pt_unmap(smmu_pt_root(cb), va, size, &freed_tables);
+
+	// on failure part of the range can be unmapped already: the maintenance is always done
+	if (freed_tables == 0 && size / GRANULARITY <= SMMU_TLBI_VA_MAX){
+		for (u32 offset=0; offset<size; offset+=GRANULARITY){
+			invalidate_CBn_by_VAA(cb, va + offset);
+		}
+	}
+	else {
+		invalidate_CBn_by_TLBIALL(cb);
+	}
+	sync_CBn_TLB(cb);
+	smmu_tcache_invalidate(cb, va, size);
+
+	return status;
+}
+
+int smmu_iova_to_phys(u8 cb, u32 va, u64* pa){
+	u32 vpn = va / GRANULARITY;
+	u32 key = SMMU_TCACHE_KEY(cb, vpn);
+	smmu_tcache_entry* entry = &smmu_tcache[SMMU_TCACHE_INDEX(cb, vpn)];
+	u64* root = smmu_pt_root(cb);
+
+	if (entry->key == key && entry->root == SMMU_TCACHE_ROOT(root)){
+		smmu_tcache_counters.hits++;
+		*pa = entry->pa | (va & (GRANULARITY - 1));
+		return XST_SUCCESS;
+	}
+
+	smmu_tcache_counters.misses++;
+	if (root == NULL || walk_Table_32_lpae(root, va, pa) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+
+	entry->key = key;
+	entry->root = SMMU_TCACHE_ROOT(root);
+	entry->pa = *pa & ~(u64)(GRANULARITY - 1);
+	return XST_SUCCESS;
+}
+
+void smmu_tcache_invalidate(u8 cb, u32 va, u32 size){
+	u64 n_pages = ((va & (GRANULARITY - 1)) + (u64)size + GRANULARITY - 1) / GRANULARITY;
+	u32 vpn = va / GRANULARITY;
+
+	if (n_pages >= SMMU_TCACHE_ENTRIES){
+		smmu_tcache_invalidate_cb(cb);
+		return;
+	}
+
+	for (u32 i=0; i<n_pages; i++){
+		smmu_tcache_entry* entry = &smmu_tcache[SMMU_TCACHE_INDEX(cb, vpn + i)];
+
+		if (entry->key == SMMU_TCACHE_KEY(cb, vpn + i)){
+			entry->key = 0x0;
+		}
+	}
+	smmu_tcache_counters.invalidations++;
+}
+
+void smmu_tcache_invalidate_cb(u8 cb){
+	for (int i=0; i<SMMU_TCACHE_ENTRIES; i++){
+		if ((smmu_tcache[i].key & SMMU_TCACHE_VALID) && (smmu_tcache[i].key & 0xF) == cb){
+			smmu_tcache[i].key = 0x0;
+		}
+	}
+	smmu_tcache_counters.invalidations++;
+}
+
+void smmu_tcache_get_stats(smmu_tcache_stats* stats){
+	*stats = smmu_tcache_counters;
+}
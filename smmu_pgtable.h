@@ -0,0 +1,118 @@
+#ifndef __SMMU_PGTABLE_H_
+#define __SMMU_PGTABLE_H_
+
+#include "smmu_driver.h"
+
+/* Translation tables managed by the driver (aarch32 lpae, stage 1, T0SZ = 0, 4KB granule).
+ *
+ * smmu_pt_*: build and tear down mappings in a table tree given its level 1 table. Next level tables are
+ * allocated from a static pool of GRANULARITY-aligned pages; every written entry is published to the
+ * table walker, but no TLB maintenance is done.
+ * smmu_map/smmu_unmap: same on the tree attached to a context bank with smmu_pt_attach, plus the TLB and
+ * the translation cache maintenance.
+ * smmu_iova_to_phys: CPU-side translation of a context bank address, a software walk of the attached
+ * tree fronted by a direct-mapped cache of the last translated pages keyed by (CB, VA page) and tagged with
+ * the tree: smmu_pt_switch moves a bank between trees without dropping their cached translations.
+ * Table placement: the pages come from one pool per memory (DDR low, the OCM, DDR high). A tree lives in
+ * the pool of its level 1 table (smmu_pt_alloc_table_in), smmu_pt_map allocates the next level tables there;
+ * smmu_pt_set_walk_attrs gives the walks of a bank the TCR cacheability and shareability of the pool.
+ * The VAs are 32-bit, the output addresses 40-bit: a 32-bit master reaches DDR high (0x8_0000_0000) through
+ * the mappings of its bank, see smmu_iova.h for windows allocated on demand.
+ * Shared tables: the pool pages are reference counted. smmu_pt_share links the L2/L3 tables of a region of a
+ * tree (firmware mailboxes, shared rings) into other trees, one entry per 1GB or 2MB and per tree instead of
+ * a copy of the tables. A tree that maps or unmaps part of a shared table first gets a private copy of it
+ * (copy-on-write), the other trees are untouched; smmu_map/smmu_unmap invalidate the bank after a split.
+ */
+
+#define SMMU_PT_POOL_PAGES        64  // table pages available for next level tables and roots, DDR low
+#define SMMU_PT_OCM_PAGES         16  // table pages in the OCM (.smmu_pt_ocm of lscript.ld)
+#define SMMU_PT_DDR_HIGH_PAGES    64  // table pages in DDR high (.smmu_pt_ddr_high of lscript.ld)
+#define SMMU_TCACHE_ENTRIES       256 // translation cache entries (power of 2)
+#define SMMU_TLBI_VA_MAX          16  // above this number of pages an unmap invalidates the whole bank
+#define SMMU_PT_MAX_REFS          0xFFFF // links to a table page
+
+#define SMMU_PT_BLOCK_1GB         0x40000000U
+#define SMMU_PT_BLOCK_2MB         0x00200000U
+#define SMMU_PT_BLOCK_4KB         0x00001000U
+#define SMMU_PT_PA_LIMIT          (1ULL << 40) // output addresses, the bank must set TCR2.PASize to PA_40 above 4GB
+
+// descriptor attributes for the mappings (AF set, outer shareable, MAIR index 0)
+#define SMMU_PT_ATTR_RW           (FIELD_PREP(DESC_AF, 1) | FIELD_PREP(DESC_SH, 0x2) | FIELD_PREP(DESC_AP, 0x1))
+#define SMMU_PT_ATTR_RO           (FIELD_PREP(DESC_AF, 1) | FIELD_PREP(DESC_SH, 0x2) | FIELD_PREP(DESC_AP, 0x3))
+#define SMMU_PT_ATTR_NG           FIELD_PREP(DESC_NG, 1) // non-global: the TLB entries are tagged with the ASID
+// stage 2 descriptor attributes: S2AP read/write, MemAttr Normal Inner/Outer Non-cacheable
+#define SMMU_PT_ATTR_S2_RW        (FIELD_PREP(DESC_AF, 1) | FIELD_PREP(DESC_SH, 0x2) | FIELD_PREP(DESC_S2AP, 0x3) | FIELD_PREP(DESC_MEMATTR, 0x5))
+
+enum smmu_pt_placement {SMMU_PT_DDR_LOW = 0, SMMU_PT_OCM = 1, SMMU_PT_DDR_HIGH = 2, SMMU_PT_PLACEMENTS};
+
+// TCR walk attributes of the pools: DDR walks are Inner/Outer WB/WA Inner Shareable, OCM walks Non-cacheable
+#define SMMU_PT_WALK_WB           (FIELD_PREP(TCR_IRGN0, 0x1) | FIELD_PREP(TCR_ORGN0, 0x1) | FIELD_PREP(TCR_SH0, 0x3))
+#define SMMU_PT_WALK_NC           (FIELD_PREP(TCR_IRGN0, 0x0) | FIELD_PREP(TCR_ORGN0, 0x0) | FIELD_PREP(TCR_SH0, 0x0))
+
+/* Memory types of the managed attribute table: smmu_pt_set_mair loads MAIR0/MAIR1 of a bank with it and a
+ * type is the AttrIndx of the descriptors mapped with it (smmu_pt_map_mem, smmu_map_mem). Type 0 is the
+ * NORMAL_IO_NonCacheable attribute the SMMU_PT_ATTR_* mappings have always used.
+ */
+enum smmu_mem_type {
+	SMMU_MEM_NORMAL_NC = 0, // 0x44 Normal, Inner/Outer Non-cacheable
+	SMMU_MEM_DEVICE    = 1, // 0x04 Device-nGnRE: control registers
+	SMMU_MEM_NORMAL_WT = 2, // 0xAA Normal, Inner/Outer Write-Through, Read-Allocate
+	SMMU_MEM_NORMAL_WB = 3, // 0xFF Normal, Inner/Outer Write-Back, Read/Write-Allocate: descriptor rings
+	SMMU_MEM_STREAMING = 4, // 0xCC Normal, Inner/Outer Write-Back, no allocation: streaming buffers
+	SMMU_MEM_TYPES
+};
+
+#define SMMU_MAIR0                0xFFAA0444 // attributes 3-0
+#define SMMU_MAIR1                0x000000CC // attributes 7-4
+#define SMMU_PT_ATTR_MEM(type)    FIELD_PREP(DESC_ATTRINDX, type)
+
+typedef struct {
+	u32 hits;
+	u32 misses;
+	u32 invalidations;
+} smmu_tcache_stats;
+
+typedef struct {
+	u32 links;         // entries linked by smmu_pt_share
+	u32 cow_splits;    // shared tables copied to be changed
+	u32 shared_tables; // table pages linked more than once now
+	u32 saved_pages;   // table pages the extra links spare now
+} smmu_pt_share_stats;
+
+// table pages
+u64* smmu_pt_alloc_table(void);
+u64* smmu_pt_alloc_table_in(enum smmu_pt_placement placement);
+void smmu_pt_free_table(u64* table);
+u32 smmu_pt_free_pages(void);
+u32 smmu_pt_table_refs(const u64* table);
+int smmu_pt_placement_of(const u64* table);
+void smmu_pt_set_walk_attrs(u8 cb, enum smmu_pt_placement placement);
+
+// table tree
+int smmu_pt_map(u64* l1_table, u32 va, u64 pa, u32 size, u64 attrs);
+int smmu_pt_map_max_block(u64* l1_table, u32 va, u64 pa, u32 size, u64 attrs, u32 max_block);
+int smmu_pt_unmap(u64* l1_table, u32 va, u32 size);
+int smmu_pt_unmap_keep_tables(u64* l1_table, u32 va, u32 size);
+int smmu_pt_map_mem(u64* l1_table, u32 va, u64 pa, u32 size, u64 attrs, enum smmu_mem_type type);
+int smmu_pt_share(u64* dst_l1, u64* src_l1, u32 va, u32 size);
+void smmu_pt_free_tree(u64* l1_table);
+void smmu_pt_get_share_stats(smmu_pt_share_stats* stats);
+
+// context banks
+void smmu_pt_attach(u8 cb, u64* l1_table);
+void smmu_pt_switch(u8 cb, u64* l1_table);
+u64* smmu_pt_root(u8 cb);
+int smmu_map(u8 cb, u32 va, u64 pa, u32 size, u64 attrs);
+int smmu_map_mem(u8 cb, u32 va, u64 pa, u32 size, u64 attrs, enum smmu_mem_type type);
+void smmu_pt_set_mair(u8 cb);
+int smmu_unmap(u8 cb, u32 va, u32 size);
+u64 smmu_remap(u8 cb, u64* table, u16 entry_index, u32 va, u64 entry_value);
+int smmu_share(u8 cb, u8 src_cb, u32 va, u32 size);
+int smmu_iova_to_phys(u8 cb, u32 va, u64* pa);
+
+// translation cache
+void smmu_tcache_invalidate(u8 cb, u32 va, u32 size);
+void smmu_tcache_invalidate_cb(u8 cb);
+void smmu_tcache_get_stats(smmu_tcache_stats* stats);
+
+#endif
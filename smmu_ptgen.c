@@ -0,0 +1,97 @@
+#include "smmu_ptgen.h"
+
+// Size of the block or page translating va in the tree of l1_table, 0 if va is not mapped
+static u64 ptgen_leaf_size(const u64* l1_table, u32 va){
+	const u64* table = l1_table;
+
+	for (int level=1; level<=3; level++){
+		u8 shift = 39 - 9*level;
+		u64 desc = table[(va >> shift) & (N_ENTRIES - 1)];
+
+		if ((desc & LPAE_DESC_VALID) == 0){
+			return 0;
+		}
+		if (level == 3 || (desc & LPAE_DESC_TABLE) == 0){
+			return 1ULL << shift;
+		}
+		table = (const u64*)(UINTPTR)(desc & LPAE_DESC_OA_MASK);
+	}
+	return 0;
+}
+
+// checks the first and the last address of every block and page of the mappings with the software walk
+int smmu_ptgen_verify(const smmu_ptgen_image* image){
+	int status = XST_SUCCESS;
+
+	for (u32 i=0; i<image->n_cbs; i++){
+		const smmu_ptgen_cb* cb = &image->cbs[i];
+
+		for (u32 j=0; j<cb->n_mappings; j++){
+			const smmu_ptgen_mapping* m = &cb->mappings[j];
+			u64 end = (u64)m->va + m->size;
+			u64 va = m->va;
+
+			while (va < end){
+				u64 leaf = ptgen_leaf_size(cb->l1_table, va);
+				u64 leaf_end = leaf ? (va | (leaf - 1)) + 1 : end;
+				u64 first_pa, last_pa;
+
+				if (leaf_end > end){
+					leaf_end = end;
+				}
+				if (leaf == 0 || walk_Table_32_lpae(cb->l1_table, va, &first_pa) != XST_SUCCESS ||
+						walk_Table_32_lpae(cb->l1_table, leaf_end - 1, &last_pa) != XST_SUCCESS ||
+						first_pa != m->pa + (va - m->va) || last_pa != m->pa + (leaf_end - 1 - m->va)){
+					xil_printf("Error, CB%d mapping 0x%08X -> 0x%010llX is not in the tables at 0x%08X\n\r", cb->index,
+							m->va, m->pa, (u32)va);
+					status = XST_FAILURE;
+					break;
+				}
+				va = leaf_end;
+			}
+		}
+	}
+
+	return status;
+}
+
+/* Programs the context banks and the stream mapping of the image.
+ * sCR0 is not modified: as in main.c the caller keeps CLIENTPD = 1 before and clears it after.
+ */
+int smmu_ptgen_apply(const smmu_ptgen_image* image){
+	// the tables are initialized data, make sure the walker does not read stale memory
+	for (u32 i=0; i<image->n_pages; i++){
+		Xil_DCacheFlushRange((INTPTR)image->pages[i], GRANULARITY);
+	}
+
+	for (u32 i=0; i<image->n_cbs; i++){
+		const smmu_ptgen_cb* cb = &image->cbs[i];
+
+		Xil_Out32(SMMU_CBn_SCTLR_base + cb->index*CBn_offset, 0x0);
+		Xil_Out32(SMMU_CBA2Rn_base + cb->index*4, cb->cba2r);
+		Xil_Out32(SMMU_CBAR_base + cb->index*4, cb->cbar);
+		Xil_Out32(SMMU_CBn_PRRR_MAIRn_base + cb->index*CBn_offset, cb->mair0);
+		Xil_Out32(SMMU_CBn_TCR_base + cb->index*CBn_offset, cb->tcr);
+		Xil_Out32(SMMU_CBn_TCR2_base + cb->index*CBn_offset, cb->tcr2);
+
+		// TTBR0: ASID [55:48], table address [39:0]
+		Xil_Out64(SMMU_CBn_TTBR0_base + cb->index*CBn_offset, ((u64)cb->asid << 48) | (u64)(UINTPTR)cb->l1_table);
+	}
+
+	// S2CR before the SMR becomes valid
+	for (u32 i=0; i<image->n_streams; i++){
+		Xil_Out32(SMMU_S2CR_base + image->streams[i].smr_index*4, image->streams[i].s2cr);
+	}
+	for (u32 i=0; i<image->n_streams; i++){
+		Xil_Out32(SMMU_SMR_base + image->streams[i].smr_index*4, image->streams[i].smr);
+	}
+
+	dsb();
+	for (u32 i=0; i<image->n_cbs; i++){
+		invalidate_CBn_by_TLBIALL(image->cbs[i].index);
+		sync_CBn_TLB(image->cbs[i].index);
+		Xil_Out32(SMMU_CBn_SCTLR_base + image->cbs[i].index*CBn_offset, image->cbs[i].sctlr);
+	}
+
+	return XST_SUCCESS;
+}
@@ -0,0 +1,51 @@
+#ifndef __SMMU_PTGEN_H_
+#define __SMMU_PTGEN_H_
+
+#include "smmu_driver.h"
+
+/* Translation tables and register values precomputed by tools/smmu_ptgen.
+ * The generated source defines smmu_ptgen_image_data, the tables are already in their final form and
+ * the boot only has to write the registers and point TTBR0 to them.
+ */
+
+typedef struct {
+	u32 va;
+	u64 pa;
+	u32 size;
+} smmu_ptgen_mapping;
+
+typedef struct {
+	u8  index;
+	u8  asid;
+	u64* l1_table;
+	u32 cbar;
+	u32 cba2r;
+	u32 tcr;
+	u32 tcr2;
+	u32 mair0;
+	u32 sctlr;
+	const smmu_ptgen_mapping* mappings;
+	u32 n_mappings;
+} smmu_ptgen_cb;
+
+typedef struct {
+	u8  smr_index;
+	u32 smr;
+	u32 s2cr;
+} smmu_ptgen_stream;
+
+typedef struct {
+	const smmu_ptgen_cb* cbs;
+	u32 n_cbs;
+	const smmu_ptgen_stream* streams;
+	u32 n_streams;
+	u64* const* pages;
+	u32 n_pages;
+} smmu_ptgen_image;
+
+extern const smmu_ptgen_image smmu_ptgen_image_data;
+
+int smmu_ptgen_verify(const smmu_ptgen_image* image);
+int smmu_ptgen_apply(const smmu_ptgen_image* image);
+
+#endif
@@ -0,0 +1,288 @@
+#include "smmu_smr.h"
+
+#define SMMU_SMR_ID_MASK          FIELD_MASK(SMR_ID)
+
+static u32 smmu_smr_shadow[N_SMRs];  // SMR values of the managed range
+static u32 smmu_s2cr_shadow[N_SMRs];
+static u8 smmu_smr_first;
+static u8 smmu_smr_count;
+static u8 smmu_smr_saved_smcfcfg;
+static const smmu_smr_ops* smmu_smr_io;
+static smmu_smr_stats smmu_smr_counters;
+
+#ifndef SMMU_SMR_HOST
+static void smmu_smr_hw_write_smr(u8 index, u32 value){
+	Xil_Out32(SMMU_SMR_base + index*4, value);
+}
+
+static void smmu_smr_hw_write_s2cr(u8 index, u32 value){
+	Xil_Out32(SMMU_S2CR_base + index*4, value);
+}
+
+static u8 smmu_smr_hw_set_smcfcfg(u8 smcfcfg){
+	u32 regVal = Xil_In32(SMMU_sCR0);
+
+	Xil_Out32(SMMU_sCR0, (regVal & ~FIELD_MASK(SCR0_SMCFCFG)) | FIELD_PREP(SCR0_SMCFCFG, smcfcfg));
+	return FIELD_GET(SCR0_SMCFCFG, regVal);
+}
+
+static const smmu_smr_ops smmu_smr_hw_ops = {
+	smmu_smr_hw_write_smr,
+	smmu_smr_hw_write_s2cr,
+	smmu_smr_hw_set_smcfcfg
+};
+#endif
+
+static int smr_valid(u32 smr){
+	return FIELD_GET(SMR_VALID, smr);
+}
+
+static u32 smr_value(u16 stream_id, u16 mask){
+	return FIELD_PREP(SMR_VALID, 1) | FIELD_PREP(SMR_MASK, mask) | FIELD_PREP(SMR_ID, stream_id);
+}
+
+static int smr_covers(u32 smr, u16 stream_id){
+	return smr_valid(smr) && ((FIELD_GET(SMR_ID, smr) ^ stream_id) & ~FIELD_GET(SMR_MASK, smr) & SMMU_SMR_ID_MASK) == 0;
+}
+
+// a mask of the form 2^k - 1, with the stream id aligned to it
+static int smr_is_block(u16 stream_id, u16 mask){
+	return (mask & (mask + 1)) == 0 && (stream_id & mask) == 0 && mask < SMMU_SMR_ID_MASK;
+}
+
+// k for a mask 2^k - 1
+static int smr_order(u16 mask){
+	int k = 0;
+
+	while ((mask >> k) & 0x1){
+		k++;
+	}
+	return k;
+}
+
+static void smmu_smr_write(u8 i, u32 smr){
+	smmu_smr_shadow[i] = smr;
+	smmu_smr_io->write_smr(smmu_smr_first + i, smr);
+}
+
+static void smmu_smr_write_s2cr(u8 i, u32 s2cr){
+	smmu_s2cr_shadow[i] = s2cr;
+	smmu_smr_io->write_s2cr(smmu_smr_first + i, s2cr);
+}
+
+// the updates can make a stream match two entries with the same S2CR for one write
+static void smmu_smr_update_begin(void){
+	smmu_smr_saved_smcfcfg = smmu_smr_io->set_smcfcfg(0);
+}
+
+static void smmu_smr_update_end(void){
+	smmu_smr_io->set_smcfcfg(smmu_smr_saved_smcfcfg);
+}
+
+static int smmu_smr_entry(u16 stream_id){
+	for (int i=0; i<smmu_smr_count; i++){
+		if (smr_covers(smmu_smr_shadow[i], stream_id)){
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int smmu_smr_free_slot(void){
+	for (int i=0; i<smmu_smr_count; i++){
+		if (!smr_valid(smmu_smr_shadow[i])){
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int smmu_smr_free_slots(void){
+	return smmu_smr_count - smmu_smr_used();
+}
+
+// entry i takes the value and the target of entry j, then j is invalidated
+static void smmu_smr_move(u8 i, u8 j){
+	smmu_smr_write_s2cr(i, smmu_s2cr_shadow[j]);
+	smmu_smr_write(i, smmu_smr_shadow[j]);
+	smmu_smr_write(j, 0x0);
+	smmu_smr_counters.moves++;
+}
+
+// Merges one pair of buddy entries with the same target, returns 0 if there is none
+static int smmu_smr_merge_one(void){
+	for (int i=0; i<smmu_smr_count; i++){
+		u32 a = smmu_smr_shadow[i];
+		u16 mask = FIELD_GET(SMR_MASK, a);
+
+		if (!smr_valid(a) || !smr_is_block(FIELD_GET(SMR_ID, a), mask)){
+			continue;
+		}
+		for (int j=i+1; j<smmu_smr_count; j++){
+			u32 b = smmu_smr_shadow[j];
+
+			if (smr_valid(b) && smmu_s2cr_shadow[j] == smmu_s2cr_shadow[i] && FIELD_GET(SMR_MASK, b) == mask &&
+					(FIELD_GET(SMR_ID, a) ^ FIELD_GET(SMR_ID, b)) == (u32)mask + 1){
+				// i widened to the pair first: the streams of j match i and j until j is invalidated
+				smmu_smr_write(i, smr_value(FIELD_GET(SMR_ID, a) & ~(mask + 1), (mask << 1) | 0x1));
+				smmu_smr_write(j, 0x0);
+				smmu_smr_counters.merges++;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void smmu_smr_pack(void){
+	int last = smmu_smr_count - 1;
+
+	for (int i=0; i<last; i++){
+		if (smr_valid(smmu_smr_shadow[i])){
+			continue;
+		}
+		while (last > i && !smr_valid(smmu_smr_shadow[last])){
+			last--;
+		}
+		if (last > i){
+			smmu_smr_move(i, last);
+		}
+	}
+}
+
+static void smmu_smr_compact_locked(void){
+	while (smmu_smr_merge_one());
+	smmu_smr_pack();
+	smmu_smr_counters.compactions++;
+}
+
+/* Manages the SMRs first to first + count - 1, which are invalidated.
+ * ops NULL selects the SMMU registers.
+ */
+int smmu_smr_init(u8 first, u8 count, const smmu_smr_ops* ops){
+	if (first + count > N_SMRs){
+		return XST_FAILURE;
+	}
+#ifdef SMMU_SMR_HOST
+	smmu_smr_io = ops;
+#else
+	smmu_smr_io = ops != NULL ? ops : &smmu_smr_hw_ops;
+#endif
+	smmu_smr_first = first;
+	smmu_smr_count = count;
+
+	for (int i=0; i<count; i++){
+		smmu_smr_write(i, 0x0);
+		smmu_s2cr_shadow[i] = 0x0;
+	}
+
+	return XST_SUCCESS;
+}
+
+// Maps the stream ids stream_id to stream_id + mask to the S2CR target, none of them can be attached already
+int smmu_smr_attach(u16 stream_id, u16 mask, enum s2cr_type type, u8 cb){
+	u32 s2cr = FIELD_PREP(S2CR_TYPE, type) | FIELD_PREP(S2CR_CBNDX, type == TRANSLATION_CB ? cb : 0);
+	int slot;
+
+	if (!smr_is_block(stream_id, mask)){
+		return XST_FAILURE;
+	}
+	for (int i=0; i<smmu_smr_count; i++){
+		u32 smr = smmu_smr_shadow[i];
+
+		if (smr_valid(smr) && ((FIELD_GET(SMR_ID, smr) ^ stream_id) & ~(FIELD_GET(SMR_MASK, smr) | mask)) == 0){
+			return XST_FAILURE;
+		}
+	}
+
+	smmu_smr_update_begin();
+	slot = smmu_smr_free_slot();
+	if (slot < 0){
+		smmu_smr_compact_locked();
+		slot = smmu_smr_free_slot();
+	}
+	if (slot >= 0){
+		// S2CR before the SMR becomes valid
+		smmu_smr_write_s2cr(slot, s2cr);
+		smmu_smr_write(slot, smr_value(stream_id, mask));
+		smmu_smr_counters.attaches++;
+	}
+	else {
+		smmu_smr_counters.full++;
+	}
+	smmu_smr_update_end();
+
+	return slot >= 0 ? XST_SUCCESS : XST_FAILURE;
+}
+
+/* Removes the stream id. A masked entry is split into the buddy blocks of the other streams: the blocks
+ * are written to free SMRs first, the entry is rewritten to the last block.
+ */
+int smmu_smr_detach(u16 stream_id){
+	int entry = smmu_smr_entry(stream_id);
+	int k;
+
+	if (entry < 0){
+		return XST_FAILURE;
+	}
+
+	smmu_smr_update_begin();
+	k = smr_order(FIELD_GET(SMR_MASK, smmu_smr_shadow[entry]));
+	if (k > 1 && smmu_smr_free_slots() < k - 1){
+		// the compaction can move the entry and widen it
+		smmu_smr_compact_locked();
+		entry = smmu_smr_entry(stream_id);
+		k = smr_order(FIELD_GET(SMR_MASK, smmu_smr_shadow[entry]));
+		if (smmu_smr_free_slots() < k - 1){
+			smmu_smr_counters.full++;
+			smmu_smr_update_end();
+			return XST_FAILURE;
+		}
+	}
+
+	for (int j=k-1; j>0; j--){
+		u16 buddy = (stream_id & ~((1U << j) - 1)) ^ (1U << j);
+		int slot = smmu_smr_free_slot();
+
+		smmu_smr_write_s2cr(slot, smmu_s2cr_shadow[entry]);
+		smmu_smr_write(slot, smr_value(buddy, (1U << j) - 1));
+	}
+	// the stream leaves the entry with this write
+	smmu_smr_write(entry, k > 0 ? smr_value(stream_id ^ 0x1, 0x0) : 0x0);
+	if (k > 0){
+		smmu_smr_counters.splits++;
+	}
+	smmu_smr_counters.detaches++;
+	smmu_smr_update_end();
+
+	return XST_SUCCESS;
+}
+
+// Returns the number of used entries
+int smmu_smr_compact(void){
+	smmu_smr_update_begin();
+	smmu_smr_compact_locked();
+	smmu_smr_update_end();
+
+	return smmu_smr_used();
+}
+
+// Returns the SMR index matching the stream id, -1 if it is not attached
+int smmu_smr_find(u16 stream_id){
+	int entry = smmu_smr_entry(stream_id);
+
+	return entry >= 0 ? smmu_smr_first + entry : -1;
+}
+
+int smmu_smr_used(void){
+	int used = 0;
+
+	for (int i=0; i<smmu_smr_count; i++){
+		used += smr_valid(smmu_smr_shadow[i]);
+	}
+	return used;
+}
+
+void smmu_smr_get_stats(smmu_smr_stats* stats){
+	*stats = smmu_smr_counters;
+}
@@ -0,0 +1,57 @@
+#ifndef __SMMU_SMR_H_
+#define __SMMU_SMR_H_
+
+#ifdef SMMU_SMR_HOST
+#include <stdint.h>
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#define XST_SUCCESS               0L
+#define XST_FAILURE               1L
+#include "smmu_fields.h"
+#define N_SMRs                    48
+enum s2cr_type {TRANSLATION_CB = 0b00, BYPASS = 0b01, FAULT = 0b10, RESERVED = 0b11};
+#else
+#include "smmu_driver.h"
+#endif
+
+/* Stream match table management for a range of SMRs.
+ * smmu_smr_attach maps a block of stream ids (id aligned to mask + 1, mask = 2^k - 1) to an S2CR target,
+ * smmu_smr_detach removes a single stream id. smmu_smr_compact merges the buddy entries with the same
+ * S2CR target into one masked entry and packs the used entries at the start of the range; it runs by itself
+ * when an attach or a detach finds no free SMR.
+ * A valid entry only covers attached streams of its target. During the updates an attached stream always
+ * matches at least one entry: an entry is widened, duplicated or written before the entries it replaces
+ * are invalidated. A single register write cannot replace two entries with one, so a stream can match two
+ * entries for the time of the next write: the two entries carry the same S2CR, and SMMU_sCR0.SMCFCFG is
+ * cleared for the duration of the update, so the conflict selects either and raises no fault.
+ * The register writes go through smmu_smr_ops: NULL selects the SMMU registers; a host model can replay
+ * attach/detach traces with its own ops (tools/smr_replay.c, built with SMMU_SMR_HOST).
+ */
+
+typedef struct {
+	void (*write_smr)(u8 index, u32 value);
+	void (*write_s2cr)(u8 index, u32 value);
+	u8   (*set_smcfcfg)(u8 smcfcfg); // returns the previous value
+} smmu_smr_ops;
+
+typedef struct {
+	u32 attaches;
+	u32 detaches;
+	u32 merges;      // two entries merged into one
+	u32 splits;      // masked entry split on a detach
+	u32 moves;       // entries moved by the packing
+	u32 compactions;
+	u32 full;        // attach/detach failed for lack of free SMRs
+} smmu_smr_stats;
+
+int smmu_smr_init(u8 first, u8 count, const smmu_smr_ops* ops);
+int smmu_smr_attach(u16 stream_id, u16 mask, enum s2cr_type type, u8 cb);
+int smmu_smr_detach(u16 stream_id);
+int smmu_smr_compact(void);
+int smmu_smr_find(u16 stream_id);
+int smmu_smr_used(void);
+void smmu_smr_get_stats(smmu_smr_stats* stats);
+
+#endif
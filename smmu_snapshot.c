@@ -0,0 +1,299 @@
+#include <string.h>
+#include "smmu_snapshot.h"
+
+#define SNAPSHOT_ALIGN(x)         (((x) + 7) & ~7U)
+#define LPAE_TABLE_ADDR_MASK      0x000000FFFFFFF000ULL // bits [39:12] of a table descriptor
+#define LPAE_TTBR_ADDR_MASK       0x000000FFFFFFFFE0ULL // bits [39:5] of TTBR0 (aarch32 lpae)
+
+static u32 crc32(const u8* data, u32 len){
+	u32 crc = 0xFFFFFFFF;
+
+	for (u32 i=0; i<len; i++){
+		crc ^= data[i];
+		for (int j=0; j<8; j++){
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 0x1)));
+		}
+	}
+
+	return ~crc;
+}
+
+// a context bank is saved when it is enabled or when a valid SMR routes a stream to it
+static bool cb_in_use(u8 index){
+	if (FIELD_GET(SCTLR_M, Xil_In32(SMMU_CBn_SCTLR_base + index*CBn_offset))){
+		return true;
+	}
+
+	for (int i=0; i<N_SMRs; i++){
+		u32 smr = Xil_In32(SMMU_SMR_base + i*4);
+		u32 s2cr = Xil_In32(SMMU_S2CR_base + i*4);
+
+		if (FIELD_GET(SMR_VALID, smr) && FIELD_GET(S2CR_TYPE, s2cr) == TRANSLATION_CB && FIELD_GET(S2CR_CBNDX, s2cr) == index){
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* First lookup level and number of entries of the TTBR0 table for an aarch32 lpae context bank.
+ * T0SZ = 0-1: the walk starts at level 1 with 2^(2-T0SZ) entries,
+ * T0SZ > 1:   the walk starts at level 2 with 2^(11-T0SZ) entries.
+ */
+static u32 lpae_first_table(u32 tcr, u8* level){
+	u8 t0sz = FIELD_GET(TCR_T0SZ, tcr);
+
+	if (t0sz <= 1){
+		*level = 1;
+		return 1U << (2 - t0sz);
+	}
+
+	*level = 2;
+	return 1U << (11 - t0sz);
+}
+
+typedef struct {
+	u8* blob;
+	u32 max_size;
+	u32 size;
+	u16 n_pages;
+	u64 pages[SMMU_SNAPSHOT_MAX_PAGES];
+} snapshot_writer;
+
+static int add_page(snapshot_writer* w, u64 addr, u32 size){
+	// tables shared by more context banks are saved once
+	for (int i=0; i<w->n_pages; i++){
+		if (w->pages[i] == addr){
+			return XST_SUCCESS;
+		}
+	}
+
+	if (w->n_pages == SMMU_SNAPSHOT_MAX_PAGES || w->size + sizeof(smmu_snapshot_page) + SNAPSHOT_ALIGN(size) > w->max_size){
+		xil_printf("Error, the SMMU snapshot does not fit in %d bytes\n\r", w->max_size);
+		return XST_FAILURE;
+	}
+
+	smmu_snapshot_page* page = (smmu_snapshot_page*)(w->blob + w->size);
+	page->addr = addr;
+	page->size = size;
+	page->reserved = 0;
+	w->size += sizeof(smmu_snapshot_page);
+
+	memcpy(w->blob + w->size, (const void*)(UINTPTR)addr, size);
+	w->size += SNAPSHOT_ALIGN(size);
+
+	w->pages[w->n_pages++] = addr;
+	return XST_SUCCESS;
+}
+
+static int add_tables(snapshot_writer* w, u64 table_addr, u32 n_entries, u8 level){
+	const u64* table = (const u64*)(UINTPTR)table_addr;
+
+	if (add_page(w, table_addr, n_entries*sizeof(u64)) != XST_SUCCESS){
+		return XST_FAILURE;
+	}
+
+	if (level == 3){
+		return XST_SUCCESS;
+	}
+
+	for (u32 i=0; i<n_entries; i++){
+		// table descriptor: bits [1:0] = 0b11 at level 1 and 2
+		if ((table[i] & 0x3) == 0x3){
+			if (add_tables(w, table[i] & LPAE_TABLE_ADDR_MASK, N_ENTRIES, level + 1) != XST_SUCCESS){
+				return XST_FAILURE;
+			}
+		}
+	}
+
+	return XST_SUCCESS;
+}
+
+/* Serializes the global configuration, the valid SMRs with their S2CRs, the used context banks and
+ * the translation tables reachable from their TTBR0 into blob.
+ * Returns the size of the blob, 0 if max_size is not enough.
+ */
+u32 smmu_snapshot_capture(void* blob, u32 max_size){
+	snapshot_writer w;
+	smmu_snapshot_header* header = (smmu_snapshot_header*)blob;
+
+	w.blob = (u8*)blob;
+	w.max_size = max_size;
+	w.size = sizeof(smmu_snapshot_header);
+	w.n_pages = 0;
+
+	if (max_size < sizeof(smmu_snapshot_header)){
+		return 0;
+	}
+
+	memset(header, 0x0, sizeof(smmu_snapshot_header));
+	header->magic = SMMU_SNAPSHOT_MAGIC;
+	header->version = SMMU_SNAPSHOT_VERSION;
+	header->header_size = sizeof(smmu_snapshot_header);
+	header->scr0 = Xil_In32(SMMU_sCR0);
+	header->scr1 = Xil_In32(SMMU_SCR1);
+
+	// SMRs
+	for (int i=0; i<N_SMRs; i++){
+		u32 smr = Xil_In32(SMMU_SMR_base + i*4);
+
+		if (FIELD_GET(SMR_VALID, smr) == 0){
+			continue;
+		}
+
+		if (w.size + sizeof(smmu_snapshot_smr) > max_size){
+			return 0;
+		}
+
+		smmu_snapshot_smr* record = (smmu_snapshot_smr*)(w.blob + w.size);
+		memset(record, 0x0, sizeof(smmu_snapshot_smr));
+		record->index = i;
+		record->smr = smr;
+		record->s2cr = Xil_In32(SMMU_S2CR_base + i*4);
+		w.size += sizeof(smmu_snapshot_smr);
+		header->n_smrs++;
+	}
+
+	// context banks
+	u32 cbs_start = w.size;
+	for (int i=0; i<N_CBs; i++){
+		if (!cb_in_use(i)){
+			continue;
+		}
+
+		if (w.size + sizeof(smmu_snapshot_cb) > max_size){
+			return 0;
+		}
+
+		smmu_snapshot_cb* record = (smmu_snapshot_cb*)(w.blob + w.size);
+		memset(record, 0x0, sizeof(smmu_snapshot_cb));
+		record->index = i;
+		record->cbar  = Xil_In32(SMMU_CBAR_base + i*4);
+		record->cba2r = Xil_In32(SMMU_CBA2Rn_base + i*4);
+		record->sctlr = Xil_In32(SMMU_CBn_SCTLR_base + i*CBn_offset);
+		record->tcr   = Xil_In32(SMMU_CBn_TCR_base + i*CBn_offset);
+		record->tcr2  = Xil_In32(SMMU_CBn_TCR2_base + i*CBn_offset);
+		record->mair0 = Xil_In32(SMMU_CBn_PRRR_MAIRn_base + i*CBn_offset);
+		record->mair1 = Xil_In32(SMMU_CBn_NMRR_MAIR1_base + i*CBn_offset);
+		record->ttbr0 = Xil_In64(SMMU_CBn_TTBR0_base + i*CBn_offset);
+		w.size += sizeof(smmu_snapshot_cb);
+		header->n_cbs++;
+	}
+
+	// translation tables of the aarch32 lpae stage 1 context banks
+	for (int i=0; i<header->n_cbs; i++){
+		smmu_snapshot_cb* record = (smmu_snapshot_cb*)(w.blob + cbs_start) + i;
+		u8 level;
+
+		if (FIELD_GET(CBA2R_VA64, record->cba2r) == VA_64 || FIELD_GET(TCR_EAE, record->tcr) == 0 || FIELD_GET(CBAR_TYPE, record->cbar) == STAGE_2_CONTEXT){
+			xil_printf("Warning, the tables of CB%d are not aarch32 lpae stage 1 and are not saved\n\r", record->index);
+			continue;
+		}
+
+		u32 n_entries = lpae_first_table(record->tcr, &level);
+		if (add_tables(&w, record->ttbr0 & LPAE_TTBR_ADDR_MASK, n_entries, level) != XST_SUCCESS){
+			return 0;
+		}
+	}
+
+	header->n_pages = w.n_pages;
+	header->size = w.size;
+	header->crc = crc32(w.blob + sizeof(smmu_snapshot_header), w.size - sizeof(smmu_snapshot_header));
+
+	return w.size;
+}
+
+int smmu_snapshot_is_valid(const void* blob){
+	const smmu_snapshot_header* header = (const smmu_snapshot_header*)blob;
+
+	if (header->magic != SMMU_SNAPSHOT_MAGIC || header->version != SMMU_SNAPSHOT_VERSION ||
+			header->header_size != sizeof(smmu_snapshot_header) || header->size < sizeof(smmu_snapshot_header)){
+		return false;
+	}
+
+	// do not trust the size of a random OCM content before the crc check
+	if (header->n_smrs > N_SMRs || header->n_cbs > N_CBs || header->n_pages > SMMU_SNAPSHOT_MAX_PAGES ||
+			header->size > sizeof(smmu_snapshot_header) + N_SMRs*sizeof(smmu_snapshot_smr) + N_CBs*sizeof(smmu_snapshot_cb) +
+			SMMU_SNAPSHOT_MAX_PAGES*(sizeof(smmu_snapshot_page) + GRANULARITY)){
+		return false;
+	}
+
+	return crc32((const u8*)blob + sizeof(smmu_snapshot_header), header->size - sizeof(smmu_snapshot_header)) == header->crc;
+}
+
+/* Programs the SMMU from a blob produced by smmu_snapshot_capture.
+ * The order follows the boot sequence of main.c: the SMMU stays in bypass (CLIENTPD = 1) with all the context
+ * banks disabled until tables, context banks and stream mapping are consistent. S2CRs are written before their
+ * SMR becomes valid, then the TLBs are invalidated and the context banks and sCR0 are enabled as captured.
+ */
+int smmu_snapshot_restore(const void* blob){
+	const smmu_snapshot_header* header = (const smmu_snapshot_header*)blob;
+	const u8* cursor = (const u8*)blob + sizeof(smmu_snapshot_header);
+
+	if (!smmu_snapshot_is_valid(blob)){
+		xil_printf("Error, invalid SMMU snapshot\n\r");
+		return XST_FAILURE;
+	}
+
+	const smmu_snapshot_smr* smrs = (const smmu_snapshot_smr*)cursor;
+	cursor += header->n_smrs*sizeof(smmu_snapshot_smr);
+
+	const smmu_snapshot_cb* cbs = (const smmu_snapshot_cb*)cursor;
+	cursor += header->n_cbs*sizeof(smmu_snapshot_cb);
+
+	// bypass while reprogramming
+	Xil_Out32(SMMU_sCR0, header->scr0 | 0x1);
+	Xil_Out32(SMMU_SCR1, header->scr1);
+
+	// translation tables
+	for (int i=0; i<header->n_pages; i++){
+		const smmu_snapshot_page* page = (const smmu_snapshot_page*)cursor;
+		cursor += sizeof(smmu_snapshot_page);
+
+		memcpy((void*)(UINTPTR)page->addr, cursor, page->size);
+		Xil_DCacheFlushRange((INTPTR)page->addr, page->size);
+		cursor += SNAPSHOT_ALIGN(page->size);
+	}
+
+	// context banks
+	for (int i=0; i<N_CBs; i++){
+		Xil_Out32(SMMU_CBn_SCTLR_base + i*CBn_offset, 0x0);
+	}
+
+	for (int i=0; i<header->n_cbs; i++){
+		u8 index = cbs[i].index;
+
+		Xil_Out32(SMMU_CBA2Rn_base + index*4, cbs[i].cba2r);
+		Xil_Out32(SMMU_CBAR_base + index*4, cbs[i].cbar);
+		Xil_Out32(SMMU_CBn_TCR2_base + index*CBn_offset, cbs[i].tcr2);
+		Xil_Out32(SMMU_CBn_TCR_base + index*CBn_offset, cbs[i].tcr);
+		Xil_Out32(SMMU_CBn_PRRR_MAIRn_base + index*CBn_offset, cbs[i].mair0);
+		Xil_Out32(SMMU_CBn_NMRR_MAIR1_base + index*CBn_offset, cbs[i].mair1);
+		Xil_Out64(SMMU_CBn_TTBR0_base + index*CBn_offset, cbs[i].ttbr0);
+	}
+
+	// stream mapping: every SMR not in the snapshot is invalidated
+	for (int i=0; i<N_SMRs; i++){
+		Xil_Out32(SMMU_SMR_base + i*4, 0x0);
+	}
+
+	for (int i=0; i<header->n_smrs; i++){
+		Xil_Out32(SMMU_S2CR_base + smrs[i].index*4, smrs[i].s2cr);
+	}
+
+	for (int i=0; i<header->n_smrs; i++){
+		Xil_Out32(SMMU_SMR_base + smrs[i].index*4, smrs[i].smr);
+	}
+
+	dsb();
+	invalidate_by_STLBIALL();
+	invalidate_by_TLBIALLNSNH();
+
+	for (int i=0; i<header->n_cbs; i++){
+		Xil_Out32(SMMU_CBn_SCTLR_base + cbs[i].index*CBn_offset, cbs[i].sctlr);
+	}
+
+	Xil_Out32(SMMU_sCR0, header->scr0);
+
+	return XST_SUCCESS;
+}
@@ -0,0 +1,70 @@
+#ifndef __SMMU_SNAPSHOT_H_
+#define __SMMU_SNAPSHOT_H_
+
+#include "smmu_driver.h"
+
+/* Binary snapshot of the programmed SMMU state.
+ * The blob is position independent: it can be kept in the OCM (SMMU_SNAPSHOT_SECTION, not cleared at boot)
+ * or programmed in the QSPI flash and restored directly from the QSPI linear region.
+ *
+ * Layout (little endian, every record 8-byte aligned):
+ *   smmu_snapshot_header
+ *   smmu_snapshot_smr   [n_smrs]   only the valid SMRs
+ *   smmu_snapshot_cb    [n_cbs]    only the configured context banks
+ *   smmu_snapshot_page  [n_pages]  each followed by the content of the table page
+ */
+
+#define SMMU_SNAPSHOT_MAGIC       0x534D4D55 // "SMMU"
+#define SMMU_SNAPSHOT_VERSION     1
+#define SMMU_SNAPSHOT_MAX_PAGES   64
+#define SMMU_SNAPSHOT_OCM_SIZE    0x10000
+
+// place a buffer in the OCM section reserved by lscript.ld
+#define SMMU_SNAPSHOT_SECTION     __attribute__((section(".smmu_snapshot"), aligned(64)))
+
+typedef struct {
+	u32 magic;
+	u16 version;
+	u16 header_size;
+	u32 size;      // total size of the blob in bytes
+	u32 crc;       // crc32 of the blob after this header
+	u32 scr0;
+	u32 scr1;
+	u16 n_smrs;
+	u16 n_cbs;
+	u16 n_pages;
+	u16 reserved;
+} smmu_snapshot_header;
+
+typedef struct {
+	u8  index;
+	u8  reserved[3];
+	u32 smr;
+	u32 s2cr;
+	u32 reserved1;
+} smmu_snapshot_smr;
+
+typedef struct {
+	u8  index;
+	u8  reserved[3];
+	u32 cbar;
+	u32 cba2r;
+	u32 sctlr;
+	u32 tcr;
+	u32 tcr2;
+	u32 mair0;
+	u32 mair1;
+	u64 ttbr0;
+} smmu_snapshot_cb;
+
+typedef struct {
+	u64 addr;      // physical address the page is restored to
+	u32 size;      // size in bytes of the content following the record
+	u32 reserved;
+} smmu_snapshot_page;
+
+u32 smmu_snapshot_capture(void* blob, u32 max_size);
+int smmu_snapshot_is_valid(const void* blob);
+int smmu_snapshot_restore(const void* blob);
+
+#endif
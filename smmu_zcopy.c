@@ -0,0 +1,70 @@
+#include "smmu_zcopy.h"
+
+#define SMMU_ZCOPY_CACHE_LINE     64
+
+static smmu_zcopy_stats smmu_zcopy_counters;
+
+// Maps the buffer in the IOVA window of the context bank of the master issuing stream_id
+int smmu_zcopy_map(u16 stream_id, void* buf, u32 size, smmu_zcopy_dir dir, smmu_zcopy_handle* handle){
+	int cb = smmu_dma_stream_cb(stream_id);
+
+	if (cb < 0){
+		xil_printf("Error, stream 0x%04X is not translated by a context bank\n\r", stream_id);
+		smmu_zcopy_counters.failures++;
+		return XST_FAILURE;
+	}
+	return smmu_zcopy_map_cb(cb, buf, size, dir, handle);
+}
+
+// Same as smmu_zcopy_map, for the context bank cb, which must have an IOVA window (smmu_iova_window_init)
+int smmu_zcopy_map_cb(u8 cb, void* buf, u32 size, smmu_zcopy_dir dir, smmu_zcopy_handle* handle){
+	UINTPTR addr = (UINTPTR)buf;
+	u64 attrs = dir == SMMU_ZCOPY_TO_DEVICE ? SMMU_PT_ATTR_RO : SMMU_PT_ATTR_RW;
+
+	handle->mapped = 0;
+	if (size == 0 || smmu_iova_window_map(cb, addr, size, attrs, &handle->iova) != XST_SUCCESS){
+		smmu_zcopy_counters.failures++;
+		return XST_FAILURE;
+	}
+	if (dir != SMMU_ZCOPY_TO_DEVICE && ((addr | size) & (SMMU_ZCOPY_CACHE_LINE - 1)) != 0){
+		smmu_zcopy_counters.unaligned++;
+	}
+
+	// the master must not miss data still in the cache, nor get it overwritten by a later eviction
+	Xil_DCacheFlushRange(addr, size);
+
+	handle->buf = addr;
+	handle->size = size;
+	handle->cb = cb;
+	handle->dir = dir;
+	handle->mapped = 1;
+
+	smmu_zcopy_counters.maps++;
+	if (++smmu_zcopy_counters.pinned > smmu_zcopy_counters.peak_pinned){
+		smmu_zcopy_counters.peak_pinned = smmu_zcopy_counters.pinned;
+	}
+	return XST_SUCCESS;
+}
+
+// Unmaps the buffer once the transfers of the master on it have completed
+int smmu_zcopy_unmap(smmu_zcopy_handle* handle){
+	if (!handle->mapped){
+		return XST_FAILURE;
+	}
+	if (smmu_iova_window_unmap(handle->cb, handle->iova, handle->size) != XST_SUCCESS){
+		smmu_zcopy_counters.failures++;
+		return XST_FAILURE;
+	}
+	if (handle->dir != SMMU_ZCOPY_TO_DEVICE){
+		Xil_DCacheInvalidateRange(handle->buf, handle->size);
+	}
+	handle->mapped = 0;
+
+	smmu_zcopy_counters.unmaps++;
+	smmu_zcopy_counters.pinned--;
+	return XST_SUCCESS;
+}
+
+void smmu_zcopy_get_stats(smmu_zcopy_stats* stats){
+	*stats = smmu_zcopy_counters;
+}
@@ -0,0 +1,50 @@
+#ifndef __SMMU_ZCOPY_H_
+#define __SMMU_ZCOPY_H_
+
+#include "smmu_dma.h"
+#include "smmu_iova.h"
+
+/* Zero-copy DMA on application buffers.
+ * smmu_zcopy_map maps an application buffer, at any address and of any size, in the IOVA window of the
+ * context bank of a master (found from its stream id in the SMRs) and returns the device address: the
+ * master transfers from or to the buffer itself instead of a copy in a DMA buffer.
+ * The permissions follow the direction: a source (SMMU_ZCOPY_TO_DEVICE) is mapped read-only, so a stray
+ * write of the master faults, a destination read/write. The pages around the buffer are mapped with it:
+ * the master can reach the rest of them, and a destination should start and end on cache lines so that no
+ * other data shares its first and last lines (counted in unaligned).
+ * Without paging, pinning is the lifetime of the handle: the buffer must stay allocated until
+ * smmu_zcopy_unmap. The data cache is cleaned at map, so the master reads the data of the CPU, and for a
+ * destination invalidated at unmap, so the CPU reads the data of the master.
+ */
+
+typedef enum {
+	SMMU_ZCOPY_TO_DEVICE = 0,   // source of the master: read-only
+	SMMU_ZCOPY_FROM_DEVICE = 1, // destination of the master: read/write
+	SMMU_ZCOPY_BIDIRECTIONAL = 2
+} smmu_zcopy_dir;
+
+typedef struct {
+	UINTPTR buf;
+	u32 size;
+	u32 iova;   // device address of buf
+	u8  cb;
+	u8  dir;    // smmu_zcopy_dir
+	u8  mapped;
+	u8  reserved;
+} smmu_zcopy_handle;
+
+typedef struct {
+	u32 maps;
+	u32 unmaps;
+	u32 failures;
+	u32 unaligned;   // destinations sharing their first or last cache line
+	u32 pinned;      // handles mapped now
+	u32 peak_pinned;
+} smmu_zcopy_stats;
+
+int smmu_zcopy_map(u16 stream_id, void* buf, u32 size, smmu_zcopy_dir dir, smmu_zcopy_handle* handle);
+int smmu_zcopy_map_cb(u8 cb, void* buf, u32 size, smmu_zcopy_dir dir, smmu_zcopy_handle* handle);
+int smmu_zcopy_unmap(smmu_zcopy_handle* handle);
+void smmu_zcopy_get_stats(smmu_zcopy_stats* stats);
+
+#endif
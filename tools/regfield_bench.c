@@ -0,0 +1,222 @@
+/* regfield_bench: host microbenchmark of the register value composition, setBit* helpers vs smmu_fields.h.
+ *
+ * Compares the two hot paths that build register values at runtime:
+ *   map:            build an lpae page descriptor (valid, page, attr index, AF, AP, SH, output address, XN)
+ *   context switch: build the TTBR0, TCR, SCTLR and S2CR values of a context bank
+ * with the setBitRange32/setBitRange64/setBit32 calls used before smmu_fields.h (out of line, as in the driver,
+ * where they live in smmu_driver.c) and with the FIELD_PREP composition used now.
+ * Reports ns per operation (clock_gettime) and retired instructions per operation (perf_event_open, when the
+ * kernel allows it; otherwise the instruction count is reported as n/a).
+ *
+ * build: gcc -O2 -I. -o regfield_bench tools/regfield_bench.c
+ * usage: regfield_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#include "smmu_fields.h"
+
+// copies of the smmu_driver.c helpers, kept out of line as they are in the driver
+__attribute__((noinline)) void setBitRange32(u32* regVal, u8 end_bit, u8 start_bit, u32 value){
+	u32 numBits = end_bit - start_bit + 1;
+	u32 mask = ((1U << numBits) - 1) << start_bit;
+	*regVal &= ~mask;
+	*regVal |= (value << start_bit) & mask;
+}
+
+__attribute__((noinline)) void setBitRange64(u64* regVal, u8 end_bit, u8 start_bit, u64 value){
+	u8 numBits = end_bit - start_bit + 1;
+	u64 mask = ((1ULL << numBits) - 1) << start_bit;
+	*regVal &= ~mask;
+	*regVal |= (value << start_bit) & mask;
+}
+
+__attribute__((noinline)) void setBit32(u32* regVal, u8 bit_position, u8 value){
+	u32 mask = 1U << bit_position;
+	*regVal &= ~mask;
+	*regVal |= (value << bit_position) & mask;
+}
+
+__attribute__((noinline)) void setBit64(u64* regVal, u8 bit_position, u8 value){
+	u64 mask = 1ULL << bit_position;
+	*regVal &= ~mask;
+	*regVal |= ((u64)value << bit_position) & mask;
+}
+
+typedef struct {
+	u64 ttbr0;
+	u32 tcr;
+	u32 sctlr;
+	u32 s2cr;
+} cb_regs;
+
+// map hot path: 4KB page descriptor
+__attribute__((noinline)) u64 desc_setbit(u64 pa, u8 attr, u8 ap, u8 xn){
+	u64 d = 0;
+	setBit64(&d, 0, 1);
+	setBit64(&d, 1, 1);
+	setBitRange64(&d, 4, 2, attr);
+	setBitRange64(&d, 7, 6, ap);
+	setBitRange64(&d, 9, 8, 0x3);
+	setBit64(&d, 10, 1);
+	setBitRange64(&d, 39, 12, pa >> 12);
+	setBit64(&d, 54, xn);
+	return d;
+}
+
+__attribute__((noinline)) u64 desc_field(u64 pa, u8 attr, u8 ap, u8 xn){
+	return FIELD_PREP(DESC_VALID, 1) | FIELD_PREP(DESC_TYPE, 1) | FIELD_PREP(DESC_ATTRINDX, attr) |
+			FIELD_PREP(DESC_AP, ap) | FIELD_PREP(DESC_SH, 0x3) | FIELD_PREP(DESC_AF, 1) |
+			(pa & FIELD_MASK(DESC_OA)) | FIELD_PREP(DESC_XN, xn);
+}
+
+// context switch hot path: the values written by set_CBnTTBR0_32_lpae_stage1, set_CBn_TCR_lpae_32_stage1,
+// set_SMMU_CBn_SCTLR and set_S2CRn
+__attribute__((noinline)) void cb_setbit(cb_regs* r, u32 table, u8 asid, u8 cb){
+	u64 ttbr0 = 0;
+	setBitRange64(&ttbr0, 31, 0, table);
+	setBitRange64(&ttbr0, 47, 40, 0x0);
+	setBitRange64(&ttbr0, 55, 48, asid);
+
+	u32 tcr = 0;
+	setBitRange32(&tcr, 2, 0, 0);
+	setBitRange32(&tcr, 9, 8, 1);
+	setBitRange32(&tcr, 11, 10, 1);
+	setBitRange32(&tcr, 13, 12, 3);
+	setBitRange32(&tcr, 18, 16, 0);
+	setBit32(&tcr, 31, 1);
+
+	u32 sctlr = 0;
+	setBit32(&sctlr, 0, 1);
+	setBit32(&sctlr, 5, 1);
+	setBit32(&sctlr, 6, 1);
+
+	u32 s2cr = 0;
+	setBitRange32(&s2cr, 17, 16, 0);
+	setBitRange32(&s2cr, 7, 0, cb);
+
+	r->ttbr0 = ttbr0;
+	r->tcr = tcr;
+	r->sctlr = sctlr;
+	r->s2cr = s2cr;
+}
+
+__attribute__((noinline)) void cb_field(cb_regs* r, u32 table, u8 asid, u8 cb){
+	r->ttbr0 = FIELD_PREP(TTBR_ADDR, table) | FIELD_PREP(TTBR_ASID, asid);
+	r->tcr = FIELD_PREP(TCR_T0SZ, 0) | FIELD_PREP(TCR_IRGN0, 1) | FIELD_PREP(TCR_ORGN0, 1) |
+			FIELD_PREP(TCR_SH0, 3) | FIELD_PREP(TCR_T1SZ, 0) | FIELD_PREP(TCR_EAE, 1);
+	r->sctlr = FIELD_PREP(SCTLR_M, 1) | FIELD_PREP(SCTLR_CFRE, 1) | FIELD_PREP(SCTLR_CFIE, 1);
+	r->s2cr = FIELD_PREP(S2CR_TYPE, 0) | FIELD_PREP(S2CR_CBNDX, cb);
+}
+
+static int perf_fd = -1;
+
+static void perf_open(void){
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static void perf_start(void){
+#ifdef __linux__
+	if (perf_fd >= 0){
+		ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+static long long perf_stop(void){
+	long long count = -1;
+#ifdef __linux__
+	if (perf_fd >= 0){
+		ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(perf_fd, &count, sizeof(count)) != sizeof(count)){
+			count = -1;
+		}
+	}
+#endif
+	return count;
+}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile u64 sink;
+
+static void report(const char* name, double ns, long long insns, long iterations){
+	if (insns >= 0){
+		printf("%-24s %8.2f ns/op %8.1f insn/op\n", name, ns / iterations, (double)insns / iterations);
+	}
+	else {
+		printf("%-24s %8.2f ns/op      n/a insn/op\n", name, ns / iterations);
+	}
+}
+
+#define BENCH(name, body) do { \
+		double t0 = now_ns(); \
+		perf_start(); \
+		for (long i = 0; i < iterations; i++){ body; } \
+		long long insns = perf_stop(); \
+		report(name, now_ns() - t0, insns, iterations); \
+	} while (0)
+
+int main(int argc, char** argv){
+	long iterations = argc > 1 ? atol(argv[1]) : 10000000;
+	cb_regs r;
+
+	// both paths must build the same values
+	for (u32 i = 0; i < 4096; i++){
+		u64 pa = (u64)i << 12;
+		cb_regs a, b;
+		if (desc_setbit(pa, i & 0x7, i & 0x3, i & 0x1) != desc_field(pa, i & 0x7, i & 0x3, i & 0x1)){
+			printf("descriptor mismatch at %u\n", i);
+			return 1;
+		}
+		cb_setbit(&a, pa, i & 0xFF, i & 0xF);
+		cb_field(&b, pa, i & 0xFF, i & 0xF);
+		if (a.ttbr0 != b.ttbr0 || a.tcr != b.tcr || a.sctlr != b.sctlr || a.s2cr != b.s2cr){
+			printf("context bank mismatch at %u\n", i);
+			return 1;
+		}
+	}
+
+	perf_open();
+	if (perf_fd < 0){
+		printf("perf_event_open not available, instruction counts not reported\n");
+	}
+	printf("%ld iterations\n", iterations);
+
+	BENCH("map: setBit*", sink += desc_setbit((u64)i << 12, i & 0x7, 0x1, 0x1));
+	BENCH("map: FIELD_PREP", sink += desc_field((u64)i << 12, i & 0x7, 0x1, 0x1));
+	BENCH("ctx switch: setBit*", cb_setbit(&r, (u32)i << 12, i & 0xFF, i & 0xF); sink += r.ttbr0);
+	BENCH("ctx switch: FIELD_PREP", cb_field(&r, (u32)i << 12, i & 0xFF, i & 0xF); sink += r.ttbr0);
+
+	return 0;
+}
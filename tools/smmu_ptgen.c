@@ -0,0 +1,572 @@
+/* smmu_ptgen: build-time generator of the SMMU translation tables (aarch32 lpae, stage 1, 4KB granule).
+ *
+ * Reads a declarative description of the context banks and emits a C source with the GRANULARITY-aligned
+ * table pages, the SMR/S2CR/context bank register values and the list of the mappings, ready to be linked
+ * with smmu_ptgen.c. At boot smmu_ptgen_apply() only writes the registers and points TTBR0 to the tables.
+ * Every block and page of the mappings is checked with a software walk of the tables as they are encoded in
+ * the generated file, before the output is opened: a failed walk leaves no source behind. The result of the
+ * walk is reported in the generated file.
+ *
+ * build: gcc -O2 -o smmu_ptgen tools/smmu_ptgen.c
+ * usage: smmu_ptgen layout.txt smmu_ptgen_image.c
+ *
+ * Layout description (one directive per line, '#' starts a comment, numbers in C notation):
+ *   cb <index> [asid <asid>]                    start the description of a context bank
+ *   stream <smr_index> <tbu> <mid> [mask <m>]   route a stream of the current context bank through an SMR
+ *   bypass <smr_index> <tbu> <mid> [mask <m>]   let a stream bypass the translation (S2CR type BYPASS)
+ *   map <va> <pa> <size> <rw|ro> [attr <idx>] [xn] [ng]
+ *                                               map [va, va+size) to pa, with the largest blocks allowed by
+ *                                               the alignment (1GB L1 blocks, 2MB L2 blocks, 4KB L3 pages)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define N_ENTRIES         512
+#define N_L1_ENTRIES      4      // T0SZ = 0: 32-bit input address space
+#define N_SMRs            48
+#define N_CBs             16
+#define MAX_PAGES         256
+#define MAX_MAPPINGS      256
+#define MAX_STREAMS       N_SMRs
+
+#define BLOCK_L1          0x40000000ULL
+#define BLOCK_L2          0x200000ULL
+#define PAGE_L3           0x1000ULL
+#define OA_MASK           0x000000FFFFFFF000ULL
+#define IMAGE_BASE        0x0010000000ULL // address of page 0 in the encoded pages, the linker one is not known here
+
+// register values, same configuration of main.c
+#define CBAR_STAGE_1_BYPASS_2   (0x1 << 16)
+#define TCR_LPAE_WALK_WBWA      ((1U << 31) | (0x1 << 12) | (0x1 << 10) | (0x1 << 8)) // EAE, SH0, ORGN0, IRGN0
+#define MAIR0_DEFAULT           0x44 // attribute 0: normal, inner/outer non-cacheable
+#define SCTLR_M_CFRE_CFIE       ((1 << 6) | (1 << 5) | (1 << 0))
+
+typedef struct {
+	u64 entries[N_ENTRIES];
+	int child[N_ENTRIES];  // index of the next level page of a table descriptor, -1 otherwise
+	int level;
+	int cb;
+} page;
+
+typedef struct {
+	u32 va;
+	u64 pa;
+	u32 size;
+	u64 attrs;
+} mapping;
+
+typedef struct {
+	bool used;
+	u16 asid;
+	int l1;                // page index of the level 1 table
+	u64 max_pa;
+	int n_mappings;
+	mapping mappings[MAX_MAPPINGS];
+} context_bank;
+
+typedef struct {
+	u8 smr_index;
+	int cb;                // -1 for a bypass stream
+	u16 tbu;
+	u16 mid;
+	u16 mask;
+} stream;
+
+typedef struct {
+	bool ok;
+	int first_level;
+	int last_level;
+} walk_result;
+
+static page pages[MAX_PAGES];
+static u64 images[MAX_PAGES][N_ENTRIES]; // the pages as emitted: table descriptors hold the next level page address
+static int n_pages;
+static walk_result results[N_CBs][MAX_MAPPINGS];
+static context_bank cbs[N_CBs];
+static stream streams[MAX_STREAMS];
+static int n_streams;
+static int line_number;
+
+static void fail(const char* msg){
+	fprintf(stderr, "smmu_ptgen: line %d: %s\n", line_number, msg);
+	exit(1);
+}
+
+static int new_page(int cb, int level){
+	if (n_pages == MAX_PAGES){
+		fail("too many table pages");
+	}
+
+	memset(&pages[n_pages], 0x0, sizeof(page));
+	for (int i=0; i<N_ENTRIES; i++){
+		pages[n_pages].child[i] = -1;
+	}
+	pages[n_pages].level = level;
+	pages[n_pages].cb = cb;
+
+	return n_pages++;
+}
+
+// returns the page of the next level, creating the table descriptor if needed
+static int next_level(int parent, int index, int cb){
+	page* p = &pages[parent];
+
+	if (p->child[index] >= 0){
+		return p->child[index];
+	}
+
+	if (p->entries[index] & 0x1){
+		fail("mapping overlaps a block mapping");
+	}
+
+	int child = new_page(cb, p->level + 1);
+	pages[parent].child[index] = child;
+	pages[parent].entries[index] = 0x3; // table descriptor, the address is resolved by the linker
+	return child;
+}
+
+static void set_leaf(int page_index, int index, u64 value){
+	page* p = &pages[page_index];
+
+	if (p->entries[index] & 0x1){
+		fail("overlapping mappings");
+	}
+	p->entries[index] = value;
+}
+
+static void map_range(int cb, const mapping* m){
+	u64 va = m->va;
+	u64 pa = m->pa;
+	u64 end = (u64)m->va + m->size;
+
+	if ((va | pa | m->size) & (PAGE_L3 - 1)){
+		fail("va, pa and size must be 4KB aligned");
+	}
+
+	while (va < end){
+		int l1 = cbs[cb].l1;
+		u32 i1 = (va >> 30) & 0x3;
+		u32 i2 = (va >> 21) & 0x1FF;
+		u32 i3 = (va >> 12) & 0x1FF;
+
+		if ((va % BLOCK_L1) == 0 && (pa % BLOCK_L1) == 0 && end - va >= BLOCK_L1){
+			// level 1 block: bits [1:0] = 0b01
+			set_leaf(l1, i1, (pa & OA_MASK) | m->attrs | 0x1);
+			va += BLOCK_L1;
+			pa += BLOCK_L1;
+		}
+		else if ((va % BLOCK_L2) == 0 && (pa % BLOCK_L2) == 0 && end - va >= BLOCK_L2){
+			// level 2 block: bits [1:0] = 0b01
+			set_leaf(next_level(l1, i1, cb), i2, (pa & OA_MASK) | m->attrs | 0x1);
+			va += BLOCK_L2;
+			pa += BLOCK_L2;
+		}
+		else {
+			// level 3 page: bits [1:0] = 0b11
+			set_leaf(next_level(next_level(l1, i1, cb), i2, cb), i3, (pa & OA_MASK) | m->attrs | 0x3);
+			va += PAGE_L3;
+			pa += PAGE_L3;
+		}
+	}
+}
+
+// encodes the pages as emit_page writes them, page i at IMAGE_BASE + i*PAGE_L3
+static void encode(void){
+	for (int i=0; i<n_pages; i++){
+		for (int j=0; j<N_ENTRIES; j++){
+			images[i][j] = pages[i].child[j] >= 0 ? (IMAGE_BASE + pages[i].child[j]*PAGE_L3) | 0x3 : pages[i].entries[j];
+		}
+	}
+}
+
+/* Software walk of the encoded pages, the same algorithm of walk_Table_32_lpae in smmu_driver.c.
+ * Returns the size of the block or page translating va, 0 if the walk faults.
+ */
+static u64 walk(int cb, u32 va, u64* pa, int* level){
+	u64 table = IMAGE_BASE + cbs[cb].l1*PAGE_L3;
+
+	for (*level = 1; *level <= 3; (*level)++){
+		u32 shift = 39 - 9*(*level); // 30, 21, 12
+		u64 p = (table - IMAGE_BASE) / PAGE_L3;
+		u64 desc;
+
+		// the descriptor must point to a page of the image at this level
+		if (table < IMAGE_BASE || (table & (PAGE_L3 - 1)) != 0 || p >= (u64)n_pages || pages[p].level != *level){
+			return 0;
+		}
+		desc = images[p][(va >> shift) & 0x1FF];
+
+		if ((desc & 0x1) == 0 || (*level == 3 && (desc & 0x2) == 0)){
+			return 0;
+		}
+
+		if (*level < 3 && (desc & 0x2)){
+			table = desc & OA_MASK;
+			continue;
+		}
+
+		u64 block_mask = (1ULL << shift) - 1;
+		*pa = (desc & OA_MASK & ~block_mask) | (va & block_mask);
+		return 1ULL << shift;
+	}
+
+	return 0;
+}
+
+/* Walks every block and page of the mappings in the encoded pages: the first and the last address of each
+ * must translate to the mapped output. Returns the number of mappings failing the walk.
+ */
+static int check(void){
+	int errors = 0;
+
+	encode();
+	for (int cb=0; cb<N_CBs; cb++){
+		for (int i=0; cbs[cb].used && i<cbs[cb].n_mappings; i++){
+			mapping* m = &cbs[cb].mappings[i];
+			walk_result* r = &results[cb][i];
+			u64 end = (u64)m->va + m->size;
+
+			r->ok = true;
+			for (u64 va = m->va; r->ok && va < end; ){
+				u64 pa, last_pa;
+				int level, last_level = 0;
+				u64 leaf = walk(cb, va, &pa, &level);
+				u64 leaf_end = leaf ? (va | (leaf - 1)) + 1 : end;
+
+				if (leaf_end > end){
+					leaf_end = end;
+				}
+				r->ok = leaf != 0 && pa == m->pa + (va - m->va) && walk(cb, leaf_end - 1, &last_pa, &last_level) != 0 &&
+						last_pa == m->pa + (leaf_end - 1 - m->va);
+				if (va == m->va){
+					r->first_level = level;
+				}
+				r->last_level = last_level;
+				va = leaf_end;
+			}
+			errors += !r->ok;
+		}
+	}
+
+	return errors;
+}
+
+static u64 parse_number(const char* token){
+	char* end;
+
+	if (token == NULL){
+		fail("missing argument");
+	}
+
+	u64 value = strtoull(token, &end, 0);
+	if (*end != '\0'){
+		fail("invalid number");
+	}
+	return value;
+}
+
+static void parse(FILE* in){
+	char line[512];
+	int cb = -1;
+
+	while (fgets(line, sizeof(line), in)){
+		line_number++;
+
+		char* comment = strchr(line, '#');
+		if (comment){
+			*comment = '\0';
+		}
+
+		char* directive = strtok(line, " \t\r\n");
+		if (directive == NULL){
+			continue;
+		}
+
+		if (strcmp(directive, "cb") == 0){
+			cb = parse_number(strtok(NULL, " \t\r\n"));
+			if (cb >= N_CBs || cbs[cb].used){
+				fail("invalid or duplicated context bank");
+			}
+			cbs[cb].used = true;
+			cbs[cb].l1 = new_page(cb, 1);
+
+			char* token = strtok(NULL, " \t\r\n");
+			if (token && strcmp(token, "asid") == 0){
+				cbs[cb].asid = parse_number(strtok(NULL, " \t\r\n")) & 0xFF;
+			}
+		}
+		else if (strcmp(directive, "stream") == 0 || strcmp(directive, "bypass") == 0){
+			bool bypass = strcmp(directive, "bypass") == 0;
+			if (cb < 0 && !bypass){
+				fail("stream outside of a context bank");
+			}
+
+			stream* s = &streams[n_streams];
+			s->cb = bypass ? -1 : cb;
+			s->smr_index = parse_number(strtok(NULL, " \t\r\n"));
+			s->tbu = parse_number(strtok(NULL, " \t\r\n"));
+			s->mid = parse_number(strtok(NULL, " \t\r\n"));
+			s->mask = 0x0;
+
+			char* token = strtok(NULL, " \t\r\n");
+			if (token && strcmp(token, "mask") == 0){
+				s->mask = parse_number(strtok(NULL, " \t\r\n"));
+			}
+
+			if (s->smr_index >= N_SMRs || s->tbu > 0x1F || s->mid > 0x3FF){
+				fail("invalid stream");
+			}
+			for (int i=0; i<n_streams; i++){
+				if (streams[i].smr_index == s->smr_index){
+					fail("SMR already used");
+				}
+			}
+			n_streams++;
+		}
+		else if (strcmp(directive, "map") == 0){
+			if (cb < 0){
+				fail("map outside of a context bank");
+			}
+			if (cbs[cb].n_mappings == MAX_MAPPINGS){
+				fail("too many mappings");
+			}
+
+			mapping* m = &cbs[cb].mappings[cbs[cb].n_mappings++];
+			u64 va = parse_number(strtok(NULL, " \t\r\n"));
+			m->pa = parse_number(strtok(NULL, " \t\r\n"));
+			u64 size = parse_number(strtok(NULL, " \t\r\n"));
+
+			if (va + size > 0x100000000ULL || size == 0 || m->pa + size > 0x10000000000ULL){
+				fail("the input range must be in 32 bits and the output range in 40 bits");
+			}
+			m->va = va;
+			m->size = size;
+
+			// AF [10], SH [9:8] = 0b10 outer shareable, as the entries of main.c
+			m->attrs = (0x1ULL << 10) | (0x2ULL << 8);
+
+			char* ap = strtok(NULL, " \t\r\n");
+			if (ap && strcmp(ap, "rw") == 0){
+				m->attrs |= 0x1ULL << 6;  // AP[2:1] = 0b01 read/write
+			}
+			else if (ap && strcmp(ap, "ro") == 0){
+				m->attrs |= 0x3ULL << 6;  // AP[2:1] = 0b11 read only
+			}
+			else {
+				fail("access must be rw or ro");
+			}
+
+			char* token;
+			while ((token = strtok(NULL, " \t\r\n"))){
+				if (strcmp(token, "attr") == 0){
+					m->attrs |= (parse_number(strtok(NULL, " \t\r\n")) & 0x7) << 2;
+				}
+				else if (strcmp(token, "xn") == 0){
+					m->attrs |= 0x1ULL << 54;
+				}
+				else if (strcmp(token, "ng") == 0){
+					m->attrs |= 0x1ULL << 11;
+				}
+				else {
+					fail("unknown map option");
+				}
+			}
+
+			if (m->pa + size - 1 > cbs[cb].max_pa){
+				cbs[cb].max_pa = m->pa + size - 1;
+			}
+
+			map_range(cb, m);
+		}
+		else {
+			fail("unknown directive");
+		}
+	}
+}
+
+static void page_name(char* name, int index){
+	if (pages[index].level == 1){
+		sprintf(name, "ptgen_cb%d_l1", pages[index].cb);
+	}
+	else {
+		sprintf(name, "ptgen_cb%d_l%d_%d", pages[index].cb, pages[index].level, index);
+	}
+}
+
+static void emit_page(FILE* out, int index){
+	char name[64];
+	int n_entries = pages[index].level == 1 ? N_L1_ENTRIES : N_ENTRIES;
+
+	page_name(name, index);
+	fprintf(out, "static u64 %s[%d] __attribute__((aligned(GRANULARITY))) = {\n", name, n_entries);
+
+	for (int i=0; i<n_entries; i++){
+		u64 desc = images[index][i];
+
+		// table descriptor: the address of the page is resolved by the linker
+		if (pages[index].level < 3 && (desc & 0x3) == 0x3){
+			char child[64];
+			page_name(child, ((desc & OA_MASK) - IMAGE_BASE) / PAGE_L3);
+			fprintf(out, "\t[%d] = (u64)(UINTPTR)((u8*)%s + 0x%" PRIX64 "),\n", i, child, (u64)(desc & ~OA_MASK));
+		}
+		else if (desc != 0){
+			fprintf(out, "\t[%d] = 0x%016" PRIX64 "ULL,\n", i, desc);
+		}
+	}
+
+	fprintf(out, "};\n\n");
+}
+
+static u32 pa_size(u64 max_pa){
+	// TCR2.PASize: 0b000 32 bits, 0b001 36 bits, 0b010 40 bits
+	if (max_pa < (1ULL << 32)){
+		return 0x0;
+	}
+	if (max_pa < (1ULL << 36)){
+		return 0x1;
+	}
+	return 0x2;
+}
+
+static void emit(FILE* out, const char* source){
+	char name[64];
+	int n_cbs = 0;
+
+	fprintf(out, "/* Generated by tools/smmu_ptgen from %s, do not edit. */\n\n", source);
+	fprintf(out, "#include \"smmu_ptgen.h\"\n\n");
+
+	// the pages are emitted from the last level, so every table descriptor refers to an already declared page
+	for (int level=3; level>=1; level--){
+		for (int i=0; i<n_pages; i++){
+			if (pages[i].level == level){
+				emit_page(out, i);
+			}
+		}
+	}
+
+	fprintf(out, "static u64* const ptgen_pages[] = {\n");
+	for (int i=0; i<n_pages; i++){
+		page_name(name, i);
+		fprintf(out, "\t%s,\n", name);
+	}
+	fprintf(out, "};\n\n");
+
+	for (int cb=0; cb<N_CBs; cb++){
+		if (!cbs[cb].used){
+			continue;
+		}
+		n_cbs++;
+
+		fprintf(out, "/* CB%d software walk:\n", cb);
+		for (int i=0; i<cbs[cb].n_mappings; i++){
+			mapping* m = &cbs[cb].mappings[i];
+			walk_result* r = &results[cb][i];
+
+			fprintf(out, " *   0x%08X-0x%08" PRIX64 " -> 0x%010" PRIX64 " (L%d..L%d) %s\n", m->va, (u64)m->va + m->size - 1,
+					m->pa, r->first_level, r->last_level, r->ok ? "OK" : "FAILED");
+		}
+		fprintf(out, " */\n");
+
+		fprintf(out, "static const smmu_ptgen_mapping ptgen_cb%d_mappings[] = {\n", cb);
+		for (int i=0; i<cbs[cb].n_mappings; i++){
+			mapping* m = &cbs[cb].mappings[i];
+			fprintf(out, "\t{0x%08X, 0x%010" PRIX64 "ULL, 0x%08X},\n", m->va, m->pa, m->size);
+		}
+		fprintf(out, "};\n\n");
+	}
+
+	fprintf(out, "static const smmu_ptgen_cb ptgen_cbs[] = {\n");
+	for (int cb=0; cb<N_CBs; cb++){
+		if (!cbs[cb].used){
+			continue;
+		}
+		page_name(name, cbs[cb].l1);
+		fprintf(out, "\t{\n");
+		fprintf(out, "\t\t.index = %d,\n", cb);
+		fprintf(out, "\t\t.asid = 0x%02X,\n", cbs[cb].asid);
+		fprintf(out, "\t\t.l1_table = %s,\n", name);
+		fprintf(out, "\t\t.cbar = 0x%08X,\n", CBAR_STAGE_1_BYPASS_2);
+		fprintf(out, "\t\t.cba2r = 0x%08X,\n", 0x0);
+		fprintf(out, "\t\t.tcr = 0x%08X,\n", TCR_LPAE_WALK_WBWA);
+		fprintf(out, "\t\t.tcr2 = 0x%08X,\n", pa_size(cbs[cb].max_pa));
+		fprintf(out, "\t\t.mair0 = 0x%08X,\n", MAIR0_DEFAULT);
+		fprintf(out, "\t\t.sctlr = 0x%08X,\n", SCTLR_M_CFRE_CFIE);
+		fprintf(out, "\t\t.mappings = ptgen_cb%d_mappings,\n", cb);
+		fprintf(out, "\t\t.n_mappings = %d,\n", cbs[cb].n_mappings);
+		fprintf(out, "\t},\n");
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "static const smmu_ptgen_stream ptgen_streams[] = {\n");
+	for (int i=0; i<n_streams; i++){
+		stream* s = &streams[i];
+		u32 smr = (1U << 31) | ((u32)s->mask << 16) | ((u32)s->tbu << 10) | s->mid;
+
+		if (s->cb < 0){
+			// S2CR type [17:16] = 0b01 BYPASS
+			fprintf(out, "\t{%d, 0x%08X, 0x%08X}, // TBU %d, MID 0x%03X --> BYPASS\n", s->smr_index, smr, 0x1 << 16, s->tbu, s->mid);
+		}
+		else {
+			// S2CR type [17:16] = 0b00 TRANSLATION_CB, CBNDX [7:0]
+			fprintf(out, "\t{%d, 0x%08X, 0x%08X}, // TBU %d, MID 0x%03X --> CB%d\n", s->smr_index, smr, (u32)s->cb, s->tbu, s->mid, s->cb);
+		}
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "const smmu_ptgen_image smmu_ptgen_image_data = {\n");
+	fprintf(out, "\t.cbs = ptgen_cbs,\n");
+	fprintf(out, "\t.n_cbs = %d,\n", n_cbs);
+	fprintf(out, "\t.streams = ptgen_streams,\n");
+	fprintf(out, "\t.n_streams = %d,\n", n_streams);
+	fprintf(out, "\t.pages = ptgen_pages,\n");
+	fprintf(out, "\t.n_pages = %d,\n", n_pages);
+	fprintf(out, "};\n");
+}
+
+int main(int argc, char** argv){
+	if (argc != 3){
+		fprintf(stderr, "usage: %s layout.txt output.c\n", argv[0]);
+		return 1;
+	}
+
+	FILE* in = fopen(argv[1], "r");
+	if (in == NULL){
+		perror(argv[1]);
+		return 1;
+	}
+	parse(in);
+	fclose(in);
+
+	for (int i=0; i<n_streams; i++){
+		if (streams[i].cb >= 0 && !cbs[streams[i].cb].used){
+			fail("stream of an undefined context bank");
+		}
+	}
+
+	int errors = check();
+	if (errors){
+		fprintf(stderr, "smmu_ptgen: %d mappings failed the software walk, %s not written\n", errors, argv[2]);
+		return 1;
+	}
+
+	FILE* out = fopen(argv[2], "w");
+	if (out == NULL){
+		perror(argv[2]);
+		return 1;
+	}
+	emit(out, argv[1]);
+	fclose(out);
+
+	printf("smmu_ptgen: %d table pages, %d streams written to %s\n", n_pages, n_streams, argv[2]);
+	return 0;
+}
@@ -0,0 +1,249 @@
+/* smr_replay: host model of the stream match table, replays attach/detach traces through smmu_smr.c.
+ *
+ * The model applies the SMR, S2CR and sCR0.SMCFCFG writes of smmu_smr.c and checks, after every write:
+ *   - every attached stream matches at least one valid SMR (no unidentified stream fault)
+ *   - a stream matching two or more SMRs does it with SMCFCFG = 0 and the same S2CR in all of them
+ *     (no stream match conflict fault, same translation whatever entry is selected)
+ * and, after every operation, that each attached stream matches exactly one SMR with its S2CR target and
+ * that detached streams match none.
+ *
+ * Trace lines:  a <stream id> <mask> <cb>   attach the block to context bank cb
+ *               d <stream id>               detach a stream
+ *               c                           compact
+ * Without a trace file a random trace is generated: masters attach and detach groups of streams of the
+ * same context bank, as the DMA channels of a TBU do.
+ *
+ * build: gcc -O2 -DSMMU_SMR_HOST -I. -o smr_replay tools/smr_replay.c smmu_smr.c
+ * usage: smr_replay [trace file | -r seed operations] [first smr] [smr count]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smmu_smr.h"
+
+#define N_STREAMS       (1 << 15)
+#define DETACHED        0xFFFFFFFF
+
+static u32 model_smr[N_SMRs];
+static u32 model_s2cr[N_SMRs];
+static u8 model_smcfcfg = 1;
+static u32 target[N_STREAMS];  // S2CR of the attached streams, DETACHED otherwise
+static u16 universe[N_STREAMS]; // streams touched by the trace, the only ones checked
+static int n_universe;
+static u8 in_universe[N_STREAMS];
+static long writes;
+static int errors;
+static int op_line;
+
+static int model_matches(u16 sid, u32* s2cr){
+	int n = 0;
+
+	for (int i=0; i<N_SMRs; i++){
+		u32 smr = model_smr[i];
+
+		if (FIELD_GET(SMR_VALID, smr) && ((FIELD_GET(SMR_ID, smr) ^ sid) & ~FIELD_GET(SMR_MASK, smr) & 0x7FFF) == 0){
+			if (n > 0 && model_s2cr[i] != *s2cr){
+				return -1;
+			}
+			*s2cr = model_s2cr[i];
+			n++;
+		}
+	}
+	return n;
+}
+
+static void check_write(void){
+	for (int i=0; i<n_universe; i++){
+		u16 sid = universe[i];
+		u32 s2cr = 0;
+		int n = model_matches(sid, &s2cr);
+
+		if (n < 0){
+			printf("op %d: stream 0x%04X matches entries with different S2CR\n", op_line, sid);
+			errors++;
+		}
+		else if (n > 1 && model_smcfcfg){
+			printf("op %d: stream 0x%04X matches %d entries with SMCFCFG = 1\n", op_line, sid, n);
+			errors++;
+		}
+		else if (n == 0 && target[sid] != DETACHED){
+			printf("op %d: attached stream 0x%04X matches no entry\n", op_line, sid);
+			errors++;
+		}
+	}
+}
+
+static void check_op(void){
+	for (int i=0; i<n_universe; i++){
+		u16 sid = universe[i];
+		u32 s2cr = 0;
+		int n = model_matches(sid, &s2cr);
+
+		if (target[sid] == DETACHED ? n != 0 : (n != 1 || s2cr != target[sid])){
+			printf("op %d: stream 0x%04X matches %d entries (S2CR 0x%08X, expected 0x%08X)\n", op_line, sid, n,
+					s2cr, target[sid]);
+			errors++;
+		}
+	}
+}
+
+static void model_write_smr(u8 index, u32 value){
+	model_smr[index] = value;
+	writes++;
+	check_write();
+}
+
+static void model_write_s2cr(u8 index, u32 value){
+	model_s2cr[index] = value;
+	writes++;
+	check_write();
+}
+
+static u8 model_set_smcfcfg(u8 smcfcfg){
+	u8 prev = model_smcfcfg;
+
+	model_smcfcfg = smcfcfg;
+	return prev;
+}
+
+static const smmu_smr_ops model_ops = {model_write_smr, model_write_s2cr, model_set_smcfcfg};
+
+static void touch(u16 sid, u16 mask){
+	for (u32 s=sid; s<=(u32)(sid | mask); s++){
+		if (!in_universe[s]){
+			in_universe[s] = 1;
+			universe[n_universe++] = s;
+		}
+	}
+}
+
+static int attached(u16 sid, u16 mask){
+	for (u32 s=sid; s<=(u32)(sid | mask); s++){
+		if (target[s] != DETACHED){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int replay(char op, u16 sid, u16 mask, u8 cb){
+	int status = XST_SUCCESS;
+
+	if (op == 'a'){
+		touch(sid, mask);
+		status = smmu_smr_attach(sid, mask, TRANSLATION_CB, cb);
+		if (status == XST_SUCCESS){
+			for (u32 s=sid; s<=(u32)(sid | mask); s++){
+				target[s] = FIELD_PREP(S2CR_TYPE, TRANSLATION_CB) | FIELD_PREP(S2CR_CBNDX, cb);
+			}
+		}
+	}
+	else if (op == 'd'){
+		u32 prev = target[sid];
+
+		touch(sid, 0);
+		// the stream is detached from the first write on
+		target[sid] = DETACHED;
+		status = smmu_smr_detach(sid);
+		if (status != XST_SUCCESS){
+			target[sid] = prev;
+		}
+	}
+	else if (op == 'c'){
+		smmu_smr_compact();
+	}
+	check_op();
+
+	return status;
+}
+
+int main(int argc, char** argv){
+	int first, count;
+	int used_peak = 0, failed = 0, ops = 0;
+	smmu_smr_stats stats;
+	FILE* trace = NULL;
+	unsigned seed = 1;
+	int n_ops = 100000;
+	int argi = 1;
+
+	if (argc > 1 && strcmp(argv[1], "-r") == 0){
+		seed = argc > 2 ? atoi(argv[2]) : 1;
+		n_ops = argc > 3 ? atoi(argv[3]) : n_ops;
+		argi = 4;
+	}
+	else if (argc > 1){
+		trace = fopen(argv[1], "r");
+		if (trace == NULL){
+			perror(argv[1]);
+			return 1;
+		}
+		argi = 2;
+	}
+	first = argc > argi ? atoi(argv[argi]) : 0;
+	count = argc > argi + 1 ? atoi(argv[argi + 1]) : N_SMRs - first;
+
+	for (int s=0; s<N_STREAMS; s++){
+		target[s] = DETACHED;
+	}
+	if (smmu_smr_init(first, count, &model_ops) != XST_SUCCESS){
+		printf("invalid SMR range %d-%d\n", first, first + count - 1);
+		return 1;
+	}
+	srand(seed);
+
+	while (1){
+		char line[128], op = 0;
+		unsigned sid = 0, mask = 0, cb = 0;
+
+		if (trace != NULL){
+			if (fgets(line, sizeof(line), trace) == NULL){
+				break;
+			}
+			if (sscanf(line, " %c %x %x %u", &op, &sid, &mask, &cb) < 1 || op == '#'){
+				continue;
+			}
+		}
+		else {
+			// 4 TBUs with 16 masters each, the masters of a group of 4 share a context bank
+			unsigned tbu = rand() % 4, mid = rand() % 16;
+
+			if (ops == n_ops){
+				break;
+			}
+			sid = (tbu << 10) | mid;
+			cb = (tbu * 4 + mid / 4) % 16;
+			if (rand() % 64 == 0){
+				op = 'c';
+			}
+			else if (target[sid] != DETACHED){
+				op = 'd';
+			}
+			else {
+				op = 'a';
+				// some masters attach a pair of streams at once
+				if ((mid & 0x1) == 0 && rand() % 4 == 0 && target[sid | 0x1] == DETACHED){
+					mask = 0x1;
+				}
+			}
+		}
+		op_line = ++ops;
+
+		if (op == 'a' && attached(sid, mask)){
+			continue;
+		}
+		if (replay(op, sid, mask, cb) != XST_SUCCESS){
+			failed++;
+		}
+		used_peak = smmu_smr_used() > used_peak ? smmu_smr_used() : used_peak;
+	}
+
+	smmu_smr_get_stats(&stats);
+	printf("%d ops, %ld register writes, %d failed (no free SMR)\n", ops, writes, failed);
+	printf("attaches %u, detaches %u, merges %u, splits %u, moves %u, compactions %u\n", stats.attaches,
+			stats.detaches, stats.merges, stats.splits, stats.moves, stats.compactions);
+	printf("SMRs in use: %d at the end, %d at peak\n", smmu_smr_used(), used_peak);
+	printf("%s: %d violations\n", errors ? "FAILED" : "OK", errors);
+
+	return errors != 0;
+}